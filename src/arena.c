@@ -0,0 +1,141 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+#include "arena.h"
+
+/* data starts right after block header, aligned */
+#define BLOCK_HDR_SIZE \
+  ((sizeof(arena_block) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1))
+#define BLOCK_DATA(b) ((char *) (b) + BLOCK_HDR_SIZE)
+
+static arena_block *
+arena_block_new(size_t size)
+  {
+    arena_block *b = NULL;
+
+    /* calloc() here, so all allocations are zeroed, as with CALLOC() */
+    CALLOC(b, 1, BLOCK_HDR_SIZE + size);
+    b->size = size;
+
+    return b;
+  }
+
+/* returns zeroed memory, exits on failure, like CALLOC() does */
+void *
+arena_alloc(arena * const a, size_t size)
+  {
+    arena_block *b = a->blocks;
+    void *p = NULL;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+    if (b != NULL && b->size - b->used >= size)
+      {
+        p = BLOCK_DATA(b) + b->used;
+        b->used += size;
+        return p;
+      }
+
+    /* too big chunks gets own block, behind current *
+     * one, so free space in current isn't lost      */
+    if (size > ARENA_BLOCK_SIZE / 4)
+      {
+        b = arena_block_new(size);
+        b->used = size;
+        if (a->blocks != NULL)
+          b->next = a->blocks->next, a->blocks->next = b;
+        else
+          a->blocks = b;
+        return BLOCK_DATA(b);
+      }
+
+    b = arena_block_new(ARENA_BLOCK_SIZE);
+    b->next = a->blocks;
+    a->blocks = b;
+    b->used = size;
+
+    return BLOCK_DATA(b);
+  }
+
+char *
+arena_strndup(arena * const a, char const *s, size_t len)
+  {
+    char *p = NULL;
+    char const *nul = NULL;
+
+    if ((nul = memchr(s, '\0', len)) != NULL)
+      len = nul - s;
+
+    p = arena_alloc(a, len + 1);
+    memcpy(p, s, len);
+
+    return p; /* '\0' is already here */
+  }
+
+/* moves all blocks of 'src' to 'dst', behind its current block, *
+ * so data stays valid and lives as long as 'dst' does            */
+void
+arena_join(arena * const dst, arena * const src)
+  {
+    arena_block *last = src->blocks;
+
+    if (last == NULL)
+      return;
+
+    if (dst->blocks == NULL)
+      dst->blocks = src->blocks;
+    else
+      {
+        while (last->next != NULL)
+          last = last->next;
+        last->next = dst->blocks->next;
+        dst->blocks->next = src->blocks;
+      }
+
+    src->blocks = NULL;
+  }
+
+/* drops all data, but keeps current block for reuse, *
+ * so arena for short-living data does not malloc()   */
+void
+arena_reset(arena * const a)
+  {
+    arena_block *b = a->blocks;
+
+    if (b == NULL)
+      return;
+
+    a->blocks = b->next;
+    b->next = NULL;
+    arena_free(a);
+
+    memset(BLOCK_DATA(b), 0, b->used); /* as arena_alloc() returns zeroed memory */
+    b->used = 0;
+    a->blocks = b;
+  }
+
+void
+arena_free(arena * const a)
+  {
+    arena_block *b = NULL;
+
+    while ((b = a->blocks) != NULL)
+      {
+        a->blocks = b->next;
+        free(b);
+      }
+  }
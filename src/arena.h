@@ -0,0 +1,52 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#define ARENA_BLOCK_SIZE (256 * 1024)
+#define ARENA_ALIGN      16
+
+/* wrappers, same as CALLOC() & STRNDUP() in common.h, *
+ * but memory taken from arena and never freed alone   */
+#define ACALLOC(ptr, arena, nmemb, size) \
+  (ptr) = arena_alloc((arena), (nmemb) * (size))
+
+#define ASTRNDUP(ptr, arena, str, len) \
+  (ptr) = arena_strndup((arena), (str), (len))
+
+/* region allocator: memory taken from big blocks *
+ * with simple pointer bump and released at once  */
+typedef struct arena_block
+  {
+    struct arena_block *next;
+    size_t size; /* usable size of block */
+    size_t used;
+  } arena_block;
+
+typedef struct arena
+  {
+    arena_block *blocks; /* head is current block */
+  } arena;
+
+/** function prototypes */
+void *arena_alloc(arena * const, size_t);
+char *arena_strndup(arena * const, char const *, size_t);
+void  arena_join(arena * const, arena * const);
+void  arena_reset(arena * const);
+void  arena_free(arena * const);
+
+#endif /* _ARENA_H */
@@ -0,0 +1,290 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+#include "batch.h"
+
+#define MSG_B_NOJOBS    _("No files to process in '%s'.")
+#define MSG_B_NOOUTPUT  _("Can't guess output file name, specify it in list.")
+#define MSG_B_FAILED    _("Failed: %s")
+#define MSG_B_SUMMARY   _("Batch done: %lu files, %lu ok, %lu failed, %.2fs.\n")
+
+/* range of jobs, owned by one worker. owner takes jobs *
+ * from the front, idle workers steal half from the end */
+struct batch_queue
+  {
+    pthread_mutex_t lock;
+    size_t head;
+    size_t tail;
+  };
+
+struct batch_pool
+  {
+    batch_job *jobs;
+    struct batch_queue queues[BATCH_THREADS_MAX];
+    uint8_t threads;
+    batch_job_f fn;
+    void *arg;
+    context *ctx; /* of main thread, every job gets own copy */
+  };
+
+struct batch_worker
+  {
+    struct batch_pool *pool;
+    uint8_t id;
+  };
+
+/* "dir/file.srt" -> "dir/file.ssa". returns NULL, if new *
+ * name can't be made or it's the same, as input one      */
+static char *
+batch_outname(char const *input, char const *ext)
+  {
+    char const *dot = strrchr(input, '.');
+    char const *slash = strrchr(input, '/');
+    char *out = NULL;
+    size_t len = 0;
+
+    if (ext == NULL)
+      return NULL;
+
+    len = (dot != NULL && (slash == NULL || dot > slash)) ? \
+            (size_t) (dot - input) : strlen(input);
+
+    CALLOC(out, len + strlen(ext) + 1, sizeof(char));
+    memcpy(out, input, len);
+    strcat(out, ext);
+
+    if (strcmp(out, input) == 0)
+      {
+        free(out);
+        return NULL;
+      }
+
+    return out;
+  }
+
+/* one line of list: "<input>" or "<input>\t<output>" */
+static size_t
+batch_read_list(context * const ctx, char const *list, char const *ext,
+                batch_job **jobs)
+  {
+    FILE *f = NULL;
+    char line[MAXLINE] = "";
+    char *tab = NULL;
+    batch_job *j = NULL;
+    size_t n = 0, size = 0;
+
+    if (strcmp(list, "-") == 0)
+      f = stdin;
+    else if ((f = fopen(list, "r")) == NULL)
+      log_msg(ctx, error, MSG_F_ORDFAIL, list);
+
+    while (fgets(line, MAXLINE, f) != NULL)
+      {
+        trim_newline(line);
+        if (line[0] == '\0' || line[0] == '#')
+          continue;
+
+        if (n == size)
+          {
+            size = (size == 0) ? 256 : size * 2;
+            if ((j = realloc(*jobs, size * sizeof(batch_job))) == NULL)
+              log_msg(NULL, error, MSG_M_OOM, __FILE__, __LINE__);
+            *jobs = j;
+          }
+
+        j = &(*jobs)[n++];
+        memset(j, 0, sizeof(batch_job));
+
+        if ((tab = strchr(line, '\t')) != NULL)
+          {
+            *tab++ = '\0';
+            STRNDUP(j->output, tab, strlen(tab));
+          }
+        else
+          j->output = batch_outname(line, ext);
+
+        STRNDUP(j->input, line, strlen(line));
+      }
+
+    if (f != stdin)
+      fclose(f);
+
+    return n;
+  }
+
+/* runs one job with own context. any error here jumps *
+ * back to this function and fails only this job        */
+static void
+batch_job_run(struct batch_pool * const pool, batch_job * const job)
+  {
+    context ctx = *pool->ctx;
+    jmp_buf env;
+
+    ctx.name = job->input;
+    job->ok = false;
+
+    if (setjmp(env) == 0)
+      {
+        ctx.abort = &env;
+
+        if (job->output == NULL)
+          log_msg(&ctx, error, MSG_B_NOOUTPUT);
+        if ((ctx.opts.infile = fopen(job->input, "r")) == NULL)
+          log_msg(&ctx, error, MSG_F_ORDFAIL, job->input);
+        if ((ctx.opts.outfile = fopen(job->output, "w")) == NULL)
+          log_msg(&ctx, error, MSG_F_OWRFAIL, job->output);
+        ctx.opts.o_name = job->output;
+
+        job->ok = pool->fn(&ctx, pool->arg);
+      }
+
+    if (ctx.opts.infile  != NULL) fclose(ctx.opts.infile);
+    if (ctx.opts.outfile != NULL) fclose(ctx.opts.outfile);
+
+    /* don't leave half-written files */
+    if (!job->ok && ctx.opts.outfile != NULL)
+      unlink(job->output);
+  }
+
+/* takes next job from own queue or steals from others */
+static bool
+batch_take(struct batch_pool * const pool, uint8_t id, size_t *job)
+  {
+    struct batch_queue *q = &pool->queues[id], *v = NULL;
+    size_t head = 0, tail = 0;
+    bool found = false;
+    uint8_t i = 0;
+
+    pthread_mutex_lock(&q->lock);
+    if ((found = (q->head < q->tail)) == true)
+      *job = q->head++;
+    pthread_mutex_unlock(&q->lock);
+
+    if (found)
+      return true;
+
+    for (i = 1; i < pool->threads && !found; i++)
+      {
+        v = &pool->queues[(id + i) % pool->threads];
+        pthread_mutex_lock(&v->lock);
+        if ((found = (v->head < v->tail)) == true)
+          {
+            tail = v->tail;
+            head = v->tail - (v->tail - v->head + 1) / 2;
+            v->tail = head;
+          }
+        pthread_mutex_unlock(&v->lock);
+      }
+
+    if (!found) /* all queues are empty, no more work */
+      return false;
+
+    pthread_mutex_lock(&q->lock);
+    *job = head;
+    q->head = head + 1, q->tail = tail;
+    pthread_mutex_unlock(&q->lock);
+
+    return true;
+  }
+
+static void *
+batch_worker(void *arg)
+  {
+    struct batch_worker *w = arg;
+    size_t i = 0;
+
+    while (batch_take(w->pool, w->id, &i))
+      batch_job_run(w->pool, &w->pool->jobs[i]);
+
+    return NULL;
+  }
+
+/* Processes all files from 'list' with 'fn' in 'threads' (0 - number  *
+ * of cpus) parallel jobs. Each job gets copy of 'ctx'. Files without  *
+ * output name in list get it from input one with extension replaced   *
+ * to 'ext', if it's not NULL. Prints summary, returns true, if all    *
+ * files was processed fine.                                           */
+bool
+batch_run(context * const ctx, char const *list, char const *ext,
+          uint8_t threads, batch_job_f fn, void *arg)
+  {
+    struct batch_pool pool;
+    struct batch_worker workers[BATCH_THREADS_MAX];
+    pthread_t tids[BATCH_THREADS_MAX];
+    bool started[BATCH_THREADS_MAX];
+    struct timespec start, end;
+    size_t n = 0, i = 0, failed = 0;
+
+    memset(&pool, 0, sizeof(struct batch_pool));
+    pool.ctx  = ctx;
+    pool.fn   = fn;
+    pool.arg  = arg;
+
+    if ((n = batch_read_list(ctx, list, ext, &pool.jobs)) == 0)
+      log_msg(ctx, error, MSG_B_NOJOBS, list);
+
+    if (threads == 0)
+      threads = cpu_threads(BATCH_THREADS_MAX);
+    if (threads > BATCH_THREADS_MAX)
+      threads = BATCH_THREADS_MAX;
+    if (threads > n)
+      threads = n;
+    pool.threads = threads;
+
+    for (i = 0; i < threads; i++)
+      {
+        pthread_mutex_init(&pool.queues[i].lock, NULL);
+        pool.queues[i].head = n * i / threads;
+        pool.queues[i].tail = n * (i + 1) / threads;
+        workers[i].pool = &pool;
+        workers[i].id = i;
+      }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* main thread is worker #0, so there is *
+     * progress, even if no threads started  */
+    for (i = 1; i < threads; i++)
+      started[i] = (pthread_create(&tids[i], NULL, batch_worker, &workers[i]) == 0);
+
+    batch_worker(&workers[0]);
+
+    for (i = 1; i < threads; i++)
+      if (started[i])
+        pthread_join(tids[i], NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (i = 0; i < n; i++)
+      {
+        if (!pool.jobs[i].ok)
+          failed++, log_msg(ctx, warn, MSG_B_FAILED, pool.jobs[i].input);
+        free(pool.jobs[i].input);
+        free(pool.jobs[i].output);
+      }
+
+    if (ctx->opts.msglevel > quiet)
+      fprintf(stderr, MSG_B_SUMMARY, (unsigned long) n,
+              (unsigned long) (n - failed), (unsigned long) failed,
+              (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    for (i = 0; i < threads; i++)
+      pthread_mutex_destroy(&pool.queues[i].lock);
+    free(pool.jobs);
+
+    return (failed == 0) ? true : false;
+  }
@@ -0,0 +1,38 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#define BATCH_THREADS_MAX 64
+
+/* one file to process */
+typedef struct batch_job
+  {
+    char *input;
+    char *output;
+    bool ok;
+  } batch_job;
+
+/* processes one file: ctx->opts.infile & ctx->opts.outfile are *
+ * already opened, context itself is a copy of main thread's one */
+typedef bool (*batch_job_f)(context * const, void *);
+
+/** function prototypes */
+bool batch_run(context * const, char const *, char const *, uint8_t,
+               batch_job_f, void *);
+
+#endif /* _BATCH_H */
@@ -0,0 +1,93 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+
+#define PROG_NAME "bench_subtime"
+#define ROUNDS    2000000
+
+static char const *samples[] =
+  {
+    "0:00:01.00",   "1:23:45.67",  "0:59:59.99",   /* ssa */
+    "00:00:01,000", "01:23:45,678", "00:59:59,999", /* srt */
+    "12:34:56.7",   "0:00:00.123", NULL             /* other */
+  };
+
+static double
+elapsed(struct timespec const * const from)
+  {
+    struct timespec to;
+
+    clock_gettime(CLOCK_MONOTONIC, &to);
+
+    return (to.tv_sec - from->tv_sec) + (to.tv_nsec - from->tv_nsec) / 1e9;
+  }
+
+/* runs all samples ROUNDS times, returns checksum, *
+ * so compiler can't throw away the whole loop      */
+static unsigned long
+bench(bool fast, double *time)
+  {
+    struct timespec start;
+    char const **s = NULL;
+    size_t len[sizeof(samples) / sizeof(char *)];
+    unsigned long sum = 0;
+    uint32_t i = 0;
+    subtime st;
+
+    for (s = samples, i = 0; *s != NULL; s++, i++)
+      len[i] = strlen(*s);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < ROUNDS; i++)
+      for (s = samples; *s != NULL; s++)
+        {
+          if (fast)
+            strn2subtime(*s, len[s - samples], &st);
+          else
+            scan_subtime(*s, &st);
+          sum += st.hrs + st.min + st.sec + st.msec;
+        }
+
+    *time = elapsed(&start);
+
+    return sum;
+  }
+
+int main(int argc, char *argv[])
+  {
+    double slow_time = 0.0, fast_time = 0.0;
+    unsigned long slow_sum = 0, fast_sum = 0;
+    unsigned long count = ROUNDS * (sizeof(samples) / sizeof(char *) - 1);
+
+    slow_sum = bench(false, &slow_time);
+    fast_sum = bench(true,  &fast_time);
+
+    printf("%s: %lu timestamps\n", PROG_NAME, count);
+    printf("  sscanf():  %.3f s, %.1f ns/each\n", slow_time, slow_time * 1e9 / count);
+#ifdef __SSE2__
+    printf("  fast+sse2: %.3f s, %.1f ns/each\n", fast_time, fast_time * 1e9 / count);
+#else
+    printf("  fast:      %.3f s, %.1f ns/each\n", fast_time, fast_time * 1e9 / count);
+#endif
+    printf("  speedup:   %.1fx\n", slow_time / fast_time);
+
+    if (slow_sum != fast_sum)
+      log_msg(NULL, error, "Results mismatch: %lu != %lu", slow_sum, fast_sum);
+
+    exit(EXIT_SUCCESS);
+  }
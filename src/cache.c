@@ -0,0 +1,436 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+#include "arena.h"
+#include "outbuf.h"
+#include "reader.h"
+#include "ssa.h"
+#include "store.h"
+#include "cache.h"
+
+#define MSG_C_TOOBIG   _("Too many strings for compiled file, limit is 4Gb.")
+#define MSG_C_BADFILE  _("Not a compiled ssa file, or it's damaged.")
+#define MSG_C_VERSION  _("Compiled file has version %u, but only %u is supported.")
+
+#define CACHE_PAD(x) (((x) + CACHE_ALIGN - 1) & ~((uint64_t) CACHE_ALIGN - 1))
+#define CACHE_STR(x) (((x) != NULL) ? (x) : "")
+
+/* length of packed strings of event, with all '\0's */
+static size_t
+cache_event_strlen(ssa_event const * const e)
+  {
+    return e->text + strlen(SSA_EVENT_TEXT(e)) + 1;
+  }
+
+static uint64_t
+cache_media_len(ssa_media * const m)
+  {
+    long len = 0;
+
+    if (m->data == NULL)
+      return m->len;
+
+    fflush(m->data);
+    fseek(m->data, 0, SEEK_END);
+    len = ftell(m->data);
+
+    return (len > 0) ? len : 0;
+  }
+
+/* zeroes till next aligned position */
+static void
+cache_pad(outbuf * const out, uint64_t * const pos)
+  {
+    static char const zero[CACHE_ALIGN] = { 0 };
+    uint64_t to = CACHE_PAD(*pos);
+
+    outbuf_put(out, zero, to - *pos);
+    *pos = to;
+  }
+
+static void
+cache_put(outbuf * const out, uint64_t * const pos, void const *data, size_t len)
+  {
+    outbuf_put(out, data, len);
+    *pos += len;
+  }
+
+/* Saves parsed 'f' to 'outfile' in compiled form. sizes of  *
+ * all sections are counted first, so file written at once, *
+ * without seeking. returns false on write error            */
+bool
+cache_write(context * const ctx, FILE *outfile, ssa_file * const f)
+  {
+    cache_head h;
+    cache_style cs;
+    cache_media cm;
+    ssa_event_rec r;
+    ssa_style *s = NULL;
+    ssa_event *e = NULL;
+    ssa_media *m = NULL, *lists[2];
+    struct slist *p = NULL;
+    outbuf out;
+    uint64_t pos = 0, blob = 0, data = 0;
+    uint8_t i = 0;
+    jmp_buf env, *outer = ctx->abort;
+    char const *store = ctx->opts.i_store;
+
+    if (!outfile || !f)
+      return false;
+
+    lists[0] = f->fonts, lists[1] = f->images;
+
+    memset(&h, 0, sizeof(cache_head));
+    memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+    h.version = CACHE_VERSION;
+    h.bom     = CACHE_BOM;
+    h.res_x   = f->res.width, h.res_y = f->res.height;
+    h.timer   = f->timer,     h.sync  = f->sync;
+    h.depth   = f->depth;
+    h.wrap    = f->wrap,      h.type  = f->type;
+    h.flags   = f->flags;
+
+    /* first pass: sizes of tables & strings blob */
+    for (p = f->txt_params; p != NULL; p = p->next)
+      h.params.count++, blob += strlen(p->value) + 1;
+    for (s = f->styles; s != NULL; s = s->next)
+      h.styles.count++, blob += strlen(CACHE_STR(s->name)) + 1 \
+                              + strlen(CACHE_STR(s->fontname)) + 1;
+    for (e = f->events; e != NULL; e = e->next)
+      h.events.count++, blob += cache_event_strlen(e);
+    for (i = 0; i < 2; i++)
+      for (m = lists[i]; m != NULL; m = m->next)
+        h.media.count++, blob += strlen(CACHE_STR(m->filename)) + 1;
+
+    if (blob > UINT32_MAX)
+      {
+        log_msg(ctx, warn, MSG_C_TOOBIG);
+        return false;
+      }
+
+    h.styles.offset  = CACHE_PAD(sizeof(cache_head));
+    h.events.offset  = CACHE_PAD(h.styles.offset + h.styles.count * sizeof(cache_style));
+    h.media.offset   = CACHE_PAD(h.events.offset + h.events.count * sizeof(ssa_event_rec));
+    h.strings.offset = CACHE_PAD(h.media.offset  + h.media.count  * sizeof(cache_media));
+    h.strings.count  = blob;
+    data = CACHE_PAD(h.strings.offset + blob);
+
+    memset(&out, 0, sizeof(outbuf));
+
+    /* on error buffered data is dropped, file is incomplete */
+    if (setjmp(env) != 0)
+      {
+        ctx->abort = outer;
+        ctx->opts.i_store = store;
+        out.used = 0;
+        outbuf_close(&out);
+        return false;
+      }
+    ctx->abort = &env;
+
+    if (!outbuf_open(&out, ctx, outfile))
+      log_msg(ctx, error, MSG_F_WRFAIL);
+
+    /* second pass: tables, with same order of strings in blob */
+    cache_put(&out, &pos, &h, sizeof(cache_head));
+    cache_pad(&out, &pos);
+
+    blob = 0;
+    for (p = f->txt_params; p != NULL; p = p->next)
+      blob += strlen(p->value) + 1;
+
+    for (s = f->styles; s != NULL; s = s->next)
+      {
+        memset(&cs, 0, sizeof(cache_style));
+        cs.name     = blob, blob += strlen(CACHE_STR(s->name)) + 1;
+        cs.fontname = blob, blob += strlen(CACHE_STR(s->fontname)) + 1;
+        cs.fontsize = s->fontsize, cs.angle = s->angle;
+        cs.pr_color = s->pr_color, cs.se_color = s->se_color;
+        cs.tr_color = s->tr_color, cs.bg_color = s->bg_color;
+        cs.bold     = s->bold,     cs.italic = s->italic;
+        cs.underlined = s->underlined, cs.strikeout = s->strikeout;
+        cs.scale_x  = s->scale_x,  cs.scale_y = s->scale_y;
+        cs.spacing  = s->spacing,  cs.brd_style = s->brd_style;
+        cs.outline  = s->outline,  cs.shadow = s->shadow;
+        cs.alignment = s->alignment, cs.a_level = s->a_level;
+        cs.margin_l = s->margin_l, cs.margin_r = s->margin_r;
+        cs.margin_v = s->margin_v, cs.codepage = s->codepage;
+        cache_put(&out, &pos, &cs, sizeof(cache_style));
+      }
+    cache_pad(&out, &pos);
+
+    memset(&r, 0, sizeof(ssa_event_rec));
+    for (e = f->events; e != NULL; e = e->next)
+      {
+        ssa_event_decode(f, e, SSA_F_ALL);
+        r.str      = blob, blob += cache_event_strlen(e);
+        r.start    = e->start,    r.end = e->end;
+        r.layer    = e->layer,    r.style_id = e->style_id;
+        r.margin_r = e->margin_r, r.margin_l = e->margin_l;
+        r.margin_v = e->margin_v;
+        r.name     = e->name,     r.effect = e->effect;
+        r.text     = e->text,     r.type = e->type;
+        cache_put(&out, &pos, &r, sizeof(ssa_event_rec));
+      }
+    cache_pad(&out, &pos);
+
+    for (i = 0; i < 2; i++)
+      for (m = lists[i]; m != NULL; m = m->next)
+        {
+          memset(&cm, 0, sizeof(cache_media));
+          cm.name   = blob, blob += strlen(CACHE_STR(m->filename)) + 1;
+          cm.type   = m->type;
+          cm.offset = data;
+          cm.len    = cache_media_len(m);
+          data = CACHE_PAD(data + cm.len);
+          cache_put(&out, &pos, &cm, sizeof(cache_media));
+        }
+    cache_pad(&out, &pos);
+
+    /* strings blob */
+    for (p = f->txt_params; p != NULL; p = p->next)
+      cache_put(&out, &pos, p->value, strlen(p->value) + 1);
+    for (s = f->styles; s != NULL; s = s->next)
+      {
+        cache_put(&out, &pos, CACHE_STR(s->name), strlen(CACHE_STR(s->name)) + 1);
+        cache_put(&out, &pos, CACHE_STR(s->fontname), strlen(CACHE_STR(s->fontname)) + 1);
+      }
+    for (e = f->events; e != NULL; e = e->next)
+      cache_put(&out, &pos, e->str, cache_event_strlen(e));
+    for (i = 0; i < 2; i++)
+      for (m = lists[i]; m != NULL; m = m->next)
+        cache_put(&out, &pos, CACHE_STR(m->filename), strlen(CACHE_STR(m->filename)) + 1);
+    cache_pad(&out, &pos);
+
+    /* media data. stripped one stays stripped, it's not  *
+     * embedded back from store, else sizes above are wrong */
+    ctx->opts.i_store = NULL;
+    for (i = 0; i < 2; i++)
+      for (m = lists[i]; m != NULL; m = m->next)
+        {
+          write_ssa_media_data(&out, m);
+          pos += cache_media_len(m);
+          cache_pad(&out, &pos);
+        }
+    ctx->opts.i_store = store;
+
+    outbuf_close(&out);
+
+    ctx->abort = outer;
+
+    return true;
+  }
+
+/* table of 'count' records of 'size' fits in input? */
+static bool
+cache_range_ok(reader const * const in, struct cache_range const * const r,
+               size_t size)
+  {
+    if (r->offset % CACHE_ALIGN != 0 || r->offset > in->size)
+      return false;
+
+    return r->count <= (in->size - r->offset) / size;
+  }
+
+/* true, if input, opened by 'in', is compiled file */
+bool
+cache_detect(reader const * const in)
+  {
+    return (in->size >= sizeof(cache_head) &&
+            memcmp(in->data, CACHE_MAGIC, sizeof(CACHE_MAGIC) - 1) == 0);
+  }
+
+/* Fills 'f' from compiled file, opened by 'in'. only header, *
+ * styles and media list are allocated, events & their       *
+ * strings are used right from mapped memory, see event_recs *
+ * in ssa_file. on failure 'in' is closed, otherwise it      *
+ * should be closed only after all work with 'f' is done     */
+bool
+cache_open(context * const ctx, reader * const in, ssa_file * const f)
+  {
+    cache_head const *h = NULL;
+    cache_style const *cs = NULL;
+    cache_media const *cm = NULL;
+    ssa_event_rec const *r = NULL;
+    ssa_style *s = NULL;
+    ssa_media *m = NULL, **tails[2];
+    char const *blob = NULL, *p = NULL, *nl = NULL;
+    char hex[STORE_HEX_LEN + 1];
+    uint64_t len = 0, i = 0;
+
+    h = (cache_head const *) in->data;
+
+    if (in->size < sizeof(cache_head) || memcmp(h->magic, CACHE_MAGIC, sizeof(h->magic)) != 0)
+      {
+        log_msg(ctx, warn, MSG_C_BADFILE);
+        reader_close(in);
+        return false;
+      }
+
+    if (h->version != CACHE_VERSION || h->bom != CACHE_BOM)
+      {
+        log_msg(ctx, warn, MSG_C_VERSION, h->version, CACHE_VERSION);
+        reader_close(in);
+        return false;
+      }
+
+    /* every string in blob should end inside of it */
+    if (!cache_range_ok(in, &h->styles, sizeof(cache_style)) ||
+        !cache_range_ok(in, &h->events, sizeof(ssa_event_rec)) ||
+        !cache_range_ok(in, &h->media,  sizeof(cache_media)) ||
+        !cache_range_ok(in, &h->strings, sizeof(char)) ||
+        h->strings.count > UINT32_MAX || h->type > ssa_v4p ||
+        h->params.offset + h->params.count > h->strings.count ||
+        (h->strings.count > 0 && in->data[h->strings.offset + h->strings.count - 1] != '\0'))
+      {
+        log_msg(ctx, warn, MSG_C_BADFILE);
+        reader_close(in);
+        return false;
+      }
+
+    blob = in->data + h->strings.offset;
+    len  = h->strings.count;
+
+    f->res.width = h->res_x, f->res.height = h->res_y;
+    f->timer = h->timer,     f->sync = h->sync;
+    f->depth = h->depth,     f->wrap = h->wrap;
+    f->type  = h->type,      f->flags = h->flags;
+
+    for (i = 0, p = blob + h->params.offset; i < h->params.count && p < blob + len; i++)
+      {
+        slist_add(&f->txt_params, (char *) p);
+        p += strlen(p) + 1;
+      }
+
+    if (h->styles.count > 0)
+      ACALLOC(s, &f->mem, h->styles.count, sizeof(ssa_style));
+    cs = (cache_style const *) (in->data + h->styles.offset);
+    for (i = 0; i < h->styles.count; i++, s++, cs++)
+      {
+        if (cs->name >= len || cs->fontname >= len)
+          {
+            log_msg(ctx, warn, MSG_C_BADFILE);
+            reader_close(in);
+            return false;
+          }
+        s->name     = (char *) blob + cs->name;
+        s->fontname = (char *) blob + cs->fontname;
+        s->fontsize = cs->fontsize, s->angle = cs->angle;
+        s->pr_color = cs->pr_color, s->se_color = cs->se_color;
+        s->tr_color = cs->tr_color, s->bg_color = cs->bg_color;
+        s->bold     = cs->bold,     s->italic = cs->italic;
+        s->underlined = cs->underlined, s->strikeout = cs->strikeout;
+        s->scale_x  = cs->scale_x,  s->scale_y = cs->scale_y;
+        s->spacing  = cs->spacing,  s->brd_style = cs->brd_style;
+        s->outline  = cs->outline,  s->shadow = cs->shadow;
+        s->alignment = cs->alignment, s->a_level = cs->a_level;
+        s->margin_l = cs->margin_l, s->margin_r = cs->margin_r;
+        s->margin_v = cs->margin_v, s->codepage = cs->codepage;
+        ssa_style_add(f, s); /* same order, so same ids as in events */
+      }
+
+    if (h->media.count > 0)
+      ACALLOC(m, &f->mem, h->media.count, sizeof(ssa_media));
+    cm = (cache_media const *) (in->data + h->media.offset);
+    tails[0] = &f->fonts, tails[1] = &f->images;
+    for (i = 0; i < h->media.count; i++, m++, cm++)
+      {
+        if (cm->name >= len || cm->offset > in->size || cm->len > in->size - cm->offset)
+          {
+            log_msg(ctx, warn, MSG_C_BADFILE);
+            reader_close(in);
+            return false;
+          }
+        m->type     = (cm->type == type_image) ? type_image : type_font;
+        m->filename = (char *) blob + cm->name;
+        m->raw      = in->data + cm->offset;
+        m->len      = cm->len;
+        if ((nl = memchr(m->raw, '\n', m->len)) != NULL &&
+            store_ref(m->raw, nl - m->raw, hex))
+          ASTRNDUP(m->ref, &f->mem, hex, STORE_HEX_LEN);
+        *tails[m->type == type_image] = m;
+        tails[m->type == type_image] = &m->next;
+      }
+
+    /* packed strings of every event should be inside of blob and *
+     * in order, text ends with '\0' (blob ends with it, see above) */
+    r = (ssa_event_rec const *) (in->data + h->events.offset);
+    for (i = 0; i < h->events.count; i++, r++)
+      if (r->name == 0 || r->name >= r->effect || r->effect >= r->text ||
+          (uint64_t) r->str + r->text >= len ||
+          (r->style_id >= h->styles.count && r->style_id != SSA_STYLE_UNKNOWN) ||
+          r->type < DIALOGUE || r->type > SOUND)
+        {
+          log_msg(ctx, warn, MSG_C_BADFILE);
+          reader_close(in);
+          return false;
+        }
+
+    f->event_recs = (ssa_event_rec const *) (in->data + h->events.offset);
+    f->event_recs_count = h->events.count;
+    f->event_strs = blob;
+    f->event_strs_len = len;
+
+    log_msg(ctx, debug, _("Compiled file: %lu styles, %lu events."),
+            (unsigned long) h->styles.count, (unsigned long) h->events.count);
+
+    return true;
+  }
+
+/* the same as cache_open(), but opens 'infile' with reader 'in' *
+ * itself (so it's mapped, if possible)                          */
+bool
+cache_load(context * const ctx, FILE *infile, reader * const in,
+           ssa_file * const f)
+  {
+    if (!reader_open(in, ctx, infile))
+      return false;
+
+    return cache_open(ctx, in, f);
+  }
+
+/* Makes usual events list of 'f' from records of compiled   *
+ * file, for tools, that work with ssa_event. all events are *
+ * allocated at once, their strings stays in mapped blob.    *
+ * records are dropped then: list may be filtered later      */
+void
+cache_events(ssa_file * const f)
+  {
+    ssa_event_rec const *r = f->event_recs;
+    ssa_event *e = NULL, **tail = &f->events;
+    size_t i = 0;
+
+    if (f->event_recs_count == 0)
+      return;
+
+    ACALLOC(e, &f->mem, f->event_recs_count, sizeof(ssa_event));
+    for (i = 0; i < f->event_recs_count; i++, r++, e++)
+      {
+        e->str   = (char *) f->event_strs + r->str;
+        e->start = r->start,       e->end = r->end;
+        e->layer = r->layer,       e->style_id = r->style_id;
+        e->margin_r = r->margin_r, e->margin_l = r->margin_l;
+        e->margin_v = r->margin_v;
+        e->name  = r->name,        e->effect = r->effect;
+        e->text  = r->text,        e->type = r->type;
+        e->fields = SSA_F_ALL;
+        *tail = e, tail = &e->next;
+      }
+
+    f->event_recs = NULL;
+    f->event_recs_count = 0;
+  }
@@ -0,0 +1,110 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#define CACHE_MAGIC   "SSACACHE"
+#define CACHE_VERSION 2
+#define CACHE_BOM     0x01020304 /* byte order & size of ints check */
+#define CACHE_ALIGN   16         /* of every section in file */
+
+/* Compiled ssa file: parsed ssa_file, saved in machine's native *
+ * byte order. layout is: head, styles, events & media tables,   *
+ * strings blob and uue data of media, each section aligned to   *
+ * CACHE_ALIGN. events are fixed-size ssa_event_rec records, so  *
+ * after loading file (mmap() by reader) they are used in place. */
+
+/* part of cache file: 'offset' from start of file and 'count' *
+ * of records in it (or length in bytes for strings blob)      */
+struct cache_range
+  {
+    uint64_t offset;
+    uint64_t count;
+  };
+
+/* one style, strings are offsets in strings blob */
+typedef struct cache_style
+  {
+    uint32_t name;
+    uint32_t fontname;
+    float fontsize;
+    float angle;
+    uint32_t pr_color;
+    uint32_t se_color;
+    uint32_t tr_color;
+    uint32_t bg_color;
+    int8_t bold;
+    int8_t italic;
+    int8_t underlined;
+    int8_t strikeout;
+    uint8_t scale_x;
+    uint8_t scale_y;
+    uint8_t spacing;
+    uint8_t brd_style;
+    uint8_t outline;
+    uint8_t shadow;
+    uint8_t alignment;
+    uint8_t a_level;
+    uint16_t margin_l;
+    uint16_t margin_r;
+    uint16_t margin_v;
+    uint8_t codepage;
+    uint8_t pad;
+  } cache_style;
+
+/* one embedded font or image */
+typedef struct cache_media
+  {
+    uint32_t name;     /* offset in strings blob  */
+    uint32_t type;     /* type_font or type_image */
+    uint64_t offset;   /* uue lines in file       */
+    uint64_t len;
+  } cache_media;
+
+typedef struct cache_head
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t bom;
+
+    /* numeric fields of ssa_file */
+    uint32_t res_x;
+    uint32_t res_y;
+    float timer;
+    float sync;
+    uint16_t depth;
+    uint8_t wrap;
+    uint8_t type;
+    uint16_t flags;
+    uint16_t pad;
+
+    struct cache_range params;  /* header lines, "\0"-separated in blob */
+    struct cache_range styles;
+    struct cache_range events;
+    struct cache_range media;
+    struct cache_range strings;
+  } cache_head;
+
+/** function prototypes */
+bool cache_write(context * const, FILE *, ssa_file * const);
+bool cache_detect(reader const * const);
+bool cache_open(context * const, reader * const, ssa_file * const);
+bool cache_load(context * const, FILE *, reader * const, ssa_file * const);
+void cache_events(ssa_file * const);
+
+#endif /* _CACHE_H */
@@ -18,9 +18,6 @@
 
 #define MSG_W_WRONGTIMEF _("Incorrect time '%s'. Should be like '[+/-][[h:]m:]s[.ms]'")
 
-/* variables */
-extern unsigned long int line_num;
-
 /* sorted in order of test */
 struct unicode_test BOMs[6] =
 {
@@ -32,21 +29,32 @@ struct unicode_test BOMs[6] =
   { SINGLE,  { 0x00, 0x00, 0x00, 0x00 }, 0 } /* this entry acts as list-terminator */
 };
 
-struct options opts =
+static struct options const opts_default =
 {
   warn,       /* msglevel    */
   false,      /* sort_events */
   false,      /* test        */
   false,      /* strict parse */
+  false,      /* skip media   */
   false,      /* font tune   */
   (FILE *) 0, /* infile      */
   (FILE *) 0, /* outfile     */
-  keep,       /* o_wrap      */
-  SINGLE      /* i_chs_type  */
+  NULL,       /* o_name      */
+  NULL,       /* media store */
+  keep        /* o_wrap      */
 };
 
 /** functions */
 
+/* context with default options, ready to use */
+void
+context_init(context * const ctx)
+  {
+    memset(ctx, 0, sizeof(context));
+    ctx->opts = opts_default;
+    ctx->charset = SINGLE;
+  }
+
 uint16_t
 char_count(char * const s, char c)
 {
@@ -77,10 +85,157 @@ is_empty_line(char *line)
     return empty;
 }
 
+#define IS_DIGIT(c) ((unsigned char) ((c) - '0') <= 9)
+
+/* fixed-format timestamps: "H:MM:SS.cc", "HH:MM:SS,mmm" *
+ * and all between: 1-2 digits of hours, '.' or ',' as  *
+ * fraction separator and 1-3 digits of fraction        */
+static bool
+subtime_fixed(char const *p, size_t len, subtime * const st)
+  {
+    uint8_t h = 0; /* hours digits */
+    uint8_t n = 0; /* fraction digits */
+    unsigned int frac = 0;
+
+    if (len < 9 || len > 13)
+      return false;
+
+    h = (p[1] == ':') ? 1 : 2;
+    n = len - h - 7;
+
+    if (n < 1 || n > 3 || p[h] != ':' || p[h + 3] != ':' ||
+        (p[h + 6] != '.' && p[h + 6] != ','))
+      return false;
+
+    if (!IS_DIGIT(p[0]) || (h == 2 && !IS_DIGIT(p[1])) ||
+        !IS_DIGIT(p[h + 1]) || !IS_DIGIT(p[h + 2]) ||
+        !IS_DIGIT(p[h + 4]) || !IS_DIGIT(p[h + 5]))
+      return false;
+
+    st->hrs = (h == 1) ? p[0] - '0' : (p[0] - '0') * 10 + p[1] - '0';
+    st->min = (p[h + 1] - '0') * 10 + p[h + 2] - '0';
+    st->sec = (p[h + 4] - '0') * 10 + p[h + 5] - '0';
+
+    for (p += h + 7; n > 0; n--, p++)
+      {
+        if (!IS_DIGIT(*p))
+          return false;
+        frac = frac * 10 + *p - '0';
+      }
+
+    switch (len - h - 7)
+      {
+        case 1 : frac *= 100; break;
+        case 2 : frac *= 10;  break;
+        default:              break;
+      }
+    st->msec = frac;
+
+    return true;
+  }
+
+#ifdef __SSE2__
+/* layouts for subtime_sse2(): separators at their places, *
+ * zeroes at digits places and in padding after timestamp  */
+static const char subtime_tpl_ssa[16] =
+  { 0, ':', 0, 0, ':', 0, 0, '.', 0, 0, 0, 0, 0, 0, 0, 0 };
+static const char subtime_tpl_srt[16] =
+  { 0, 0, ':', 0, 0, ':', 0, 0, ',', 0, 0, 0, 0, 0, 0, 0 };
+/* digits weights for _mm_madd_epi16(), see below */
+static const int16_t subtime_w_ssa[16] =
+  { 1, 0, 10, 1, 0, 10, 1, 0,   10, 1, 0, 0, 0, 0, 0, 0 };
+static const int16_t subtime_w_srt[16] =
+  { 10, 1, 0, 10, 1, 0, 10, 1,   0, 100, 10, 1, 0, 0, 0, 0 };
+
+/* validates & converts exact "H:MM:SS.cc" (10 chars) *
+ * or "HH:MM:SS,mmm" (12 chars) at once. input should *
+ * be padded with zeroes up to 16 bytes               */
+static bool
+subtime_sse2(char const *pad, size_t len, subtime * const st)
+  {
+    __m128i v, d, tpl, is_digit, good, lo, hi;
+    int32_t a[4], b[4];
+    bool ssa = (len == 10);
+    int16_t const *w = ssa ? subtime_w_ssa : subtime_w_srt;
+
+    v   = _mm_loadu_si128((__m128i const *) pad);
+    tpl = _mm_loadu_si128((__m128i const *) (ssa ? subtime_tpl_ssa : subtime_tpl_srt));
+
+    /* digit places: 0..9 after subtraction, separators & padding: as in template */
+    d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    is_digit = _mm_cmpeq_epi8(_mm_max_epu8(d, _mm_set1_epi8(9)), _mm_set1_epi8(9));
+    good = _mm_cmpeq_epi8(v, tpl);
+    tpl  = _mm_cmpeq_epi8(tpl, _mm_setzero_si128());
+    /* padding is zero in template and in data, but not a digit */
+    tpl  = _mm_and_si128(tpl, _mm_cmpgt_epi8(_mm_set1_epi8(len), \
+              _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)));
+    good = _mm_or_si128(_mm_and_si128(tpl, is_digit), _mm_andnot_si128(tpl, good));
+
+    if (_mm_movemask_epi8(good) != 0xFFFF)
+      return false;
+
+    /* 16 x 8-bit digits -> 2 x 8 x 16-bit, then pairs of     *
+     * neighbours multiplied by weights & summed into 32-bit */
+    d  = _mm_and_si128(d, tpl);
+    lo = _mm_unpacklo_epi8(d, _mm_setzero_si128());
+    hi = _mm_unpackhi_epi8(d, _mm_setzero_si128());
+    lo = _mm_madd_epi16(lo, _mm_loadu_si128((__m128i const *) w));
+    hi = _mm_madd_epi16(hi, _mm_loadu_si128((__m128i const *) (w + 8)));
+    _mm_storeu_si128((__m128i *) a, lo);
+    _mm_storeu_si128((__m128i *) b, hi);
+
+    if (ssa) /* [H] [MM] [S0] [S1] | [cc] */
+      st->hrs = a[0], st->min = a[1], st->sec = a[2] + a[3], st->msec = b[0] * 10;
+    else     /* [HH] [M0] [M1] [SS] | [m00] [mm] */
+      st->hrs = a[0], st->min = a[1] + a[2], st->sec = a[3], st->msec = b[0] + b[1];
+
+    return true;
+  }
+#endif /* __SSE2__ */
+
+/* fast paths for common layouts, slow path for everything else */
+bool
+strn2subtime(char const *line, size_t len, subtime *st)
+  {
+    char buf[MAXLINE];
+#ifdef __SSE2__
+    char pad[16] = { 0 };
+#endif
+
+    memset(st, 0, sizeof(subtime));
+
+#ifdef __SSE2__
+    if (len == 10 || len == 12)
+      {
+        memcpy(pad, line, len);
+        if (subtime_sse2(pad, len, st))
+          return check_subtime(st);
+      }
+#endif
+
+    if (subtime_fixed(line, len, st))
+      return check_subtime(st);
+
+    if (len >= MAXLINE)
+      len = MAXLINE - 1;
+    memcpy(buf, line, len);
+    buf[len] = '\0';
+
+    return scan_subtime(buf, st);
+  }
+
 bool
 str2subtime(char *line, subtime *st)
   {
-    char *p = (char *) 0;
+    return strn2subtime(line, strlen(line), st);
+  }
+
+/* reference parser, slow, but handles all odd cases, *
+ * like spaces or separators other than '.' and ','  */
+bool
+scan_subtime(char const *line, subtime *st)
+  {
+    char const *p = (char *) 0;
 
     memset(st, 0, sizeof(subtime));
 
@@ -117,7 +272,7 @@ str2subtime(char *line, subtime *st)
    * returns double instead of subtime
  */
 bool
-parse_time(char *token, double *d, bool exit)
+parse_time(context * const ctx, char *token, double *d, bool exit)
   {
     char *p = token;
     subtime t = { 0, 0, 0, 0 };
@@ -160,7 +315,7 @@ parse_time(char *token, double *d, bool exit)
 
     if (scan != (count + 1))
       {
-        log_msg(level, MSG_W_WRONGTIMEF, token);
+        log_msg(ctx, level, MSG_W_WRONGTIMEF, token);
         return false;
       }
 
@@ -170,7 +325,7 @@ parse_time(char *token, double *d, bool exit)
         while (isdigit(*(p + len + 1))) len++;
         if (sscanf(p, ".%3u", &t.msec) != 1)
           {
-            log_msg(level, MSG_W_WRONGTIMEF, token);
+            log_msg(ctx, level, MSG_W_WRONGTIMEF, token);
             return false;
           }
           switch (len)
@@ -183,7 +338,7 @@ parse_time(char *token, double *d, bool exit)
 
     if (check_subtime(&t) == false)
     {
-      log_msg(level, MSG_W_WRONGTIMEF, token);
+      log_msg(ctx, level, MSG_W_WRONGTIMEF, token);
       return false;
     }
 
@@ -208,7 +363,6 @@ double2subtime(double d, subtime * const st)
   {
     unsigned int i = (int) d;
 
-    fesetround(1); /* to nearest int */
     st->msec = (int) round((d - i) * 1000);
     st->hrs = (int) i / SEC_IN_HOUR;
     i = i % SEC_IN_HOUR;
@@ -217,6 +371,32 @@ double2subtime(double d, subtime * const st)
     st->sec = (int) i /* SEC_IN_SEC :-) */;
   }
 
+/* centiseconds, rounded to nearest */
+int32_t
+subtime2cs(subtime const * const st)
+  {
+    int32_t cs = 0;
+
+    cs += st->hrs * SEC_IN_HOUR * 100;
+    cs += st->min * SEC_IN_MIN * 100;
+    cs += st->sec * 100;
+    cs += (st->msec + 5) / 10;
+
+    return cs;
+  }
+
+/* seconds -> centiseconds, rounded to nearest */
+int32_t
+double2cs(double d)
+  {
+    d = round(d * 100.0);
+
+    if (d > INT32_MAX) return INT32_MAX;
+    if (d < INT32_MIN) return INT32_MIN;
+
+    return (int32_t) d;
+  }
+
 bool
 check_subtime(subtime const * const time)
   {
@@ -258,8 +438,8 @@ bool trim_spaces(char *line, int dirs)
 
 /* remember, that 'count = 0' means ALL entries found in string will be replaced */
 bool
-text_replace(char *haystack, char *needle, char *replace,
-             unsigned int hs_size, unsigned int count)
+text_replace(context * const ctx, char *haystack, char *needle,
+             char *replace, unsigned int hs_size, unsigned int count)
   {
     uint16_t len_h = 0;
     uint16_t len_n = 0;
@@ -281,7 +461,7 @@ text_replace(char *haystack, char *needle, char *replace,
       count = -1; /* street magic. small negative value... wait, oh shi--! */
     if (len_n == 0)
       {
-        log_msg(warn, _("Search token is empty."));
+        log_msg(ctx, warn, _("Search token is empty."));
         return false;
       }
 
@@ -310,7 +490,7 @@ text_replace(char *haystack, char *needle, char *replace,
           {
             if (i > chars_remain)
               {
-                log_msg(warn, MSG_W_TXTNOTFITS, chars_remain, i, _("Replace incompleted."));
+                log_msg(ctx, warn, MSG_W_TXTNOTFITS, chars_remain, i, _("Replace incompleted."));
                 return false;
               }
             f = haystack + len_h;          /* [text needl text2\0...] */
@@ -374,8 +554,8 @@ string_skip_chars(char *string, char *chars)
  * with 'sep' between old and new content, but   *
  * no more than 'len' chars                      */
 bool
-append_string(char *to, char *from, char *sep,
-            unsigned int to_size, unsigned int len)
+append_string(context * const ctx, char *to, char *from, char *sep,
+              unsigned int to_size, unsigned int len)
   {
     uint16_t len_f, len_t, len_s;
 
@@ -388,7 +568,7 @@ append_string(char *to, char *from, char *sep,
 
     if (to_size < len_t)
       {
-        log_msg(warn, _("Incorrect parameters in append_string() call"));
+        log_msg(ctx, warn, _("Incorrect parameters in append_string() call"));
         return false;
       }
 
@@ -399,7 +579,7 @@ append_string(char *to, char *from, char *sep,
       }
     else
       {
-        log_msg(warn, MSG_W_TXTNOTFITS, to_size - len_t,
+        log_msg(ctx, warn, MSG_W_TXTNOTFITS, to_size - len_t,
                  len_f + len_s, _("Append failed."));
         return false;
       }
@@ -423,6 +603,123 @@ append_char(char *to, char c, unsigned int len)
     return true;
   }
 
+/** span functions */
+void
+span_trim(struct span * const s, int dirs)
+  {
+    /** dirs: 1 - start, 2 - end, 3 - both */
+    if (dirs & LINE_START)
+      while (s->len > 0 && isblank(*s->ptr))
+        s->ptr++, s->len--;
+
+    if (dirs & LINE_END)
+      while (s->len > 0 && isblank(s->ptr[s->len - 1]))
+        s->len--;
+  }
+
+bool
+span_starts(struct span const * const s, char const *prefix)
+  {
+    size_t len = strlen(prefix);
+
+    return (s->len >= len && memcmp(s->ptr, prefix, len) == 0) ? true : false;
+  }
+
+/* splits span 's' by 'delim' to no more than 'max' fields in one  *
+ * pass. last field takes all rest of span, delimiters included.   *
+ * returns number of fields found, at least one for any 'max' > 0  */
+size_t
+span_split(struct span const * const s, char delim,
+           struct span * const fields, size_t max)
+  {
+    char const *p = s->ptr, *from = s->ptr, *end = s->ptr + s->len;
+    size_t n = 0;
+#ifdef __SSE2__
+    __m128i const needle = _mm_set1_epi8(delim);
+    unsigned int mask = 0, bit = 0;
+#endif
+
+    if (max == 0)
+      return 0;
+
+#ifdef __SSE2__
+    /* 16 bytes at once, every set bit of 'mask' is a delimiter */
+    for (; n < max - 1 && end - p >= 16; p += 16)
+      {
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(needle,
+                 _mm_loadu_si128((__m128i const *) p)));
+        while (mask != 0 && n < max - 1)
+          {
+            bit = __builtin_ctz(mask);
+            mask &= mask - 1;
+            fields[n].ptr = from, fields[n].len = (p + bit) - from;
+            from = p + bit + 1;
+            n++;
+          }
+      }
+#endif
+
+    for (; n < max - 1 && p < end; p++)
+      if (*p == delim)
+        {
+          fields[n].ptr = from, fields[n].len = p - from;
+          from = p + 1;
+          n++;
+        }
+
+    fields[n].ptr = from, fields[n].len = end - from;
+
+    return n + 1;
+  }
+
+/* the same as atoi(), but never reads more than 'len' chars */
+int
+strntoi(char const *s, size_t len)
+  {
+    char const *end = s + len;
+    bool negative = false;
+    int i = 0;
+
+    while (s < end && isspace(*s)) s++;
+
+    if (s < end && (*s == '+' || *s == '-'))
+      negative = (*s++ == '-') ? true : false ;
+
+    for (; s < end && isdigit(*s); s++)
+      i = i * 10 + (*s - '0');
+
+    return (negative) ? -i : i;
+  }
+
+/* the same as atof(). float values is rare and short, *
+ * so simply copy it to buffer and let libc do rest    */
+double
+strntod(char const *s, size_t len)
+  {
+    char buf[64];
+
+    if (len >= sizeof(buf))
+      len = sizeof(buf) - 1;
+
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+
+    return atof(buf);
+  }
+
+/* number of newlines between 'from' and 'to', *
+ * used for line numbers in chunked parsing    */
+uint32_t
+count_lines(char const *from, char const *to)
+  {
+    uint32_t n = 0;
+
+    while (from < to && (from = memchr(from, '\n', to - from)) != NULL)
+      from++, n++;
+
+    return n;
+  }
+
 /** strings list functions */
 bool
 slist_add(struct slist **list, char *item)
@@ -440,7 +737,7 @@ slist_add(struct slist **list, char *item)
     }
 
     if ((p->value = strdup(item)) == NULL)
-      log_msg(error, MSG_M_OOM);
+      log_msg(NULL, error, MSG_M_OOM);
 
     return true;
   }
@@ -474,7 +771,7 @@ stack_push(STACK_ELEM * const st, STACK_ELEM **top, STACK_ELEM val)
     if ((*top - st) < STACK_MAX)
       (*top)++, **top = val;
     else
-      log_msg(debug, _("Stack is full! Increase STACK_MAX and recompile."));
+      log_msg(NULL, debug, _("Stack is full! Increase STACK_MAX and recompile."));
   }
 
 void
@@ -483,7 +780,7 @@ stack_pop(STACK_ELEM * const st, STACK_ELEM **top)
     if (*top > st)
       **top = '\0', (*top)--;
     else
-      log_msg(debug, "Try to pop on empty stack.");
+      log_msg(NULL, debug, "Try to pop on empty stack.");
   }
 
 /** various functions */
@@ -527,9 +824,10 @@ _strtok(char *s, char *delim)
   }
 
 enum chs_type
-unicode_check(char *s, struct unicode_test *aux_tests)
+unicode_check(context * const ctx, char *s, struct unicode_test *aux_tests)
   {
     struct unicode_test *b;
+    enum chs_type charset_type = SINGLE;
 
     for (b = BOMs; b->charset_type != SINGLE; b++)
       if (memcmp(s, b->sample, sizeof(char) * b->sample_len) == 0)
@@ -554,7 +852,7 @@ unicode_check(char *s, struct unicode_test *aux_tests)
         case UTF32BE :
         case UTF16LE :
         case UTF16BE :
-          log_msg(error, MSG_W_WRONGUNI, charset_type_tos(charset_type));
+          log_msg(ctx, error, MSG_W_WRONGUNI, charset_type_tos(charset_type));
           break;
         case UTF8    :
           memset(s, ' ', unicode_bom_len(UTF8));
@@ -565,7 +863,26 @@ unicode_check(char *s, struct unicode_test *aux_tests)
           break;
       }
 
-    return SINGLE;
+    return charset_type;
+  }
+
+/* the same as above, but for first line, given as span. *
+ * BOM, if any, will be excluded from span               */
+enum chs_type
+unicode_check_span(context * const ctx, struct span * const line,
+                   struct unicode_test *aux_tests)
+  {
+    char buf[5] = "";
+    uint8_t skip = 0;
+    enum chs_type charset_type = SINGLE;
+
+    memcpy(buf, line->ptr, (line->len < 4) ? line->len : 4);
+    charset_type = unicode_check(ctx, buf, aux_tests);
+
+    if (charset_type == UTF8 && line->len >= (skip = unicode_bom_len(UTF8)))
+      line->ptr += skip, line->len -= skip;
+
+    return charset_type;
   }
 
 uint8_t
@@ -606,6 +923,27 @@ Common options:\n\
   -v                Increase verbosity. Can be given more than once.\n"));
   }
 
+void
+usage_ssa_input_opts(void)
+  {
+    fprintf(stderr, _("\
+Input options:\n\
+  -M                Skip embedded fonts & graphics, output will have none.\n\
+  -R <dir>          Media store: stripped fonts & graphics (see\n\
+                    'ssa-resources strip') are embedded back from here.\n"));
+  }
+
+void
+usage_batch_opts(void)
+  {
+    fprintf(stderr, _("\
+Batch mode:\n\
+  -b <file>         Process all files, listed in this file, one per line:\n\
+                    '<input>' or '<input><TAB><output>'. '-' means stdin.\n\
+                    Options '-i' and '-o' not allowed in this mode.\n\
+  -j <int>          Number of parallel jobs. Default: number of cpus.\n"));
+  }
+
 void
 usage_convert(char *prog)
   {
@@ -621,7 +959,7 @@ usage_convert_input(void)
     fprintf(stderr, _("\
 Input options:\n\
   -S                Sort events by timing during parsing input file.\n\
-  -T                Only parse input file. Use for testing.\n"));
+  -T                Only check input file, exit with error on any problem.\n"));
   }
 
 void
@@ -656,14 +994,20 @@ msglevel_change(verbosity *level, char sign)
     if (sign == '-' && *level > quiet) (*level)--;
   }
 
+/* Prints message, if it's allowed by verbosity of 'ctx'. Errors  *
+ * are stored in 'ctx' and jump to ctx->abort, so caller of parse *
+ * or write function gets 'false'. Without context or abort point *
+ * error still terminates program.                                */
 void
-log_msg(uint8_t level, const char *format, ...)
+log_msg(context * const ctx, uint8_t level, const char *format, ...)
   {
     char p;
-    char *f = "%c: %s%s\n";
+    char *f = "%c: %s%s%s%s\n";
     char *m = _(" Exiting...");
     bool quit = false;
     char buf[MAXLINE];
+    char const *name = (ctx) ? ctx->name : NULL;
+    verbosity msglevel = (ctx) ? ctx->opts.msglevel : warn;
     va_list ap;
 
     if (level < warn && level > quiet) quit = true;
@@ -681,46 +1025,77 @@ log_msg(uint8_t level, const char *format, ...)
           break;
       }
 
-    if (opts.msglevel >= level)
+    if (msglevel < level && !quit)
+      return;
+
+    va_start(ap, format);
+    vsnprintf(buf, MAXLINE, format, ap);
+    va_end(ap);
+
+    if (quit && ctx != NULL && ctx->abort != NULL)
+      m = ""; /* it's up to caller, what to do next */
+
+    if (msglevel >= level)
+      fprintf(stderr, f, p, (name) ? name : "", (name) ? ": " : "",
+              buf, (quit) ? m : "");
+
+    if (!quit)
+      return;
+
+    if (ctx != NULL)
       {
-        va_start(ap, format);
-        vsnprintf(buf, MAXLINE, format, ap);
-        va_end(ap);
-        fprintf(stderr, f, p, buf, (quit) ? m : "");
+        ctx->failed = true;
+        strncpy(ctx->errmsg, buf, CTX_ERRMSG_MAX - 1);
+        ctx->errmsg[CTX_ERRMSG_MAX - 1] = '\0';
+        if (ctx->abort != NULL)
+          longjmp(*ctx->abort, 1);
       }
 
-    if (quit) exit(EXIT_FAILURE);
+    exit(EXIT_FAILURE);
   }
 
 bool
-common_checks(struct options * const opts)
+common_checks(context * const ctx)
   {
-    if (!opts) return false;
+    if (!ctx) return false;
 
-    if (opts->infile  == NULL)
-      log_msg(error, MSG_F_IFMISSING);
+    if (ctx->opts.infile  == NULL)
+      log_msg(ctx, error, MSG_F_IFMISSING);
 
-    if (opts->outfile == NULL)
+    if (ctx->opts.outfile == NULL)
       {
-        log_msg(warn, MSG_F_OFMISSING);
-        opts->outfile = stdout;
+        log_msg(ctx, warn, MSG_F_OFMISSING);
+        ctx->opts.outfile = stdout;
       }
 
-    if (opts->i_test == true)
+    if (ctx->opts.i_test == true)
       {
-        if (opts->msglevel < warn)
-          opts->msglevel = warn;
-        log_msg(info, MSG_W_TESTONLY);
+        if (ctx->opts.msglevel < warn)
+          ctx->opts.msglevel = warn;
+        log_msg(ctx, info, MSG_W_TESTONLY);
       }
 
-    if (opts->i_sort == true)
-      log_msg(info, MSG_I_EVSORTED);
+    if (ctx->opts.i_sort == true)
+      log_msg(ctx, info, MSG_I_EVSORTED);
 
     return true;
   }
 
+/* number of online cpus, but at least 1 (also if it's *
+ * unknown) and at most 'max'. for 'max' worker threads */
+uint8_t
+cpu_threads(uint8_t max)
+  {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cpus < 1 || max < 1)
+      return 1;
+
+    return (cpus > max) ? max : cpus;
+  }
+
 bool
-set_wrap(enum wrapping_mode *o_wrap, char *mode)
+set_wrap(context * const ctx, enum wrapping_mode *o_wrap, char *mode)
   {
     if (!mode)
       return false;
@@ -731,7 +1106,7 @@ set_wrap(enum wrapping_mode *o_wrap, char *mode)
       *o_wrap = keep; /* default */
 
     if (*o_wrap != keep)
-      log_msg(info, _("Wrapping mode set to '%s'"), mode);
+      log_msg(ctx, info, _("Wrapping mode set to '%s'"), mode);
 
     return true;
   }
@@ -758,7 +1133,7 @@ font_size_normalize(struct res const * const res, float * const fsize)
 
 /** gets custom string, returns A+RGB color in integer */
 uint32_t
-parse_color(char const * const s)
+parse_color(context * const ctx, char const * const s)
   {
     uint32_t color = WHITE;
 
@@ -775,10 +1150,10 @@ parse_color(char const * const s)
         else if (strcmp(s, "blue")   == 0) color = BLUE;
         else if (strcmp(s, "yellow") == 0) color = YELLOW;
         else if (strcmp(s, "white")  == 0) color = WHITE;
-        else log_msg(warn, MSG_W_UNKNCOLOR, s);
+        else log_msg(ctx, warn, MSG_W_UNKNCOLOR, s);
       }
     else
-      log_msg(warn, MSG_W_HOWTOCOLOR, s);
+      log_msg(ctx, warn, MSG_W_HOWTOCOLOR, s);
 
     return color;
   }
@@ -786,7 +1161,7 @@ parse_color(char const * const s)
 /** tags functions */
 
 bool
-add_tag_param(struct tag * const tag, char type, char *value)
+add_tag_param(context * const ctx, struct tag * const tag, char type, char *value)
   {
     uint16_t len = 0;
     uint16_t i = 0;
@@ -802,7 +1177,7 @@ add_tag_param(struct tag * const tag, char type, char *value)
 
     if (i == TAG_DATA_MAX)
       {
-        log_msg(warn, _("Too many parameters in tag or too long values"));
+        log_msg(ctx, warn, _("Too many parameters in tag or too long values"));
         return false;
       }
     /* 'p' now should points to '0x04' (EOT) */
@@ -814,7 +1189,7 @@ add_tag_param(struct tag * const tag, char type, char *value)
       }
 
     /* if check above fails: */
-    log_msg(warn, MSG_W_TAGOVERBUF, _("parameter"));
+    log_msg(ctx, warn, MSG_W_TAGOVERBUF, _("parameter"));
 
     return false;
   }
@@ -874,7 +1249,7 @@ dump_tag(struct tag const * const tag)
  * known limitations: <name param=value.part1 value.part2>       *
  * becomes 'name => { "param" => "value.part1", "value.part2" }' */
 int16_t
-parse_html_tag(char const * const s, struct tag * const tag)
+parse_html_tag(context * const ctx, char const * const s, struct tag * const tag)
   {
     char buf[MAXLINE + 1];
     char const *w = s; /* worker poiner */
@@ -926,7 +1301,7 @@ parse_html_tag(char const * const s, struct tag * const tag)
             case '\0':
               /* if we meet this - it means, that tag was unclosed, *
                * so, consiger that all chars before - text          */
-              log_msg(warn, MSG_W_TAGUNCL, tag->data, s);
+              log_msg(ctx, warn, MSG_W_TAGUNCL, tag->data, s);
               return -(w - s);
               break;
             case '>' :
@@ -973,11 +1348,11 @@ parse_html_tag(char const * const s, struct tag * const tag)
                   break;
                 case param :
                   string_lowercase(buf, 0);
-                  add_tag_param(tag, TAG_PARAM, buf);
+                  add_tag_param(ctx, tag, TAG_PARAM, buf);
                   break;
                 case value :
                 default :
-                  add_tag_param(tag, TAG_VALUE, buf);
+                  add_tag_param(ctx, tag, TAG_VALUE, buf);
                   break;
               }
             b = buf;
@@ -20,6 +20,8 @@
 #include <libintl.h>
 #include <locale.h>
 #include <math.h>
+#include <pthread.h>
+#include <setjmp.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -27,7 +29,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "msg.h"
 
@@ -40,18 +53,19 @@
 
 /* wrappers */
 #define _(x) gettext((x))
+/* out of memory is fatal everywhere, so no context here */
 #define CALLOC(ptr, nmemb, size) \
   if (((ptr) = calloc((nmemb), (size))) == NULL) \
-    log_msg(error, MSG_M_OOM, __FILE__, __LINE__)
+    log_msg(NULL, error, MSG_M_OOM, __FILE__, __LINE__)
     /* yes, i know about assert() */
 
-#define TMPFILE(ptr) \
+#define TMPFILE(ctx, ptr) \
   if (((ptr) = tmpfile()) == NULL) \
-    log_msg(error, MSG_F_CTMPFAIL, strerror(errno))
+    log_msg((ctx), error, MSG_F_CTMPFAIL, strerror(errno))
 
 #define STRNDUP(ptr, str, len) \
   if (((ptr) = strndup((str), (len))) == NULL) \
-    log_msg(error, MSG_M_OOM, __FILE__, __LINE__)
+    log_msg(NULL, error, MSG_M_OOM, __FILE__, __LINE__)
 
 #define SEC_MAX     85399 /* 23h:59m:59s */
 #define SEC_IN_HOUR  3600
@@ -105,7 +119,6 @@ struct time_pt
 {
   double pos;
   double shift;
-  struct time_pt *next;
 };
 
 struct res
@@ -120,6 +133,13 @@ struct slist
   struct slist *next;
 };
 
+/* part of some bigger string, not null-terminated */
+struct span
+{
+  char const *ptr;
+  size_t len;
+};
+
 /* ascii char 0x01 (SOH) and 0x02 (STX) *
  * used as indicators of data type      *
  * data stored looks-like this:         *
@@ -160,7 +180,7 @@ enum chs_type
   UTF16LE = 3,
   UTF32BE = 4,
   UTF32LE = 5
-} charset_type;
+};
 
 enum wrapping_mode
 {
@@ -171,7 +191,7 @@ enum wrapping_mode
   upperwide,
 */
   merge
-} wrapping_mode;
+};
 
 struct unicode_test
 {
@@ -188,47 +208,83 @@ struct options
   bool i_sort;
   bool i_test;
   bool i_strict;
+  bool i_nomedia;    /* skip embedded fonts & graphics */
   bool o_fsize_tune;
 
   FILE *infile;
   FILE *outfile;
+  char const *o_name; /* name of outfile, NULL if unknown */
+  char const *i_store; /* media store for stripped files, or NULL */
 
   enum wrapping_mode o_wrap;
-  enum chs_type i_chs_type;
 };
 
+#define CTX_ERRMSG_MAX 256
+
+/* state of processing one file. parse & write functions take it *
+ * explicitly, so any number of files may be processed at once   */
+typedef struct context
+{
+  struct options opts;
+  uint32_t line_num;     /* current line of input file          */
+  enum chs_type charset; /* detected charset of input file      */
+  char const *name;      /* prefix for messages, may be NULL    */
+
+  bool failed;           /* error happened, text is in 'errmsg' */
+  char errmsg[CTX_ERRMSG_MAX];
+  jmp_buf *abort;        /* errors jump here, if NULL - exit()  */
+} context;
+
 /** functions prototypes */
 /* subtime functions */
 bool str2subtime(char *, subtime *); /* + bool subtime2str(char *, subtime *); ? */
-bool parse_time(char *, double *, bool);
+bool strn2subtime(char const *, size_t, subtime *);
+bool scan_subtime(char const *, subtime *);
+bool parse_time(context * const, char *, double *, bool);
 void subtime2double(subtime const * const, double *);
 void double2subtime(double, subtime * const);
+int32_t subtime2cs(subtime const * const);
+int32_t double2cs(double);
 bool check_subtime(subtime const * const);
 
+/* context functions */
+void context_init(context * const);
+
 /* string functions */
 uint16_t char_count(char * const, char);
 bool is_empty_line(char *);
 void trim_newline(char *);
 bool trim_spaces(char *, int);
-bool text_replace(char *, char *, char *, unsigned int, unsigned int);
+bool text_replace(context * const, char *, char *, char *, unsigned int, unsigned int);
 bool strip_text(char *, char, char);
 bool string_lowercase(char * const, unsigned int);
 bool string_skip_chars(char *, char *);
-bool append_string(char *, char *, char *, unsigned int, unsigned int);
+bool append_string(context * const, char *, char *, char *, unsigned int, unsigned int);
 bool append_char(char *, char, unsigned int);
 
+/* span functions */
+void span_trim(struct span * const, int);
+bool span_starts(struct span const * const, char const *);
+size_t span_split(struct span const * const, char, struct span * const, size_t);
+int strntoi(char const *, size_t);
+double strntod(char const *, size_t);
+uint32_t count_lines(char const *, char const *);
+
 /* strings list functions */
 bool slist_add(struct slist **, char *);
 bool slist_match(struct slist *, char *);
 
 /* unicode-related functions */
-enum chs_type unicode_check(char *, struct unicode_test *);
+enum chs_type unicode_check(context * const, char *, struct unicode_test *);
+enum chs_type unicode_check_span(context * const, struct span * const, struct unicode_test *);
 char *charset_type_tos(enum chs_type type);
 uint8_t unicode_bom_len(enum chs_type);
 
 /* "usage" functions */
 void usage(int);
 void usage_common_opts(void);
+void usage_ssa_input_opts(void);
+void usage_batch_opts(void);
 void usage_convert(char *);
 void usage_convert_input(void);
 void usage_convert_output(void);
@@ -241,16 +297,17 @@ void stack_pop (STACK_ELEM * const, STACK_ELEM **);
 /* various functions */
 int _strtok(char *, char *);
 void msglevel_change(verbosity *, char);
-void log_msg(uint8_t, const char *, ...);
-bool common_checks(struct options * const);
-bool set_wrap(enum wrapping_mode *, char *);
+void log_msg(context * const, uint8_t, const char *, ...);
+bool common_checks(context * const);
+uint8_t cpu_threads(uint8_t);
+bool set_wrap(context * const, enum wrapping_mode *, char *);
 bool font_size_normalize(struct res const * const, float * const);
-uint32_t parse_color(char const * const);
+uint32_t parse_color(context * const, char const * const);
 
 /* tags functions */
 bool dump_tag(struct tag const * const);
-bool add_tag_param(struct tag * const, char, char *);
+bool add_tag_param(context * const, struct tag * const, char, char *);
 char *get_tag_param_by_name(struct tag *, char *);
-int16_t parse_html_tag(char const * const, struct tag * const);
+int16_t parse_html_tag(context * const, char const * const, struct tag * const);
 
 #endif /* _COMMON_H */
@@ -16,10 +16,8 @@
 
 #include "common.h"
 #include "microsub.h"
-
-/* variables */
-extern struct options opts;
-extern uint32_t line_num;
+#include "sort.h"
+#include "scan.h"
 
 /* order is important */
 struct unicode_test uc_t_microsub[5] =
@@ -32,29 +30,39 @@ struct unicode_test uc_t_microsub[5] =
 };
 
 bool
-parse_microsub_file(FILE *infile, microsub_file * const file)
+parse_microsub_file(context * const ctx, FILE *infile,
+                    microsub_file * const file)
   {
     char line[MAXLINE];
     char *p = line;
     uint8_t i = 0;
     microsub_event *event;
     microsub_event **elist_tail = &file->events;
+    jmp_buf env, *outer = ctx->abort;
 
     if (!infile || !file) return false;
 
+    /* events, parsed before error, stays in file */
+    if (setjmp(env) != 0)
+      {
+        ctx->abort = outer;
+        return false;
+      }
+    ctx->abort = &env;
+
     while (true)
       {
         memset(line, '\0', MAXLINE);
         fgets(line, MAXLINE, infile);
         if (feof(infile)) break;
-        line_num++;
+        ctx->line_num++;
 
         /* unicode handle */
-        if (line_num == 1)
-          charset_type = unicode_check(line, uc_t_microsub);
+        if (ctx->line_num == 1)
+          ctx->charset = unicode_check(ctx, line, uc_t_microsub);
 
         trim_newline(line);
-        log_msg(raw, "%s", line);
+        log_msg(ctx, raw, "%s", line);
         trim_spaces(line, LINE_START | LINE_END);
 
         CALLOC(event, 1, sizeof(microsub_event));
@@ -62,14 +70,14 @@ parse_microsub_file(FILE *infile, microsub_file * const file)
         if (strncmp(line, "{1}{1}", 6) == 0)
           {
             file->framerate = atof(line + 6);
-            log_msg(info, _("Detected framerate: %f"), file->framerate);
+            log_msg(ctx, info, _("Detected framerate: %f"), file->framerate);
             free(event);
             continue;
           }
 
         if (sscanf(line, "{%u}{%u}", &event->start, &event->end) != 2)
           {
-            log_msg(warn, _("Can't detect timing in event at line %u. Event will be skipped."), line_num);
+            log_msg(ctx, warn, _("Can't detect timing in event at line %u. Event will be skipped."), ctx->line_num);
             free(event);
             continue;
           }
@@ -81,32 +89,119 @@ parse_microsub_file(FILE *infile, microsub_file * const file)
               {         /*            ^- '*p'      */
                 while ((p = strchr(line, '|')) != NULL) *p = '\n';
                 if ((event->text = strndup(line, MAXLINE)) == NULL)
-                  log_msg(error, MSG_M_OOM);
+                  log_msg(NULL, error, MSG_M_OOM);
                 break;
               }
           }
-        microsub_event_append(&file->events, &elist_tail, event, opts.i_sort);
+        microsub_event_append(&file->events, &elist_tail, event);
       }
 
+    if (ctx->opts.i_sort)
+      events_sort((void **) &file->events, microsub_event_start);
+
+    ctx->abort = outer;
+
     return true;
   }
 
 void
 microsub_event_append(microsub_event **head, microsub_event ***tail,
-                      microsub_event * const e, bool sort)
+                      microsub_event * const e)
   {
-    microsub_event *t = NULL;
-
     if (*head == NULL)
       *head = e;
-    else if (**tail != NULL && (!sort || e->start > (**tail)->start))
+    else
       (**tail)->next = e, *tail = &(**tail)->next;
-    else /* *tail == NULL || (tail != NULL && e->start <= (*tail)->start) */
-      for (t = *head; t != NULL && t->next != NULL; t = t->next)
-        if (t->next->start > e->start)
-          {
-            e->next = t->next, t->next = e;
-            break;
-          }
+  }
+
+double
+microsub_event_start(void const *e)
+  {
+    return ((microsub_event const *) e)->start;
+  }
+
+/** validation */
+
+/* "{start}{end}Text|Text", lines are independent of each other, *
+ * so scanner itself is the whole state of checker              */
+static void
+microsub_check_line(scanner * const s, struct span * const line)
+  {
+    char const *p = NULL, *end = NULL;
+    uint32_t t[2] = { 0, 0 };
+    uint8_t i = 0, digits = 0;
+    int depth = 0;
+
+    span_trim(line, LINE_START | LINE_END);
+    p = line->ptr, end = line->ptr + line->len;
+
+    if (line->len == 0)
+      return;
+
+    if (span_starts(line, "{1}{1}"))
+      {
+        if (strntod(p + 6, line->len - 6) <= 0.0)
+          scan_warn(s, _("Wrong framerate at line %u: %.*s"),
+                    scan_line_num(s, s->line_num), (int) line->len, line->ptr);
+        return;
+      }
+
+    for (i = 0; i < 2; i++, p++)
+      {
+        if (p >= end || *p != '{')
+          break;
+        for (p++, digits = 0; p < end && isdigit(*p); p++, digits++)
+          t[i] = t[i] * 10 + (*p - '0');
+        if (digits == 0 || p >= end || *p != '}')
+          break;
+      }
+
+    if (i < 2)
+      {
+        scan_warn(s, _("Can't detect timing in event at line %u. Event will be skipped."),
+                  scan_line_num(s, s->line_num));
+        return;
+      }
+
+    if (t[0] > t[1])
+      scan_warn(s, _("Negative duration of event at line '%u'. Event will be skipped."),
+                scan_line_num(s, s->line_num));
+
+    for (; p < end && isblank(*p); p++);
+    if (p == end)
+      {
+        scan_warn(s, _("Empty subtitle text at line %u."), scan_line_num(s, s->line_num));
+        return;
+      }
+
+    /* formatting codes, like "{y:i}", should be balanced */
+    for (; p < end && depth >= 0; p++)
+      if      (*p == '{') depth++;
+      else if (*p == '}') depth--;
+
+    if (depth != 0)
+      scan_warn(s, _("Unbalanced braces in text at line %u."),
+                scan_line_num(s, s->line_num));
+  }
+
+static scan_ops const microsub_check_ops =
+  {
+    sizeof(scanner),
+    uc_t_microsub,
+    microsub_check_line,
+    NULL,
+    NULL
+  };
+
+/* Validation only: checks timings & text of each event, *
+ * without building events list and without any memory   *
+ * allocation. Returns false, if any problem found       */
+bool
+check_microsub_file(context * const ctx, FILE *infile)
+  {
+    scanner jobs[SCAN_THREADS_MAX];
+
+    memset(&jobs[0], 0, sizeof(scanner));
 
+    return scan_input(ctx, infile, &microsub_check_ops, jobs);
   }
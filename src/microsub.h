@@ -33,8 +33,10 @@ typedef struct microsub_file
   } microsub_file;
 
 /** function prototypes */
-bool parse_microsub_file(FILE *, microsub_file * const);
+bool parse_microsub_file(context * const, FILE *, microsub_file * const);
+bool check_microsub_file(context * const, FILE *);
 void microsub_event_append(microsub_event **, microsub_event ***,
-                           microsub_event * const, bool);
+                           microsub_event * const);
+double microsub_event_start(void const *);
 
 #endif /* _MICROSUB_H */
@@ -16,6 +16,9 @@
 
 #include "common.h"
 #include "microsub.h"
+#include "arena.h"
+#include "batch.h"
+#include "outbuf.h"
 #include "ssa.h"
 
 #define PROG_NAME "microsub2ssa"
@@ -34,77 +37,164 @@ void usage(int exit_code)
     usage_convert_output();
     fputc('\n', stderr);
 
+    usage_batch_opts();
+    fputc('\n', stderr);
+
     exit(exit_code);
  }
 
 /* import some usefull stuff */
-extern struct options opts;
 extern ssa_style ssa_style_template;
 extern ssa_event ssa_event_template;
 
-/* options */
-unsigned long int line_num = 0;
-unsigned long parsed = 0;
+/* options from command line, the same for all converted files */
+struct settings
+  {
+    ssa_version type;
+    struct res res;
+  };
 
-int main(int argc, char *argv[])
+/* converts ctx->opts.infile to ctx->opts.outfile */
+static bool
+convert(context * const ctx, void *arg)
   {
+    struct settings const *set = arg;
     microsub_file   source;
     ssa_file        target;
     microsub_event *src;
     ssa_event     **dst;
-    char opt;
     char buf[MAXLINE] = "";
+    /* style, name, effect & text of each event */
+    struct span str[4] = { { "Default", 7 }, { "", 0 }, { "", 0 }, { NULL, 0 } };
 
-    if (argc < 2) usage(EXIT_SUCCESS);
+    /* validation only: nothing is parsed or allocated */
+    if (ctx->opts.i_test)
+      {
+        if (!check_microsub_file(ctx, ctx->opts.infile))
+          {
+            if (!ctx->failed)
+              log_msg(ctx, error, MSG_W_TESTFAIL);
+            return false;
+          }
+        log_msg(ctx, warn, MSG_W_TESTDONE);
+        return true;
+      }
 
-    /* init, stage 1 */
     memset(&source, 0, sizeof(microsub_file));
     init_ssa_file(&target);
+    target.type = set->type;
+    target.res  = set->res;
+
+    if (!parse_microsub_file(ctx, ctx->opts.infile, &source))
+      return false;
+
+    /* init, stage 2 */
+    src = source.events;
+    dst = &target.events;
+    ACALLOC(target.styles, &target.mem, 1, sizeof(ssa_style));
+
+    memcpy(target.styles, &ssa_style_template, sizeof(ssa_style));
+    target.styles->name = "Default";
+
+    while (src != (microsub_event *) 0)
+      {
+        ACALLOC(*dst, &target.mem, 1, sizeof(ssa_event));
+
+        memcpy(*dst, &ssa_event_template, sizeof(ssa_event));
+
+        /* copy data */
+        (*dst)->type  = DIALOGUE;
+        (*dst)->start = double2cs(src->start);
+        (*dst)->end   = double2cs(src->end);
+
+        strncpy(buf, src->text, MAXLINE);
+
+        /* text wrapping */
+        if      (ctx->opts.o_wrap == keep)
+          text_replace(ctx, buf, "|", "\\n", MAXLINE, 0);
+        else if (ctx->opts.o_wrap == merge)
+          text_replace(ctx, buf, "|", " ",   MAXLINE, 0);
+
+        str[3].ptr = buf, str[3].len = strlen(buf);
+        ssa_event_pack(&target.mem, *dst, str);
+
+        dst = &((*dst)->next);
+        source.events = src->next;
+        free(src->text);
+        free(src);
+        src = source.events;
+      }
+
+    font_size_normalize(&target.res, &target.styles->fontsize);
+
+    return write_ssa_file(ctx, ctx->opts.outfile, &target, true);
+  }
+
+int main(int argc, char *argv[])
+  {
+    struct settings set = { ssa_unknown, { 0, 0 } };
+    context ctx;
+    char *batch = NULL;
+    uint8_t jobs = 0;
+    int k = 0;
+    char opt;
+
+    if (argc < 2) usage(EXIT_SUCCESS);
+
+    context_init(&ctx);
 
     /* parsing options */
-    while ((opt = getopt(argc, argv, "qvhi:o:" "ST" "f:x:y:Fw:")) != -1)
+    while ((opt = getopt(argc, argv, "qvhi:o:" "b:j:" "ST" "f:x:y:Fw:")) != -1)
       {
         switch (opt)
           {
             case 'f' :
-              if      (strcmp(optarg, "ssa") == 0) target.type = ssa_v4;
-              else if (strcmp(optarg, "ass") == 0) target.type = ssa_v4p;
+              if      (strcmp(optarg, "ssa") == 0) set.type = ssa_v4;
+              else if (strcmp(optarg, "ass") == 0) set.type = ssa_v4p;
               break;
             case 'q' :
             case 'v' :
-              msglevel_change(&opts.msglevel, (opt == 'q') ? '-' : '+');
+              msglevel_change(&ctx.opts.msglevel, (opt == 'q') ? '-' : '+');
               break;
             case 'i' :
-              if ((opts.infile = fopen(optarg, "r")) == NULL)
-                log_msg(error, MSG_F_ORDFAIL, optarg);
+              if ((ctx.opts.infile = fopen(optarg, "r")) == NULL)
+                log_msg(&ctx, error, MSG_F_ORDFAIL, optarg);
               break;
             case 'o' :
-              if ((opts.outfile = fopen(optarg, "w")) == NULL)
+              if ((ctx.opts.outfile = fopen(optarg, "w")) == NULL)
                 {
-                  log_msg(warn, MSG_F_OWRFAILSO, optarg);
-                  opts.outfile = stdout;
+                  log_msg(&ctx, warn, MSG_F_OWRFAILSO, optarg);
+                  ctx.opts.outfile = stdout;
                 }
               break;
+            case 'b' :
+              batch = optarg;
+              break;
+            case 'j' :
+              if ((k = atoi(optarg)) < 0 || k > BATCH_THREADS_MAX)
+                log_msg(&ctx, error, MSG_O_OOR, "-j");
+              jobs = k;
+              break;
             case 'S' :
-              opts.i_sort = true;
+              ctx.opts.i_sort = true;
               break;
             case 'T' :
-              opts.i_test = true;
+              ctx.opts.i_test = true;
               break;
             case 'x' :
-              target.res.width  = atoi(optarg);
+              set.res.width  = atoi(optarg);
               break;
             case 'y' :
-              target.res.height = atoi(optarg);
+              set.res.height = atoi(optarg);
               break;
             case 'w' :
-              set_wrap(&opts.o_wrap, optarg);
+              set_wrap(&ctx, &ctx.opts.o_wrap, optarg);
               break;
             case 'h' :
               usage(EXIT_SUCCESS);
               break;
             case 'F' :
-              opts.o_fsize_tune = true;
+              ctx.opts.o_fsize_tune = true;
               break;
             default :
               usage(EXIT_FAILURE);
@@ -113,66 +203,29 @@ int main(int argc, char *argv[])
       }
 
     /* checks */
-    common_checks(&opts);
+    if (set.type == ssa_unknown)
+      log_msg(&ctx, error, MSG_O_OREQUIRED, "-f");
 
-    if (target.type == ssa_unknown)
-      log_msg(error, MSG_O_OREQUIRED, "-f");
+    if (ctx.opts.o_fsize_tune && !set.res.width && !set.res.height)
+      log_msg(&ctx, error, _("'-F' option requires '-x' and/or '-y'."));
 
-    if (opts.o_fsize_tune && !target.res.width && !target.res.height)
-      log_msg(error, _("'-F' option requires '-x' and/or '-y'."));
-
-    if (!parse_microsub_file(opts.infile, &source))
-      log_msg(error, MSG_U_UNKNOWN);
-
-    if (opts.i_test)
+    if (batch != NULL)
       {
-        log_msg(warn, MSG_W_TESTDONE);
-        exit(EXIT_SUCCESS);
+        if (ctx.opts.infile != NULL || ctx.opts.outfile != NULL)
+          log_msg(&ctx, error, MSG_O_NOTWITHB);
+        exit(batch_run(&ctx, batch, (set.type == ssa_v4p) ? ".ass" : ".ssa",
+                       jobs, convert, &set) ? EXIT_SUCCESS : EXIT_FAILURE);
       }
 
-    /* init, stage 2 */
-    src = source.events;
-    dst = &target.events;
-    CALLOC(target.styles, 1, sizeof(ssa_style));
-
-    memcpy(target.styles, &ssa_style_template, sizeof(ssa_style));
-
-    while (src != (microsub_event *) 0)
-      {
-        CALLOC(*dst, 1, sizeof(ssa_event));
-
-        memcpy(*dst, &ssa_event_template, sizeof(ssa_event));
-
-        /* copy data */
-        (*dst)->type  = DIALOGUE;
-        (*dst)->start = src->start;
-        (*dst)->end   = src->end;
-
-        strncpy(buf, src->text, MAXLINE);
-
-        /* text wrapping */
-        if      (opts.o_wrap == keep)
-          text_replace(buf, "|", "\\n", MAXLINE, 0);
-        else if (opts.o_wrap == merge)
-          text_replace(buf, "|", " ",   MAXLINE, 0);
-
-        STRNDUP((*dst)->text, buf, MAXLINE);
-
-        dst = &((*dst)->next);
-        source.events = src->next;
-        free(src->text);
-        free(src);
-        src = source.events;
-      }
-
-    font_size_normalize(&target.res, &target.styles->fontsize);
+    common_checks(&ctx);
 
-    write_ssa_file(opts.outfile, &target, true);
+    if (!convert(&ctx, &set) && !ctx.failed)
+      log_msg(&ctx, error, MSG_U_UNKNOWN);
 
     /* prepare to exit */
-    if (opts.infile  != NULL)   fclose(opts.infile);
-    if (opts.outfile != NULL &&
-        opts.outfile != stdout) fclose(opts.outfile);
+    if (ctx.opts.infile  != NULL)   fclose(ctx.opts.infile);
+    if (ctx.opts.outfile != NULL &&
+        ctx.opts.outfile != stdout) fclose(ctx.opts.outfile);
 
-    return 0;
+    return (ctx.failed) ? EXIT_FAILURE : EXIT_SUCCESS;
   }
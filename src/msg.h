@@ -29,6 +29,7 @@
 #define MSG_F_OWRFAILSO  _("Can't open file '%s' for write. stdout will be used.")
 #define MSG_F_CTMPFAIL   _("Can't create temporary file: %s")
 #define MSG_F_WRFAIL     _("Write failed.")
+#define MSG_F_RDFAIL     _("Read failed: %s")
 #define MSG_F_IFMISSING  _("Input file not specified.")
 #define MSG_F_OFMISSING  _("Output file not specified. stdout will be used.")
 #define MSG_F_UNEXPEOF   _("Unexpected EOF at line '%u'")
@@ -61,6 +62,8 @@
 #define MSG_O_OREQUIRED  _("'%s' option required.")
 #define MSG_O_OVREQUIRED _("'%s' option: value required.")
 #define MSG_O_OOR        _("'%s': value is out of acceptable range.")
+#define MSG_O_NOTWITHB   _("Options '-i' and '-o' not allowed in batch mode.")
+#define MSG_O_NOTTOGETHER _("Options '%s' and '%s' can't be used together.")
 /* various messages */
 #define MSG_I_EVSORTED   _("Events in output file will be sorted by timing.")
 /* unknown error */
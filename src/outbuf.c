@@ -0,0 +1,262 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+#include "outbuf.h"
+
+/* enough for any 64-bit integer with sign */
+#define NUM_MAXLEN 24
+
+static void
+outbuf_writev(outbuf const * const b, struct iovec *iov, int cnt)
+  {
+    ssize_t done = 0;
+
+    while (cnt > 0)
+      {
+        if ((done = writev(b->fd, iov, cnt)) < 0)
+          {
+            if (errno == EINTR)
+              continue;
+            log_msg(b->ctx, error, MSG_F_WRFAIL);
+          }
+
+        /* partial write: skip written parts */
+        for (; cnt > 0 && (size_t) done >= iov->iov_len; iov++, cnt--)
+          done -= iov->iov_len;
+
+        if (cnt > 0)
+          {
+            iov->iov_base = (char *) iov->iov_base + done;
+            iov->iov_len -= done;
+          }
+      }
+  }
+
+bool
+outbuf_open(outbuf * const b, context * const ctx, FILE *outfile)
+  {
+    if (!b || !outfile)
+      return false;
+
+    b->ctx = ctx;
+
+    /* anything, already buffered by stdio, goes first */
+    if (fflush(outfile) != 0)
+      log_msg(ctx, error, MSG_F_WRFAIL);
+
+    if ((b->fd = fileno(outfile)) < 0)
+      return false;
+
+    CALLOC(b->data, OUTBUF_SIZE, sizeof(char));
+    b->used = 0;
+
+    return true;
+  }
+
+void
+outbuf_flush(outbuf * const b)
+  {
+    struct iovec iov;
+
+    if (b->used == 0)
+      return;
+
+    iov.iov_base = b->data;
+    iov.iov_len  = b->used;
+    outbuf_writev(b, &iov, 1);
+    b->used = 0;
+  }
+
+void
+outbuf_close(outbuf * const b)
+  {
+    if (!b || !b->data)
+      return;
+
+    outbuf_flush(b);
+    free(b->data);
+    b->data = NULL;
+  }
+
+void
+outbuf_put(outbuf * const b, char const *str, size_t len)
+  {
+    struct iovec iov[2];
+
+    if (b->used + len <= OUTBUF_SIZE)
+      {
+        memcpy(b->data + b->used, str, len);
+        b->used += len;
+        return;
+      }
+
+    if (len < OUTBUF_DIRECT)
+      {
+        outbuf_flush(b);
+        memcpy(b->data, str, len);
+        b->used = len;
+        return;
+      }
+
+    /* big chunk: buffer & chunk with single syscall */
+    iov[0].iov_base = b->data;
+    iov[0].iov_len  = b->used;
+    iov[1].iov_base = (void *) str;
+    iov[1].iov_len  = len;
+    outbuf_writev(b, iov, 2);
+    b->used = 0;
+  }
+
+void
+outbuf_puts(outbuf * const b, char const *str)
+  {
+    if (!str) /* as glibc's printf("%s") does */
+      str = "(null)";
+
+    outbuf_put(b, str, strlen(str));
+  }
+
+void
+outbuf_putc(outbuf * const b, char c)
+  {
+    if (b->used == OUTBUF_SIZE)
+      outbuf_flush(b);
+
+    b->data[b->used++] = c;
+  }
+
+/* same as printf("%0*li", width, num) */
+void
+outbuf_int(outbuf * const b, long num, uint8_t width)
+  {
+    char buf[NUM_MAXLEN];
+    char *p = buf + NUM_MAXLEN;
+    unsigned long u = (num < 0) ? 0UL - num : (unsigned long) num;
+    uint8_t len = 0;
+
+    do
+      *(--p) = '0' + u % 10, u /= 10;
+    while (u > 0);
+
+    /* width includes sign */
+    len = (num < 0) ? 1 : 0;
+    while (buf + NUM_MAXLEN - p + len < width && p > buf + 1)
+      *(--p) = '0';
+
+    if (num < 0)
+      *(--p) = '-';
+
+    outbuf_put(b, p, buf + NUM_MAXLEN - p);
+  }
+
+/* same as printf("%0*X", width, num) */
+void
+outbuf_hex(outbuf * const b, uint32_t num, uint8_t width)
+  {
+    char buf[NUM_MAXLEN];
+    char *p = buf + NUM_MAXLEN;
+
+    do
+      *(--p) = "0123456789ABCDEF"[num & 0xF], num >>= 4;
+    while (num > 0);
+
+    while (buf + NUM_MAXLEN - p < width && p > buf)
+      *(--p) = '0';
+
+    outbuf_put(b, p, buf + NUM_MAXLEN - p);
+  }
+
+/* "H:MM:SS.cc" from centiseconds, *
+ * negative values written as zero */
+void
+outbuf_time(outbuf * const b, int32_t t)
+  {
+    char buf[NUM_MAXLEN];
+    char *p = buf + NUM_MAXLEN;
+    long cs = (t > 0) ? t : 0;
+    long i = 0;
+
+    i = cs % 100,  cs /= 100;
+    *(--p) = '0' + i % 10, *(--p) = '0' + i / 10, *(--p) = '.';
+    i = cs % SEC_IN_MIN, cs /= SEC_IN_MIN;
+    *(--p) = '0' + i % 10, *(--p) = '0' + i / 10, *(--p) = ':';
+    i = cs % SEC_IN_MIN, cs /= SEC_IN_MIN;
+    *(--p) = '0' + i % 10, *(--p) = '0' + i / 10, *(--p) = ':';
+
+    outbuf_int(b, cs, 0);
+    outbuf_put(b, p, buf + NUM_MAXLEN - p);
+  }
+
+/* for rare cases, like floats */
+void
+outbuf_printf(outbuf * const b, char const *format, ...)
+  {
+    va_list ap;
+    int len = 0;
+
+    if (OUTBUF_SIZE - b->used < MAXLINE)
+      outbuf_flush(b);
+
+    va_start(ap, format);
+    len = vsnprintf(b->data + b->used, OUTBUF_SIZE - b->used, format, ap);
+    va_end(ap);
+
+    if (len < 0 || (size_t) len >= OUTBUF_SIZE - b->used)
+      log_msg(b->ctx, error, MSG_F_WRFAIL);
+
+    b->used += len;
+  }
+
+/* Copies 'len' bytes at 'offset' of file 'fd' to output. data goes *
+ * from file to file in kernel with sendfile(), where possible, or  *
+ * with pread() right into buffer otherwise                         */
+void
+outbuf_copy(outbuf * const b, int fd, off_t offset, size_t len)
+  {
+    ssize_t got = 0;
+    size_t part = 0;
+#ifdef __linux__
+    bool direct = true;
+#endif
+
+    outbuf_flush(b); /* buffered data goes first */
+
+    while (len > 0)
+      {
+#ifdef __linux__
+        if (direct && (got = sendfile(b->fd, fd, &offset, len)) > 0)
+          {
+            len -= got;
+            continue;
+          }
+        direct = false; /* not supported for these files */
+#endif
+        if (b->used == OUTBUF_SIZE)
+          outbuf_flush(b);
+
+        part = OUTBUF_SIZE - b->used;
+        if ((got = pread(fd, b->data + b->used, (len < part) ? len : part, offset)) <= 0)
+          {
+            if (got < 0 && errno == EINTR)
+              continue;
+            log_msg(b->ctx, error, MSG_F_RDFAIL,
+                    (got < 0) ? strerror(errno) : _("unexpected end of file"));
+          }
+
+        b->used += got, offset += got, len -= got;
+      }
+  }
@@ -0,0 +1,51 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef _OUTBUF_H
+#define _OUTBUF_H
+
+#define OUTBUF_SIZE (256 * 1024)
+/* chunks of this size or larger are written directly *
+ * with writev(), together with buffered data         */
+#define OUTBUF_DIRECT (OUTBUF_SIZE / 4)
+
+/* Output layer for writers: data collected in large *
+ * user-space buffer and flushed with write()/writev() *
+ * directly to file descriptor. Numbers & timestamps *
+ * formatted by hand, without stdio format parsing.  */
+typedef struct outbuf
+  {
+    int      fd;
+    char    *data;
+    size_t   used;
+    context *ctx;  /* write errors are reported here */
+  } outbuf;
+
+/** function prototypes */
+bool outbuf_open(outbuf * const, context * const, FILE *);
+void outbuf_flush(outbuf * const);
+void outbuf_close(outbuf * const);
+
+void outbuf_put(outbuf * const, char const *, size_t);
+void outbuf_puts(outbuf * const, char const *);
+void outbuf_putc(outbuf * const, char);
+void outbuf_int(outbuf * const, long, uint8_t);
+void outbuf_hex(outbuf * const, uint32_t, uint8_t);
+void outbuf_time(outbuf * const, int32_t);
+void outbuf_printf(outbuf * const, char const *, ...);
+void outbuf_copy(outbuf * const, int, off_t, size_t);
+
+#endif /* _OUTBUF_H */
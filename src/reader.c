@@ -0,0 +1,247 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+#include "reader.h"
+
+/* slurp whole input with large blocks, *
+ * used, if mmap() is not possible      */
+static bool
+reader_fill(reader * const r, int fd)
+  {
+    size_t size = 0;
+    ssize_t got = 0;
+    char *p = NULL;
+
+    for (;;)
+      {
+        if (r->size + READER_BLOCK_SIZE > size)
+          {
+            size = (size == 0) ? READER_BLOCK_SIZE * 4 : size * 2;
+            if ((p = realloc(r->data, size)) == NULL)
+              log_msg(NULL, error, MSG_M_OOM, __FILE__, __LINE__);
+            r->data = p;
+          }
+
+        got = read(fd, r->data + r->size, size - r->size);
+
+        if (got == 0)
+          break;
+
+        if (got < 0)
+          {
+            if (errno == EINTR)
+              continue;
+            log_msg(r->ctx, warn, MSG_F_RDFAIL, strerror(errno));
+            return false;
+          }
+
+        r->size += got;
+      }
+
+    return true;
+  }
+
+/* window: moves unread data to start of buffer and reads *
+ * more, till there is whole line in it or input ends      */
+static void
+reader_refill(reader * const r)
+  {
+    ssize_t got = 0;
+    char *p = NULL;
+
+    while (!r->eof && (r->pos == r->size ||
+           memchr(r->data + r->pos, '\n', r->size - r->pos) == NULL))
+      {
+        if (r->pos > 0)
+          {
+            memmove(r->data, r->data + r->pos, r->size - r->pos);
+            r->offset += r->pos;
+            r->size -= r->pos, r->pos = 0;
+          }
+
+        if (r->size == r->cap) /* line is longer, than window */
+          {
+            r->cap = (r->cap == 0) ? READER_BLOCK_SIZE : r->cap * 2;
+            if ((p = realloc(r->data, r->cap)) == NULL)
+              log_msg(NULL, error, MSG_M_OOM, __FILE__, __LINE__);
+            r->data = p;
+          }
+
+        if ((got = read(r->fd, r->data + r->size, r->cap - r->size)) < 0)
+          {
+            if (errno == EINTR)
+              continue;
+            log_msg(r->ctx, warn, MSG_F_RDFAIL, strerror(errno));
+          }
+
+        if (got <= 0)
+          r->eof = true;
+        else
+          r->size += got;
+      }
+  }
+
+/* mapped: pages behind current line are not needed any more */
+static void
+reader_drop(reader * const r)
+  {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t upto = r->pos / page * page;
+
+    madvise(r->data + r->dropped, upto - r->dropped, MADV_DONTNEED);
+    r->dropped = upto;
+  }
+
+/* maps regular file, without any fallback: false means, that *
+ * input should be read by other means, 'r' is left zeroed    */
+bool
+reader_open_map(reader * const r, context * const ctx, FILE *infile)
+  {
+    int fd = -1;
+    struct stat st;
+    void *map = NULL;
+
+    if (!r || !infile)
+      return false;
+
+    memset(r, 0, sizeof(reader));
+    r->ctx = ctx;
+
+    if ((fd = fileno(infile)) < 0)
+      return false;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+      {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+          {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            r->data   = map;
+            r->size   = st.st_size;
+            r->mapped = true;
+            return true;
+          }
+        log_msg(r->ctx, debug, "mmap() failed: %s, fallback to read()", strerror(errno));
+      }
+
+    return false;
+  }
+
+bool
+reader_open(reader * const r, context * const ctx, FILE *infile)
+  {
+    int fd = -1;
+
+    if (!r || !infile || (fd = fileno(infile)) < 0)
+      return false;
+
+    if (reader_open_map(r, ctx, infile))
+      return true;
+
+    return reader_fill(r, fd);
+  }
+
+/* Same as reader_open(), but input, which can't be mapped, *
+ * is read by window, and mapped one is released, while    *
+ * it's read. so memory use does not depend on input size  */
+bool
+reader_open_stream(reader * const r, context * const ctx, FILE *infile)
+  {
+    struct stat st;
+    int fd = -1;
+
+    if (!r || !infile || (fd = fileno(infile)) < 0)
+      return false;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+      {
+        if (!reader_open(r, ctx, infile))
+          return false;
+        r->stream = r->mapped; /* slurped one is not released */
+        return true;
+      }
+
+    memset(r, 0, sizeof(reader));
+    r->ctx = ctx;
+    r->fd = fd;
+    r->stream = true;
+
+    return true;
+  }
+
+/* returns next line without trailing "\n" or "\r\n" *
+ * false means, that no more lines left              */
+bool
+reader_next_line(reader * const r, struct span * const line)
+  {
+    char *p = NULL;
+    char *nl = NULL;
+    size_t left = 0;
+
+    if (r->stream && !r->mapped)
+      reader_refill(r);
+    else if (r->stream && r->pos - r->dropped >= READER_DROP_SIZE)
+      reader_drop(r);
+
+    if (r->pos >= r->size)
+      return false;
+
+    p = r->data + r->pos;
+    left = r->size - r->pos;
+
+    if ((nl = memchr(p, '\n', left)) != NULL)
+      {
+        line->len = nl - p;
+        r->pos += line->len + 1;
+      }
+    else /* last line without newline */
+      {
+        line->len = left;
+        r->pos = r->size;
+      }
+
+    line->ptr = p;
+    if (line->len > 0 && p[line->len - 1] == '\r')
+      line->len--;
+
+    return true;
+  }
+
+/* continue reading from 'p', which must point into data, *
+ * for callers, who consumed some lines by other means    */
+void
+reader_seek(reader * const r, char const * const p)
+  {
+    if (p < r->data || p > r->data + r->size)
+      return;
+
+    r->pos = p - r->data;
+  }
+
+void
+reader_close(reader * const r)
+  {
+    if (!r || !r->data)
+      return;
+
+    if (r->mapped)
+      munmap(r->data, r->size);
+    else
+      free(r->data);
+
+    memset(r, 0, sizeof(reader));
+  }
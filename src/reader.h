@@ -0,0 +1,56 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef _READER_H
+#define _READER_H
+
+/* chunk size for reading from pipes & other non-mmap()'able inputs */
+#define READER_BLOCK_SIZE (1024 * 1024)
+/* streaming: mapped input, already read, is dropped by such pieces */
+#define READER_DROP_SIZE  (16 * 1024 * 1024)
+
+/* Input is available as one solid memory region:  *
+ * mmap()'ed regular file or buffer, filled by     *
+ * large read()'s. Lines are returned as spans     *
+ * right into this region, without any copying.    *
+ * All spans stays valid until reader_close().     *
+ * Streaming reader keeps only window of input in  *
+ * memory, and only the last span stays valid      */
+typedef struct reader
+  {
+    char  *data;   /* start of input data          */
+    size_t size;   /* size of input data           */
+    size_t pos;    /* offset of next unread line   */
+    bool mapped;   /* data was mmap()'ed?          */
+    context *ctx;  /* for messages, may be NULL    */
+    /* streaming only */
+    bool stream;
+    bool eof;      /* window: nothing more to read */
+    int fd;        /* window: read from here       */
+    size_t cap;    /* window: allocated size       */
+    off_t offset;  /* window: of 'data' in input   */
+    size_t dropped; /* mapped: bytes, released     */
+  } reader;
+
+/** function prototypes */
+bool reader_open(reader * const, context * const, FILE *);
+bool reader_open_map(reader * const, context * const, FILE *);
+bool reader_open_stream(reader * const, context * const, FILE *);
+bool reader_next_line(reader * const, struct span * const);
+void reader_seek(reader * const, char const * const);
+void reader_close(reader * const);
+
+#endif /* _READER_H */
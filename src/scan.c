@@ -0,0 +1,347 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+#include "reader.h"
+#include "scan.h"
+
+/* absolute number of chunk's line 'n'. lines before chunk *
+ * are counted only once and only if some warning occurs  */
+uint32_t
+scan_line_num(scanner * const s, uint32_t n)
+  {
+    if (!s->counted)
+      s->base = count_lines(s->input, s->chunk.ptr), s->counted = true;
+
+    return s->base + n;
+  }
+
+/* Warnings of chunks are printed in order of chunks, as if input *
+ * was checked by one thread: chunk keeps them in it's buffer and *
+ * prints when all previous chunks are done. chunk with full      *
+ * buffer waits for it's turn and then prints at once             */
+struct scan_order
+  {
+    pthread_mutex_t lock;
+    pthread_cond_t next;
+    uint8_t turn;         /* chunk, that prints now */
+  };
+
+static void
+scan_wait_turn(scanner * const s)
+  {
+    struct scan_order *o = s->order;
+
+    pthread_mutex_lock(&o->lock);
+    while (o->turn != s->part)
+      pthread_cond_wait(&o->next, &o->lock);
+    pthread_mutex_unlock(&o->lock);
+
+    s->turn = true;
+  }
+
+/* prints warnings kept in buffer, chunk should have it's turn */
+static void
+scan_flush(scanner * const s)
+  {
+    char const *p = s->msgs, *end = s->msgs + s->msgs_len, *nl = NULL;
+
+    for (; p < end; p = nl + 1)
+      {
+        nl = memchr(p, '\n', end - p);
+        log_msg(&s->ctx, warn, "%.*s", (int) (nl - p), p);
+      }
+
+    s->msgs_len = 0;
+  }
+
+/* chunk is checked: print it's warnings, pass turn to next one */
+static void
+scan_pass_turn(scanner * const s)
+  {
+    struct scan_order *o = s->order;
+
+    if (!s->turn)
+      scan_wait_turn(s);
+    scan_flush(s);
+
+    pthread_mutex_lock(&o->lock);
+    o->turn++;
+    pthread_cond_broadcast(&o->next);
+    pthread_mutex_unlock(&o->lock);
+  }
+
+/* the same as log_msg(.., warn, ..), but also counts problem */
+void
+scan_warn(scanner * const s, char const *format, ...)
+  {
+    char buf[MAXLINE];
+    size_t len = 0;
+    va_list ap;
+
+    s->problems++;
+
+    va_start(ap, format);
+    vsnprintf(buf, MAXLINE, format, ap);
+    va_end(ap);
+
+    if (s->order == NULL || s->turn)
+      {
+        log_msg(&s->ctx, warn, "%s", buf);
+        return;
+      }
+
+    len = strlen(buf);
+    if (s->msgs_len + len + 1 > SCAN_MSGS_SIZE)
+      {
+        scan_wait_turn(s);
+        scan_flush(s);
+        log_msg(&s->ctx, warn, "%s", buf);
+        return;
+      }
+
+    memcpy(s->msgs + s->msgs_len, buf, len);
+    s->msgs_len += len;
+    s->msgs[s->msgs_len++] = '\n';
+  }
+
+/* i-th state in caller's array of checker's states */
+static scanner *
+scan_state(scan_ops const * const ops, void * const states, uint8_t i)
+  {
+    return (scanner *) ((char *) states + ops->size * i);
+  }
+
+/* all states are copies of the first one, prepared by caller */
+static void
+scan_init(context * const ctx, scan_ops const * const ops,
+          void * const states, uint8_t parts)
+  {
+    scanner *s = NULL;
+    uint8_t i = 0;
+
+    for (i = 0; i < parts; i++)
+      {
+        s = scan_state(ops, states, i);
+        if (i > 0)
+          memcpy(s, states, ops->size);
+        memset(s, 0, sizeof(scanner));
+        s->ctx = *ctx;
+        s->ctx.abort = NULL; /* only warnings are possible there */
+        s->ops = ops;
+      }
+  }
+
+static void *
+scan_thread(void *arg)
+  {
+    scanner *s = arg;
+    struct span line = { NULL, 0 };
+    reader in; /* over chunk memory, never closed */
+
+    memset(&in, 0, sizeof(reader));
+    in.data = (char *) s->chunk.ptr;
+    in.size = s->chunk.len;
+
+    while (reader_next_line(&in, &line))
+      {
+        s->line_num++;
+        s->ops->line(s, &line);
+      }
+
+    if (s->ops->done)
+      s->ops->done(s);
+
+    if (s->order)
+      scan_pass_turn(s);
+
+    return NULL;
+  }
+
+/* how many threads is worth to use for input of 'size' bytes */
+static uint8_t
+scan_threads(size_t size)
+  {
+    return (size < SCAN_MT_SIZE) ? 1 : cpu_threads(SCAN_THREADS_MAX);
+  }
+
+/* chunk may end after any line by default */
+static char const *
+scan_cut_line(char const *p, char const *end)
+  {
+    return ((p = memchr(p, '\n', end - p)) != NULL) ? p + 1 : end;
+  }
+
+/* mapped input: splitted to chunks, each one checked in own thread */
+static void
+scan_mapped(context * const ctx, reader * const in, scan_ops const * const ops,
+            void * const states, uint8_t parts)
+  {
+    pthread_t threads[SCAN_THREADS_MAX];
+    bool started[SCAN_THREADS_MAX];
+    struct scan_order order;
+    char const *from = in->data, *end = in->data + in->size;
+    char const *p = NULL, *cut = NULL;
+    struct span first = { NULL, 0 };
+    scanner *s = NULL;
+    uint8_t i = 0;
+
+    /* charset is checked once, BOM is not a part of first line */
+    if (reader_next_line(in, &first))
+      {
+        ctx->charset = unicode_check_span(ctx, &first, ops->charsets);
+        from = first.ptr;
+      }
+
+    for (i = 0, p = from; i < parts; i++)
+      {
+        cut = (i + 1 < parts) ? from + (end - from) * (i + 1) / parts : end;
+        if (cut < p)
+          cut = p;
+        if (cut < end)
+          cut = (ops->cut) ? ops->cut(cut, end) : scan_cut_line(cut, end);
+
+        s = scan_state(ops, states, i);
+        s->chunk.ptr = p, s->chunk.len = cut - p;
+        s->input = in->data;
+        if (parts > 1)
+          s->order = &order, s->part = i;
+        p = cut;
+      }
+
+    if (parts > 1)
+      log_msg(ctx, debug, _("Checking input in %u threads."), parts);
+
+    order.turn = 0;
+    pthread_mutex_init(&order.lock, NULL);
+    pthread_cond_init(&order.next, NULL);
+
+    for (i = 0; i < parts; i++)
+      {
+        s = scan_state(ops, states, i);
+        started[i] = (parts > 1) &&
+                     (pthread_create(&threads[i], NULL, scan_thread, s) == 0);
+        if (!started[i]) /* no more threads? do it by self */
+          scan_thread(s);
+      }
+
+    for (i = 0; i < parts; i++)
+      if (started[i])
+        pthread_join(threads[i], NULL);
+
+    pthread_cond_destroy(&order.next);
+    pthread_mutex_destroy(&order.lock);
+  }
+
+/* input, that can't be mapped, is read line by line to fixed buffer */
+static void
+scan_stream(context * const ctx, FILE *infile, scanner * const s)
+  {
+    char buf[MAXLINE];
+    struct span line = { buf, 0 };
+    bool tail = false; /* rest of too long line, not checked */
+    bool nl = false;
+
+    s->counted = true; /* nothing before the only chunk */
+
+    while (fgets(buf, MAXLINE, infile) != NULL)
+      {
+        line.ptr = buf, line.len = strlen(buf);
+        nl = (line.len > 0 && buf[line.len - 1] == '\n');
+
+        if (tail)
+          {
+            tail = !nl;
+            continue;
+          }
+
+        s->line_num++;
+        if (nl)
+          line.len--;
+        if (line.len > 0 && buf[line.len - 1] == '\r')
+          line.len--;
+
+        if (!nl && !feof(infile))
+          {
+            scan_warn(s, _("Line %u is too long, only first %u bytes checked."),
+                      s->line_num, (unsigned int) line.len);
+            tail = true;
+          }
+
+        if (s->line_num == 1)
+          ctx->charset = unicode_check_span(ctx, &line, s->ops->charsets);
+
+        s->ops->line(s, &line);
+      }
+
+    if (s->ops->done)
+      s->ops->done(s);
+  }
+
+/* Checks input by format-specific checker without any memory *
+ * allocation. 'states' is an array of SCAN_THREADS_MAX states *
+ * of 'ops->size' bytes each, the first one is prepared by     *
+ * caller. Returns true, if checker found no problems          */
+bool
+scan_input(context * const ctx, FILE *infile, scan_ops const * const ops,
+           void * const states)
+  {
+    reader in;
+    uint32_t problems = 0;
+    uint8_t parts = 1, i = 0;
+    jmp_buf env, *outer = ctx->abort;
+    scanner *s = NULL;
+
+    if (!infile || !ops || !states)
+      return false;
+
+    memset(&in, 0, sizeof(reader));
+
+    /* only wrong charset is possible here */
+    if (setjmp(env) != 0)
+      {
+        ctx->abort = outer;
+        reader_close(&in);
+        return false;
+      }
+    ctx->abort = &env;
+
+    if (reader_open_map(&in, ctx, infile))
+      {
+        scan_init(ctx, ops, states, (parts = scan_threads(in.size)));
+        scan_mapped(ctx, &in, ops, states, parts);
+        reader_close(&in);
+      }
+    else
+      {
+        scan_init(ctx, ops, states, parts);
+        scan_stream(ctx, infile, states);
+      }
+
+    ctx->abort = outer;
+
+    for (i = 0; i < parts; i++)
+      {
+        s = scan_state(ops, states, i);
+        ctx->line_num += s->line_num;
+        problems += s->problems;
+      }
+
+    log_msg(ctx, info, _("Checked %u lines, %u problem(s) found."),
+            ctx->line_num, problems);
+
+    return (problems == 0) ? true : false;
+  }
@@ -0,0 +1,68 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef _SCAN_H
+#define _SCAN_H
+
+/* smaller input is checked by one thread */
+#define SCAN_MT_SIZE     (4 * 1024 * 1024)
+#define SCAN_THREADS_MAX 8
+/* warnings of chunk are kept here till previous chunks are printed */
+#define SCAN_MSGS_SIZE   (4 * MAXLINE)
+
+/* Validation of input without parsing: input is mapped (or read  *
+ * line by line to fixed buffer, if it can't be mapped), splitted *
+ * to line-aligned chunks, and each chunk is passed line by line  *
+ * to format-specific checker in own thread. Checker keeps it's   *
+ * state in fixed-size struct, so no memory allocated at all      */
+typedef struct scanner
+  {
+    context ctx;          /* copy of caller's one, for warnings  */
+    struct scan_ops const *ops; /* checker's callbacks           */
+    struct span chunk;    /* whole lines only                    */
+    char const *input;    /* start of input & line number of ... */
+    uint32_t base;        /* ...chunk start, counted when needed */
+    bool counted;
+    uint32_t line_num;    /* of current line, inside chunk       */
+    uint32_t problems;    /* found by checker                    */
+    struct scan_order *order; /* NULL - warnings printed at once */
+    uint8_t part;         /* number of chunk, for 'order'        */
+    bool turn;            /* previous chunks printed, print too  */
+    size_t msgs_len;
+    char msgs[SCAN_MSGS_SIZE]; /* "\n"-terminated warnings      */
+  } scanner;
+
+/* format-specific part. checker's state embeds 'scanner' as *
+ * first member, see check_srt_file() for example            */
+typedef struct scan_ops
+  {
+    size_t size;                         /* of checker's state    */
+    struct unicode_test *charsets;       /* for unicode_check()   */
+    /* called for each line, without trailing "\n" or "\r\n" */
+    void (*line)(scanner * const, struct span * const);
+    /* called after the last line of chunk, may be NULL */
+    void (*done)(scanner * const);
+    /* where chunk, cut at 'p', really ends: chunk should start in *
+     * the same state, as input does. may be NULL - any line       */
+    char const *(*cut)(char const *p, char const *end);
+  } scan_ops;
+
+/** function prototypes */
+bool scan_input(context * const, FILE *, scan_ops const * const, void * const);
+uint32_t scan_line_num(scanner * const, uint32_t);
+void scan_warn(scanner * const, char const *, ...);
+
+#endif /* _SCAN_H */
@@ -0,0 +1,414 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+#include "arena.h"
+#include "outbuf.h"
+#include "reader.h"
+#include "ssa.h"
+#include "cache.h"
+#include "seekidx.h"
+
+#define MSG_S_NOTREGULAR _("Seek index can be made only for regular file.")
+#define MSG_S_MALFORMED  _("Seek index '%s' is malformed, ignored.")
+#define MSG_S_OUTDATED   _("Seek index '%s' is outdated, ignored.")
+
+/* positions of 'Start' & 'End' in event line, by 'Format:' line */
+static void
+seekidx_fields(context * const ctx, struct span const * const line,
+               uint8_t pos[2])
+  {
+    int8_t fieldlist[MAX_FIELDS + 1];
+    char *format = NULL;
+    uint8_t i = 0;
+
+    STRNDUP(format, line->ptr, line->len);
+    string_skip_chars(format, " ");
+    string_lowercase(format, 0);
+
+    detect_event_fields_order(ctx, format, fieldlist);
+    for (i = 0; i < MAX_FIELDS && fieldlist[i] != 0; i++)
+      if      (fieldlist[i] == EVENT_START) pos[0] = i;
+      else if (fieldlist[i] == EVENT_END)   pos[1] = i;
+
+    free(format);
+  }
+
+/* only timing of event, without parsing the rest of line */
+static bool
+seekidx_times(struct span const * const line, uint8_t const pos[2],
+              int32_t *start, int32_t *end)
+  {
+    struct span rest = { NULL, 0 }, tokens[MAX_FIELDS + 1];
+    subtime st = { 0, 0, 0, 0.0 };
+    char const *p = NULL;
+    size_t max = ((pos[0] > pos[1]) ? pos[0] : pos[1]) + 1;
+
+    if ((p = memchr(line->ptr, ':', line->len)) == NULL)
+      return false;
+
+    rest.ptr = p + 1, rest.len = line->ptr + line->len - rest.ptr;
+    if (span_split(&rest, ',', tokens, max + 1) < max)
+      return false;
+
+    if (!strn2subtime(tokens[pos[0]].ptr, tokens[pos[0]].len, &st))
+      return false;
+    *start = subtime2cs(&st);
+
+    if (!strn2subtime(tokens[pos[1]].ptr, tokens[pos[1]].len, &st))
+      return false;
+    *end = subtime2cs(&st);
+
+    return true;
+  }
+
+/* takes identity of indexed file from it's stat() */
+static void
+seekidx_stamp_of(seekidx_stamp * const st, struct stat const * const sb)
+  {
+    st->ino     = sb->st_ino;
+    st->mtime_s = sb->st_mtim.tv_sec, st->mtime_ns = sb->st_mtim.tv_nsec;
+    st->ctime_s = sb->st_ctim.tv_sec, st->ctime_ns = sb->st_ctim.tv_nsec;
+  }
+
+/* Scans 'infile' once and fills 'idx': byte range of first *
+ * [Events] section and block of every SEEKIDX_STEP lines   *
+ * there, with bounds of their events timing. lines are     *
+ * not parsed further, than their 'Start' & 'End' fields.   */
+bool
+seekidx_build(context * const ctx, FILE *infile, seekidx * const idx)
+  {
+    reader in;
+    struct stat sb;
+    struct span line = { NULL, 0 };
+    ssa_section section = NONE;
+    seekidx_block *b = NULL;
+    uint8_t pos[2] = { 1, 2 }; /* 'Start' & 'End' of both v4 & v4+ */
+    int32_t start = 0, end = 0;
+    size_t offset = 0, lines = 0, size = 0;
+    bool inside = false;
+
+    if (!infile || !idx)
+      return false;
+
+    memset(idx, 0, sizeof(seekidx));
+
+    if (fstat(fileno(infile), &sb) != 0 || !S_ISREG(sb.st_mode))
+      {
+        log_msg(ctx, warn, MSG_S_NOTREGULAR);
+        return false;
+      }
+
+    if (!reader_open(&in, ctx, infile))
+      return false;
+
+    if (cache_detect(&in))
+      {
+        log_msg(ctx, warn, _("Seek index is not needed for compiled file."));
+        reader_close(&in);
+        return false;
+      }
+
+    idx->size  = in.size;
+    seekidx_stamp_of(&idx->stamp, &sb);
+
+    while (reader_next_line(&in, &line))
+      {
+        offset = line.ptr - in.data;
+        span_trim(&line, LINE_START | LINE_END);
+
+        if (line.len == 0)
+          continue;
+
+        /* the same check, as in parse_ssa_file(): uue lines *
+         * may start with '[', section names can't be uue    */
+        if (line.len != 80 && line.ptr[0] == '[' &&
+            (!(section == FONTS || section == GRAPHICS) || !ssa_media_chars(&line)))
+          ssa_section_switch(ctx, &section, &line);
+
+        if (!inside && section == EVENTS && idx->ev_to == 0)
+          {
+            inside = true;
+            continue;
+          }
+
+        if (inside && section != EVENTS)
+          {
+            if (idx->ev_from == 0)
+              idx->ev_from = offset;
+            idx->ev_to = offset;
+            inside = false;
+          }
+
+        if (!inside)
+          continue;
+
+        if (idx->ev_from == 0)
+          {
+            if (*line.ptr == 'F' || *line.ptr == 'f')
+              {
+                seekidx_fields(ctx, &line, pos);
+                continue;
+              }
+            idx->ev_from = offset;
+          }
+
+        if (lines++ % SEEKIDX_STEP == 0)
+          {
+            if (idx->count == size)
+              {
+                size = (size == 0) ? 256 : size * 2;
+                if ((b = realloc(idx->blocks, size * sizeof(seekidx_block))) == NULL)
+                  log_msg(NULL, error, MSG_M_OOM, __FILE__, __LINE__);
+                idx->blocks = b;
+              }
+            b = &idx->blocks[idx->count++];
+            b->offset = offset;
+            b->start = INT32_MAX, b->end = INT32_MIN;
+          }
+
+        if (!seekidx_times(&line, pos, &start, &end))
+          continue; /* parser will complain about it later */
+
+        if (start < b->start) b->start = start;
+        if (end   > b->end)   b->end   = end;
+      }
+
+    if (idx->ev_from == 0) /* no events at all */
+      idx->ev_from = in.size;
+    if (idx->ev_to == 0)   /* ...or they last till the end */
+      idx->ev_to = in.size;
+
+    reader_close(&in);
+
+    return true;
+  }
+
+/* Writes index to file 'name'. format is plain text: *
+ * magic, "file <size> <inode> <mtime> <ctime>" (times *
+ * as "<s>.<ns>"), "events <from> <to> <count>", then  *
+ * "<offset> <start> <end>" per block                  */
+bool
+seekidx_write(context * const ctx, char const *name, seekidx const * const idx)
+  {
+    FILE *f = NULL;
+    seekidx_block const *b = NULL;
+    size_t i = 0;
+
+    if ((f = fopen(name, "w")) == NULL)
+      {
+        log_msg(ctx, warn, MSG_F_OWRFAIL, name);
+        return false;
+      }
+
+    fprintf(f, "%s\n", SEEKIDX_MAGIC);
+    fprintf(f, "file %lu %llu %lld.%09lld %lld.%09lld\n", (unsigned long) idx->size,
+            (unsigned long long) idx->stamp.ino,
+            (long long) idx->stamp.mtime_s, (long long) idx->stamp.mtime_ns,
+            (long long) idx->stamp.ctime_s, (long long) idx->stamp.ctime_ns);
+    fprintf(f, "events %lu %lu %lu\n", (unsigned long) idx->ev_from,
+            (unsigned long) idx->ev_to, (unsigned long) idx->count);
+
+    for (i = 0, b = idx->blocks; i < idx->count; i++, b++)
+      fprintf(f, "%lu %ld %ld\n", (unsigned long) b->offset, (long) b->start, (long) b->end);
+
+    if (ferror(f) | fclose(f))
+      {
+        log_msg(ctx, warn, MSG_F_WRFAIL);
+        unlink(name);
+        return false;
+      }
+
+    return true;
+  }
+
+/* reads "<offset> <start> <end>" lines of index to 'idx' */
+static bool
+seekidx_read_blocks(FILE *f, seekidx * const idx, size_t count)
+  {
+    seekidx_block *b = NULL;
+    unsigned long offset = 0;
+    long start = 0, end = 0;
+
+    if (count > 0)
+      CALLOC(idx->blocks, count, sizeof(seekidx_block));
+
+    for (b = idx->blocks; idx->count < count; idx->count++, b++)
+      {
+        if (fscanf(f, "%lu %ld %ld\n", &offset, &start, &end) != 3)
+          return false;
+        /* blocks should go in order inside of section */
+        if (offset < idx->ev_from || offset >= idx->ev_to ||
+            (idx->count > 0 && offset <= b[-1].offset))
+          return false;
+        b->offset = offset, b->start = start, b->end = end;
+      }
+
+    return true;
+  }
+
+/* Reads index from file 'name' and checks it against 'infile'. *
+ * returns false, if index missing, damaged or made for another *
+ * version of file, 'idx' is left empty then                    */
+bool
+seekidx_read(context * const ctx, char const *name, FILE *infile,
+             seekidx * const idx)
+  {
+    FILE *f = NULL;
+    struct stat sb;
+    char line[MAXLINE] = "";
+    unsigned long size = 0, from = 0, to = 0, count = 0;
+    unsigned long long ino = 0;
+    long long t[4] = { 0, 0, 0, 0 };
+    seekidx_stamp now;
+    bool result = false, stale = false;
+
+    memset(idx, 0, sizeof(seekidx));
+
+    if ((f = fopen(name, "r")) == NULL)
+      return false;
+
+    result = fgets(line, MAXLINE, f) != NULL &&
+             strncmp(line, SEEKIDX_MAGIC, strlen(SEEKIDX_MAGIC)) == 0 &&
+             fscanf(f, "file %lu %llu %lld.%lld %lld.%lld\n", &size, &ino,
+                    &t[0], &t[1], &t[2], &t[3]) == 6 &&
+             fscanf(f, "events %lu %lu %lu\n", &from, &to, &count) == 3;
+
+    /* file was changed since index was made? */
+    memset(&now, 0, sizeof(seekidx_stamp));
+    if (result && (stale = (fstat(fileno(infile), &sb) != 0)) == false)
+      {
+        seekidx_stamp_of(&now, &sb);
+        stale = (unsigned long) sb.st_size != size || now.ino != ino ||
+                now.mtime_s != t[0] || now.mtime_ns != t[1] ||
+                now.ctime_s != t[2] || now.ctime_ns != t[3];
+      }
+    if (stale)
+      {
+        log_msg(ctx, warn, MSG_S_OUTDATED, name);
+        fclose(f);
+        return false;
+      }
+
+    if (result && from <= to && to <= size && count <= size)
+      {
+        idx->size = size, idx->stamp = now;
+        idx->ev_from = from, idx->ev_to = to;
+        result = seekidx_read_blocks(f, idx, count);
+      }
+    else
+      result = false;
+
+    fclose(f);
+
+    if (!result)
+      {
+        log_msg(ctx, warn, MSG_S_MALFORMED, name);
+        seekidx_free(idx);
+      }
+
+    return result;
+  }
+
+/* copies bytes [from, to) of 'fd' to 'out' */
+static bool
+seekidx_copy(context * const ctx, int fd, FILE *out, size_t from, size_t to,
+             char * const buf)
+  {
+    size_t len = 0;
+    ssize_t got = 0;
+
+    while (from < to)
+      {
+        len = (to - from < READER_BLOCK_SIZE) ? to - from : READER_BLOCK_SIZE;
+        if ((got = pread(fd, buf, len, from)) <= 0)
+          {
+            if (got < 0 && errno == EINTR)
+              continue;
+            log_msg(ctx, warn, MSG_F_RDFAIL,
+                    (got < 0) ? strerror(errno) : _("file truncated"));
+            return false;
+          }
+        if (fwrite(buf, sizeof(char), got, out) != (size_t) got)
+          {
+            log_msg(ctx, warn, MSG_F_WRFAIL);
+            return false;
+          }
+        from += got;
+      }
+
+    return true;
+  }
+
+/* Makes temporary file from header, tail and only those blocks *
+ * of 'infile' events, that may have events overlapping period  *
+ * [from, to). result is usual ssa file, ready for parsing and  *
+ * rewinded. returns NULL on read/write errors                  */
+FILE *
+seekidx_extract(context * const ctx, FILE *infile, seekidx const * const idx,
+                int32_t from, int32_t to)
+  {
+    FILE *out = NULL;
+    seekidx_block const *b = idx->blocks;
+    char *buf = NULL;
+    size_t i = 0, a = 0, z = 0, taken = 0;
+    int fd = fileno(infile);
+    bool ok = true;
+
+    TMPFILE(ctx, out);
+    CALLOC(buf, READER_BLOCK_SIZE, sizeof(char));
+
+    ok = seekidx_copy(ctx, fd, out, 0, idx->ev_from, buf);
+
+    /* adjacent blocks are copied at once */
+    for (i = 0; ok && i < idx->count; i++)
+      {
+        if (b[i].start >= to || b[i].end <= from)
+          continue;
+
+        a = b[i].offset;
+        while (i + 1 < idx->count && b[i + 1].start < to && b[i + 1].end > from)
+          i++;
+
+        z = (i + 1 < idx->count) ? b[i + 1].offset : idx->ev_to;
+        ok = seekidx_copy(ctx, fd, out, a, z, buf);
+        taken += z - a;
+      }
+
+    ok = ok && seekidx_copy(ctx, fd, out, idx->ev_to, idx->size, buf);
+
+    free(buf);
+
+    if (!ok)
+      {
+        fclose(out);
+        return NULL;
+      }
+
+    log_msg(ctx, debug, _("Seek index: %lu of %lu bytes of events taken."),
+            (unsigned long) taken, (unsigned long) (idx->ev_to - idx->ev_from));
+
+    rewind(out);
+
+    return out;
+  }
+
+void
+seekidx_free(seekidx * const idx)
+  {
+    free(idx->blocks);
+    memset(idx, 0, sizeof(seekidx));
+  }
@@ -0,0 +1,67 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef _SEEKIDX_H
+#define _SEEKIDX_H
+
+#define SEEKIDX_EXT     ".idx"
+#define SEEKIDX_MAGIC   "# ssa-utils seek index v2"
+#define SEEKIDX_STEP    1024 /* lines of [Events] per block */
+
+/* SEEKIDX_STEP lines of [Events] section, starting at  *
+ * 'offset'. block ends, where next one starts. empty   *
+ * block (no valid events) has start > end              */
+typedef struct seekidx_block
+  {
+    size_t offset;
+    int32_t start; /* min start time of events in block, cs */
+    int32_t end;   /* max end time of events in block, cs   */
+  } seekidx_block;
+
+/* identity of indexed file. in-place rewrite may keep size *
+ * & even mtime, but not ctime, which is taken in ns         */
+typedef struct seekidx_stamp
+  {
+    uint64_t ino;
+    int64_t mtime_s;
+    int64_t mtime_ns;
+    int64_t ctime_s;
+    int64_t ctime_ns;
+  } seekidx_stamp;
+
+/* Sidecar index of ssa file. [Events] lines are in    *
+ * [ev_from, ev_to), everything before them (including *
+ * section's 'Format:' line) is header, after - tail.  *
+ * 'size' & 'stamp' are of indexed file, for checks.   */
+typedef struct seekidx
+  {
+    size_t size;
+    seekidx_stamp stamp;
+    size_t ev_from;
+    size_t ev_to;
+    seekidx_block *blocks;
+    size_t count;
+  } seekidx;
+
+/** function prototypes */
+bool seekidx_build(context * const, FILE *, seekidx * const);
+bool seekidx_write(context * const, char const *, seekidx const * const);
+bool seekidx_read(context * const, char const *, FILE *, seekidx * const);
+FILE *seekidx_extract(context * const, FILE *, seekidx const * const,
+                      int32_t, int32_t);
+void seekidx_free(seekidx * const);
+
+#endif /* _SEEKIDX_H */
@@ -0,0 +1,225 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+#include "sort.h"
+
+/* one piece of work for sorting thread */
+struct sort_job
+  {
+    sort_item *items; /* items to sort      */
+    sort_item *tmp;   /* temp space of same size */
+    size_t n;
+    size_t mid;       /* start of second run     */
+    bool merge;       /* sort or merge two runs? */
+  };
+
+/* merges two sorted runs [0, mid) & [mid, n) from 'src' to 'dst'. *
+ * on equal keys left one goes first, this keeps sort stable       */
+static void
+sort_merge(sort_item const *src, sort_item *dst, size_t mid, size_t n)
+  {
+    size_t l = 0, r = mid, i = 0;
+
+    while (l < mid && r < n)
+      dst[i++] = (src[r].key < src[l].key) ? src[r++] : src[l++];
+
+    while (l < mid) dst[i++] = src[l++];
+    while (r < n)   dst[i++] = src[r++];
+  }
+
+/* bottom-up merge sort. result always ends up in 'items' */
+static void
+sort_run(sort_item *items, sort_item *tmp, size_t n)
+  {
+    sort_item *src = items, *dst = tmp, *t = NULL;
+    size_t width = 0, i = 0, mid = 0, len = 0;
+
+    for (width = 1; width < n; width *= 2)
+      {
+        for (i = 0; i < n; i += 2 * width)
+          {
+            len = (n - i < 2 * width) ? n - i : 2 * width;
+            mid = (width < len) ? width : len;
+            sort_merge(src + i, dst + i, mid, len);
+          }
+        t = src, src = dst, dst = t;
+      }
+
+    if (src != items)
+      memcpy(items, src, sizeof(sort_item) * n);
+  }
+
+static void *
+sort_thread(void *arg)
+  {
+    struct sort_job *job = arg;
+
+    if (!job->merge)
+      sort_run(job->items, job->tmp, job->n);
+    else
+      {
+        sort_merge(job->items, job->tmp, job->mid, job->n);
+        memcpy(job->items, job->tmp, sizeof(sort_item) * job->n);
+      }
+
+    return NULL;
+  }
+
+/* how many threads is worth to use for 'n' items */
+uint8_t
+sort_threads(size_t n)
+  {
+    return (n < SORT_MT_THRESHOLD) ? 1 : cpu_threads(SORT_THREADS_MAX);
+  }
+
+/* runs jobs in separate threads and waits for all of them */
+static void
+sort_jobs_run(struct sort_job *jobs, uint8_t count)
+  {
+    pthread_t threads[SORT_THREADS_MAX];
+    bool started[SORT_THREADS_MAX];
+    uint8_t i = 0;
+
+    for (i = 0; i < count; i++)
+      {
+        started[i] = (pthread_create(&threads[i], NULL, sort_thread, &jobs[i]) == 0);
+        if (!started[i]) /* no more threads? do it by self */
+          sort_thread(&jobs[i]);
+      }
+
+    for (i = 0; i < count; i++)
+      if (started[i])
+        pthread_join(threads[i], NULL);
+  }
+
+/* splits array in 'parts', sorts them in parallel, then merges *
+ * neighbour parts pairwise, also in parallel, until one left   */
+static void
+sort_parallel(sort_item *items, sort_item *tmp, size_t n, uint8_t parts)
+  {
+    struct sort_job jobs[SORT_THREADS_MAX];
+    struct sort_job merges[SORT_THREADS_MAX];
+    uint8_t i = 0, j = 0;
+
+    for (i = 0; i < parts; i++)
+      {
+        jobs[i].items = items + n * i / parts;
+        jobs[i].tmp   = tmp   + n * i / parts;
+        jobs[i].n     = n * (i + 1) / parts - n * i / parts;
+        jobs[i].mid   = 0;
+        jobs[i].merge = false;
+      }
+
+    sort_jobs_run(jobs, parts);
+
+    while (parts > 1)
+      {
+        for (i = 0, j = 0; i + 1 < parts; i += 2, j++)
+          {
+            merges[j] = jobs[i];
+            merges[j].mid = jobs[i].n;
+            merges[j].n   = jobs[i].n + jobs[i + 1].n;
+            merges[j].merge = true;
+          }
+
+        sort_jobs_run(merges, j);
+
+        if (i < parts) /* odd part, already in place, simply carry over */
+          merges[j++] = jobs[i];
+
+        memcpy(jobs, merges, sizeof(struct sort_job) * j);
+        parts = j;
+      }
+  }
+
+/* Sorts list by key, given by 'key' function. Sort is stable: *
+ * events with equal keys stays in order, they was in input.   *
+ * already sorted list detected in one pass and not touched.   */
+bool
+events_sort(void **head, sort_key_f key)
+  {
+    list_item *l = NULL;
+    list_item **tail = NULL;
+    sort_item *items = NULL;
+    sort_item *tmp = NULL;
+    bool sorted = true;
+    double prev = 0.0, k = 0.0;
+    size_t n = 0, i = 0;
+    uint8_t threads = 1;
+
+    if (!head || !key)
+      return false;
+
+    for (l = *head; l != NULL; l = l->next, n++)
+      {
+        k = key(l);
+        if (n > 0 && k < prev)
+          sorted = false;
+        prev = k;
+      }
+
+    if (sorted)
+      return true;
+
+    CALLOC(items, n, sizeof(sort_item));
+    CALLOC(tmp,   n, sizeof(sort_item));
+
+    for (l = *head, i = 0; l != NULL; l = l->next, i++)
+      items[i].key = key(l), items[i].item = l;
+
+    if ((threads = sort_threads(n)) > 1)
+      sort_parallel(items, tmp, n, threads);
+    else
+      sort_run(items, tmp, n);
+
+    /* relink list in new order */
+    for (i = 0, tail = (list_item **) head; i < n; i++)
+      *tail = items[i].item, tail = &items[i].item->next;
+    *tail = NULL;
+
+    free(items);
+    free(tmp);
+
+    return true;
+  }
+
+/* Merges sorted list 'b' into sorted list 'a'. Also stable:  *
+ * on equal keys items from 'a' goes first. 'b' is consumed. */
+bool
+events_merge(void **a, void *b, sort_key_f key)
+  {
+    list_item *l = NULL, *r = b;
+    list_item **tail = (list_item **) a;
+
+    if (!a || !key)
+      return false;
+
+    l = *a;
+
+    while (l != NULL && r != NULL)
+      {
+        if (key(r) < key(l))
+          *tail = r, r = r->next;
+        else
+          *tail = l, l = l->next;
+        tail = &(*tail)->next;
+      }
+
+    *tail = (l != NULL) ? l : r;
+
+    return true;
+  }
@@ -0,0 +1,45 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef _SORT_H
+#define _SORT_H
+
+/* lists shorter than this always sorted in one thread */
+#define SORT_MT_THRESHOLD (64 * 1024)
+#define SORT_THREADS_MAX  8
+
+/* any events list: ssa_event, srt_event, microsub_event. *
+ * all of them have pointer to next item as first member  */
+typedef struct list_item
+  {
+    struct list_item *next;
+  } list_item;
+
+/* returns sort key (start time) of list item */
+typedef double (*sort_key_f)(void const *);
+
+typedef struct sort_item
+  {
+    double key;
+    list_item *item;
+  } sort_item;
+
+/** function prototypes */
+bool events_sort(void **, sort_key_f);
+bool events_merge(void **, void *, sort_key_f);
+uint8_t sort_threads(size_t);
+
+#endif /* _SORT_H */
@@ -16,11 +16,10 @@
 
 #include "common.h"
 #include "srt.h"
+#include "sort.h"
+#include "scan.h"
 
-extern struct options opts;
-extern unsigned long int line_num;
-
-enum { unknown, id, timing, text, blank } prev_line, curr_line;
+enum srt_line { unknown, id, timing, text, blank };
 
 /*
  Standart behaviour:
@@ -29,7 +28,7 @@ enum { unknown, id, timing, text, blank } prev_line, curr_line;
    if missing text - skip event, empty event also useless.
  */
 bool
-parse_srt_file(FILE *infile, srt_file * const file)
+parse_srt_file(context * const ctx, FILE *infile, srt_file * const file)
   {
     char line[MAXLINE] = "";
     char text_buf[MAXLINE] = "";
@@ -39,25 +38,33 @@ parse_srt_file(FILE *infile, srt_file * const file)
     uint8_t t_detect = 3; /* number of first timing strings to analyze */
     srt_event *event = (srt_event *) 0;
     srt_event **elist_tail = &file->events;
+    enum srt_line prev_line = unknown, curr_line = unknown;
+    jmp_buf env, *outer = ctx->abort;
 
     if (!infile) return false;
 
-    curr_line = unknown;
+    /* events, parsed before error, stays in file */
+    if (setjmp(env) != 0)
+      {
+        ctx->abort = outer;
+        return false;
+      }
+    ctx->abort = &env;
 
     while(!feof(infile))
       {
         fgets(line, MAXLINE, infile);
-        line_num++;
+        ctx->line_num++;
 
         /* unicode handle */
-        if (line_num == 1)
-          charset_type = unicode_check(line, 0);
+        if (ctx->line_num == 1)
+          ctx->charset = unicode_check(ctx, line, 0);
 
         prev_line = curr_line;
         curr_line = unknown;
 
         trim_newline(line);
-        log_msg(raw, "%s", line);
+        log_msg(ctx, raw, "%s", line);
         trim_spaces(line, LINE_START | LINE_END);
         s_len = strlen(line);
 
@@ -72,14 +79,14 @@ parse_srt_file(FILE *infile, srt_file * const file)
 
         if (feof(infile) && s_len != 0)
           {
-            log_msg(warn, MSG_F_UNEXPEOF, line_num);
+            log_msg(ctx, warn, MSG_F_UNEXPEOF, ctx->line_num);
             if (prev_line == text)
-              append_string(text_buf, line, "\n", MAXLINE, 0);
+              append_string(ctx, text_buf, line, "\n", MAXLINE, 0);
             else
               strncpy(text_buf, line, MAXLINE);
           }
 
-        log_msg(debug, "Line type: %i", curr_line);
+        log_msg(ctx, debug, "Line type: %i", curr_line);
 
         if (curr_line == id || (curr_line == timing && prev_line == blank))
           {
@@ -88,20 +95,20 @@ parse_srt_file(FILE *infile, srt_file * const file)
 
             if (curr_line != id)
               {
-                log_msg(warn, _("Missing subtitle id at line '%u'."), line_num);
+                log_msg(ctx, warn, _("Missing subtitle id at line '%u'."), ctx->line_num);
                 event->id = ++parsed;
               }
           }
 
         if (prev_line == timing && curr_line == blank)
           {
-            log_msg(warn, _("Empty subtitle text at line %u. Event will be skipped."), line_num);
+            log_msg(ctx, warn, _("Empty subtitle text at line %u. Event will be skipped."), ctx->line_num);
             skip_event = true;
           }
 
         if (prev_line == id && curr_line == blank)
           {
-            log_msg(warn, _("Lonely subtitle id without timing or text. :-("));
+            log_msg(ctx, warn, _("Lonely subtitle id without timing or text. :-("));
             skip_event = true;
           }
 
@@ -115,10 +122,10 @@ parse_srt_file(FILE *infile, srt_file * const file)
             case timing :
               if (t_detect-- && !(file->flags & SRT_E_STRICT))
                 analyze_srt_timing(line, &file->flags);
-              skip_event = !parse_srt_timing(event, line, &file->flags);
+              skip_event = !parse_srt_timing(ctx, event, line, &file->flags);
               if (event->start > event->end)
                 {
-                  log_msg(warn, _("Negative duration of event at line '%u'. Event will be skipped."), line_num);
+                  log_msg(ctx, warn, _("Negative duration of event at line '%u'. Event will be skipped."), ctx->line_num);
                   skip_event = true;
                 }
               /*printf("%f --> %f\n", event->start, event->end);*/
@@ -126,7 +133,7 @@ parse_srt_file(FILE *infile, srt_file * const file)
             case text :
               /* TODO: wrapping handling here   */
               if (prev_line == text)
-                append_string(text_buf, line, "\n", MAXLINE, 0);
+                append_string(ctx, text_buf, line, "\n", MAXLINE, 0);
               else
                 strncpy(text_buf, line, MAXLINE);
               break;
@@ -134,8 +141,8 @@ parse_srt_file(FILE *infile, srt_file * const file)
               if (!skip_event && prev_line != blank)
                 {
                   if ((event->text = strndup(text_buf, MAXLINE)) == NULL)
-                    log_msg(error, MSG_M_OOM);
-                  srt_event_append(&file->events, &elist_tail, event, opts.i_sort);
+                    log_msg(NULL, error, MSG_M_OOM);
+                  srt_event_append(&file->events, &elist_tail, event);
                   memset(text_buf, 0, MAXLINE);
                 }
             case unknown :
@@ -153,6 +160,11 @@ parse_srt_file(FILE *infile, srt_file * const file)
           }
      }
 
+    if (ctx->opts.i_sort)
+      events_sort((void **) &file->events, srt_event_start);
+
+    ctx->abort = outer;
+
     return true; /* if we reach this line, no error happens */
   }
 
@@ -175,7 +187,7 @@ analyze_srt_timing(char *s, uint8_t * const flags)
   }
 
 bool
-parse_srt_timing(srt_event *e, char *s, const uint8_t *flags)
+parse_srt_timing(context * const ctx, srt_event *e, char *s, const uint8_t *flags)
   {
     char token[MAXLINE];
     uint16_t i = 0;
@@ -194,7 +206,7 @@ parse_srt_timing(srt_event *e, char *s, const uint8_t *flags)
 
     if (!get_srt_timing(&e->start, token))
       {
-        log_msg(warn, w_token, "start", token, line_num);
+        log_msg(ctx, warn, w_token, "start", token, ctx->line_num);
         return false;
       }
 
@@ -207,7 +219,7 @@ parse_srt_timing(srt_event *e, char *s, const uint8_t *flags)
 
     if (!get_srt_timing(&e->end, token))
       {
-        log_msg(warn, w_token, "end", token, line_num);
+        log_msg(ctx, warn, w_token, "end", token, ctx->line_num);
         return false;
       }
 
@@ -236,7 +248,7 @@ parse_srt_timing(srt_event *e, char *s, const uint8_t *flags)
         {
           delim = ",";
           /* TODO: make it "implemented" */
-          log_msg(error, MSG_W_UNIMPL);
+          log_msg(ctx, error, MSG_W_UNIMPL);
         }
     }
 
@@ -290,21 +302,348 @@ write_srt_event(FILE *outfile, srt_event *event)
 }
 
 void
-srt_event_append(srt_event **head, srt_event ***tail,
-                 srt_event * const e, bool sort)
+srt_event_append(srt_event **head, srt_event ***tail, srt_event * const e)
   {
-    srt_event *t = NULL;
-
     if (*head == NULL)
       *head = e;
-    else if (**tail != NULL && (!sort || e->start > (**tail)->start))
+    else
       (**tail)->next = e, *tail = &(**tail)->next;
-    else /* *tail == NULL || (tail != NULL && e->start <= (*tail)->start) */
-      for (t = *head; t != NULL && t->next != NULL; t = t->next)
-        if (t->next->start > e->start)
+  }
+
+double
+srt_event_start(void const *e)
+  {
+    return ((srt_event const *) e)->start;
+  }
+
+/** validation */
+
+/* opened tags, tracked by checker. deeper ones are ignored */
+#define SRT_CHECK_TAGS 16
+
+/* state of srt checker, one per chunk of input */
+struct srt_check
+  {
+    scanner scan;          /* should be the first member */
+    uint8_t flags;         /* SRT_E_STRICT only          */
+    enum srt_line prev;
+    uint32_t event_line;   /* timing line of current event, in chunk */
+    uint8_t depth;         /* of opened tags in current event */
+    char tags[SRT_CHECK_TAGS];
+  };
+
+static char const *
+srt_check_arrow(struct span const * const line)
+  {
+    char const *p = line->ptr, *end = line->ptr + line->len;
+
+    for (; end - p >= 3 && (p = memchr(p, '-', end - p - 2)) != NULL; p++)
+      if (p[1] == '-' && p[2] == '>')
+        return p;
+
+    return NULL;
+  }
+
+/* the same as get_srt_timing(), but for span */
+static bool
+srt_check_time(double *d, struct span const * const token)
+  {
+    char buf[64];
+
+    if (token->len == 0 || token->len >= sizeof(buf))
+      return false;
+
+    memcpy(buf, token->ptr, token->len);
+    buf[token->len] = '\0';
+
+    return get_srt_timing(d, buf);
+  }
+
+/* "X1:[px] X2:[px] Y1:[px] Y2:[px]", in any order */
+static void
+srt_check_position(struct srt_check * const c, struct span const * const ext)
+  {
+    scanner *s = &c->scan;
+    char const *p = ext->ptr, *end = ext->ptr + ext->len;
+    struct span f = { NULL, 0 };
+    uint8_t seen = 0, bit = 0;
+    size_t i = 0;
+
+    while (p < end)
+      {
+        for (f.ptr = p; p < end && !isspace(*p); p++);
+        f.len = p - f.ptr;
+        for (; p < end && isspace(*p); p++);
+
+        bit = (f.len > 3 && f.ptr[2] == ':' && (f.ptr[1] == '1' || f.ptr[1] == '2'))
+              ? (f.ptr[1] - '1') : 0xFF;
+        if      (bit != 0xFF && tolower(f.ptr[0]) == 'x') bit = 1 << bit;
+        else if (bit != 0xFF && tolower(f.ptr[0]) == 'y') bit = 1 << (bit + 2);
+        else bit = 0;
+
+        for (i = 3; bit != 0 && i < f.len; i++)
+          if (!isdigit(f.ptr[i]))
+            bit = 0;
+
+        if (bit == 0 || (seen & bit))
+          scan_warn(s, _("Malformed position field '%.*s' at line %u."),
+                    (int) f.len, f.ptr, scan_line_num(s, s->line_num));
+        seen |= bit;
+      }
+
+    if (seen != 0x0F)
+      scan_warn(s, _("Incomplete position at line %u: X1, X2, Y1 and Y2 expected."),
+                scan_line_num(s, s->line_num));
+  }
+
+static void
+srt_check_timing(struct srt_check * const c, struct span const * const line,
+                 char const *arrow)
+  {
+    scanner *s = &c->scan;
+    char *w_token = _("Can't get %s timing from this token: '%.*s' at line '%u'.");
+    char buf[MAXLINE + 1];
+    char const *p = NULL;
+    struct span start = { line->ptr, arrow - line->ptr };
+    struct span end   = { arrow + 3, line->len - (arrow + 3 - line->ptr) };
+    struct span ext   = { NULL, 0 };
+    double t_start = 0.0, t_end = 0.0;
+    uint8_t flags = 0;
+
+    span_trim(&start, LINE_START | LINE_END);
+    span_trim(&end, LINE_START);
+
+    /* end time ends at first space, extensions follows it */
+    if ((p = memchr(end.ptr, ' ', end.len)) != NULL)
+      {
+        ext.ptr = p, ext.len = end.len - (p - end.ptr);
+        end.len = p - end.ptr;
+        span_trim(&ext, LINE_START | LINE_END);
+      }
+
+    if (!srt_check_time(&t_start, &start))
+      {
+        scan_warn(s, w_token, "start", (int) start.len, start.ptr,
+                  scan_line_num(s, s->line_num));
+        return;
+      }
+
+    if (!srt_check_time(&t_end, &end))
+      {
+        scan_warn(s, w_token, "end", (int) end.len, end.ptr,
+                  scan_line_num(s, s->line_num));
+        return;
+      }
+
+    if (t_start > t_end)
+      scan_warn(s, _("Negative duration of event at line '%u'. Event will be skipped."),
+                scan_line_num(s, s->line_num));
+
+    if (ext.len == 0 || (c->flags & SRT_E_STRICT))
+      return;
+
+    if (ext.len > MAXLINE)
+      ext.len = MAXLINE;
+    memcpy(buf, ext.ptr, ext.len);
+    buf[ext.len] = '\0';
+    analyze_srt_timing(buf, &flags);
+
+    /* incomplete position is not detected by analyze_srt_timing() */
+    if      ((flags & SRT_E_HAVE_POSITION) ||
+             (ext.len > 2 && ext.ptr[2] == ':' && tolower(ext.ptr[0]) >= 'x'))
+      srt_check_position(c, &ext);
+    else if (flags & SRT_E_HAVE_STYLE)
+      scan_warn(s, _("Unsupported style extension at line %u."),
+                scan_line_num(s, s->line_num));
+  }
+
+/* the same stack rules, as in srt2ssa, but only for known tags */
+static void
+srt_check_tags(struct srt_check * const c, struct span const * const line)
+  {
+    scanner *s = &c->scan;
+    char const *p = line->ptr, *end = line->ptr + line->len;
+    char const *gt = NULL, *lt = NULL;
+    struct span name = { NULL, 0 };
+    bool closing = false;
+    char chr = '\0', top = '\0';
+
+    while ((p = memchr(p, '<', end - p)) != NULL)
+      {
+        if ((gt = memchr(p, '>', end - p)) == NULL)
+          {
+            scan_warn(s, _("Unclosed tag at line %u: %.*s"),
+                      scan_line_num(s, s->line_num), (int) (end - p), p);
+            return;
+          }
+
+        /* "a < b <i>": all before last '<' is a text */
+        if ((lt = memchr(p + 1, '<', gt - p - 1)) != NULL)
+          {
+            p = lt;
+            continue;
+          }
+
+        name.ptr = p + 1;
+        if ((closing = (*name.ptr == '/')))
+          name.ptr++;
+        for (name.len = 0; name.ptr + name.len < gt &&
+             !isspace(name.ptr[name.len]) && name.ptr[name.len] != '/'; name.len++);
+        p = gt + 1;
+
+        if (!closing && gt[-1] == '/') /* standalone, like <br/> */
+          continue;
+
+        chr = (name.len == 1) ? toupper(*name.ptr) : '\0';
+        if (name.len == 4 && tolower(name.ptr[0]) == 'f' &&
+            tolower(name.ptr[1]) == 'o' && tolower(name.ptr[2]) == 'n' &&
+            tolower(name.ptr[3]) == 't')
+          chr = SRT_T_FONT;
+
+        switch (chr)
+          {
+            case SRT_T_BOLD      :
+            case SRT_T_ITALIC    :
+            case SRT_T_STRIKEOUT :
+            case SRT_T_UNDERLINE :
+            case SRT_T_FONT      :
+              break;
+            default :
+              scan_warn(s, _("Unrecognized tag <%.*s> at line %u."),
+                        (int) name.len, name.ptr, scan_line_num(s, s->line_num));
+              continue;
+              break;
+          }
+
+        top = (c->depth > 0 && c->depth <= SRT_CHECK_TAGS) ? c->tags[c->depth - 1] : '\0';
+
+        if (!closing)
           {
-            e->next = t->next, t->next = e;
-            break;
+            if (top == chr)
+              scan_warn(s, _("The same opening tag <%.*s> twice in row at line %u."),
+                        (int) name.len, name.ptr, scan_line_num(s, s->line_num));
+            if (c->depth < SRT_CHECK_TAGS)
+              c->tags[c->depth] = chr;
+            c->depth++;
           }
+        else if (top == chr)
+          c->depth--;
+        else /* note: stack remains unchanged */
+          scan_warn(s, _("Closing tag </%.*s> without opening one at line %u."),
+                    (int) name.len, name.ptr, scan_line_num(s, s->line_num));
+      }
+  }
+
+/* current line ends event, if any */
+static void
+srt_check_end(struct srt_check * const c)
+  {
+    scanner *s = &c->scan;
+
+    if (c->prev == timing)
+      scan_warn(s, _("Empty subtitle text at line %u. Event will be skipped."),
+                scan_line_num(s, s->line_num));
+
+    if (c->prev == id)
+      scan_warn(s, _("Lonely subtitle id without timing or text at line %u."),
+                scan_line_num(s, s->line_num));
+
+    if (c->prev == text && c->depth > 0)
+      scan_warn(s, _("Improperly opened/closed/deranged tag(s) in event at line %u."),
+                scan_line_num(s, c->event_line));
+
+    c->depth = 0;
+  }
+
+static void
+srt_check_line(scanner * const s, struct span * const line)
+  {
+    struct srt_check *c = (struct srt_check *) s;
+    enum srt_line curr = unknown;
+    char const *arrow = NULL;
+
+    span_trim(line, LINE_START | LINE_END);
+
+    if      (line->len == 0)                                curr = blank;
+    else if ((arrow = srt_check_arrow(line)) != NULL)      curr = timing;
+    else if (c->prev == blank || c->prev == unknown)        curr = id;
+    else                                                    curr = text;
+
+    switch (curr)
+      {
+        case blank :
+          srt_check_end(c);
+          break;
+        case timing :
+          if (c->prev == blank || c->prev == unknown)
+            scan_warn(s, _("Missing subtitle id at line '%u'."),
+                      scan_line_num(s, s->line_num));
+          else if (c->prev != id)
+            scan_warn(s, _("Timing in the middle of event at line %u."),
+                      scan_line_num(s, s->line_num));
+          c->event_line = s->line_num;
+          srt_check_timing(c, line, arrow);
+          break;
+        case text :
+          if (c->prev == id)
+            scan_warn(s, _("Missing timing in event at line %u."),
+                      scan_line_num(s, s->line_num));
+          srt_check_tags(c, line);
+          break;
+        case id :
+        case unknown :
+        default :
+          break;
+      }
+
+    c->prev = curr;
+  }
+
+static void
+srt_check_done(scanner * const s)
+  {
+    srt_check_end((struct srt_check *) s);
+  }
+
+/* chunk should start right after blank line, like input does */
+static char const *
+srt_check_cut(char const *p, char const *end)
+  {
+    char const *q = NULL;
+
+    while ((p = memchr(p, '\n', end - p)) != NULL)
+      {
+        for (q = ++p; q < end && (*q == ' ' || *q == '\t' || *q == '\r'); q++);
+        if (q == end)
+          return end;
+        if (*q == '\n')
+          return q + 1;
+      }
+
+    return end;
+  }
+
+static scan_ops const srt_check_ops =
+  {
+    sizeof(struct srt_check),
+    NULL,
+    srt_check_line,
+    srt_check_done,
+    srt_check_cut
+  };
+
+/* Validation only: checks structure, timings, position fields  *
+ * and tags balance, the same way as parse_srt_file() and       *
+ * srt2ssa do, but without building events list and without     *
+ * any memory allocation. Returns false, if any problem found   */
+bool
+check_srt_file(context * const ctx, FILE *infile, uint8_t flags)
+  {
+    struct srt_check jobs[SCAN_THREADS_MAX];
+
+    memset(&jobs[0], 0, sizeof(struct srt_check));
+    jobs[0].flags = flags & SRT_E_STRICT;
+    jobs[0].prev  = unknown;
 
+    return scan_input(ctx, infile, &srt_check_ops, jobs);
   }
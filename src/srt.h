@@ -69,13 +69,14 @@ typedef struct srt_file
 #define SRT_T_FONT_COLOR  0x04
 
 /** function prototypes */
-bool parse_srt_file(FILE *, srt_file * const);
+bool parse_srt_file(context * const, FILE *, srt_file * const);
+bool check_srt_file(context * const, FILE *, uint8_t);
 bool analyze_srt_timing(char *, uint8_t * const);
-bool parse_srt_timing(srt_event *, char *, const uint8_t *);
+bool parse_srt_timing(context * const, srt_event *, char *, const uint8_t *);
 int  get_srt_event(FILE *, srt_event *);
 bool get_srt_timing(double *, char *h);
 bool write_srt_event(FILE *, srt_event *);
-void srt_event_append(srt_event **, srt_event ***,
-                      srt_event * const, bool);
+void srt_event_append(srt_event **, srt_event ***, srt_event * const);
+double srt_event_start(void const *);
 
 #endif /* _SRT_H */
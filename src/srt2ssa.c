@@ -17,12 +17,14 @@
 #include "common.h"
 
 #include "srt.h"
+#include "arena.h"
+#include "batch.h"
+#include "outbuf.h"
 #include "ssa.h"
 
 #define PROG_NAME "srt2ssa"
 
 /* import some usefull stuff */
-extern struct options opts;
 extern ssa_style ssa_style_template;
 extern ssa_event ssa_event_template;
 
@@ -43,15 +45,18 @@ void usage(int exit_code)
     usage_convert_output();
     fputc('\n', stderr);
 
+    usage_batch_opts();
+    fputc('\n', stderr);
+
     exit(exit_code);
  }
 
 /* this chunk of code calls at least twice, *
  * so i've made it as separate function     */
 void
-commit_tags_buffer(char *common_buf, char *tags_buf)
+commit_tags_buffer(context * const ctx, char *common_buf, char *tags_buf)
   {
-    append_string(common_buf, tags_buf, "{", MAXLINE, 0);
+    append_string(ctx, common_buf, tags_buf, "{", MAXLINE, 0);
     append_char(common_buf, '}', MAXLINE);
     memset(tags_buf, 0, MAXLINE);
   }
@@ -60,7 +65,7 @@ commit_tags_buffer(char *common_buf, char *tags_buf)
  * for example, if srt tag acts as borders for scope of some property, *
  * ssa - set this property untill next tag with the same name          */
 bool
-srt_tags_to_ssa(char *string, ssa_file *file)
+srt_tags_to_ssa(context * const ctx, char *string, ssa_file *file)
   {
     char *p;
     char *value;
@@ -78,7 +83,7 @@ srt_tags_to_ssa(char *string, ssa_file *file)
     if (!string || !file) return false;
 
     stack_init(stack);
-    for (p = string; (len = parse_html_tag(p, &ttag)) != 0; )
+    for (p = string; (len = parse_html_tag(ctx, p, &ttag)) != 0; )
       {
         if (len > 0) /* it's a tag! */
           {
@@ -91,7 +96,7 @@ srt_tags_to_ssa(char *string, ssa_file *file)
                     case SRT_T_UNDERLINE :
                       if (file->type == ssa_v4)
                         {
-                          log_msg(warn, MSG_W_NOTALLOWED, "Tag", ttag.data);
+                          log_msg(ctx, warn, MSG_W_NOTALLOWED, "Tag", ttag.data);
                           break;
                         }
                     /* break; */
@@ -103,7 +108,7 @@ srt_tags_to_ssa(char *string, ssa_file *file)
                                     MAXLINE);
                       break;
                     default  :
-                      log_msg(warn, MSG_W_UNRECTAG, ttag.data, string);
+                      log_msg(ctx, warn, MSG_W_UNRECTAG, ttag.data, string);
                       break;
                 } /* switch (chr) */
               }
@@ -111,20 +116,20 @@ srt_tags_to_ssa(char *string, ssa_file *file)
               {
                 if ((value = get_tag_param_by_name(&ttag, "size")) != NULL)
                   {
-                    append_string(tags_buf, value, "\\fs", MAXLINE, 0);
+                    append_string(ctx, tags_buf, value, "\\fs", MAXLINE, 0);
                     font_params &= SRT_T_FONT_SIZE;
                   }
 
                 if ((value = get_tag_param_by_name(&ttag, "face")) != NULL)
                   {
-                    append_string(tags_buf, value, "\\fn", MAXLINE, 0);
+                    append_string(ctx, tags_buf, value, "\\fn", MAXLINE, 0);
                     font_params &= SRT_T_FONT_FACE;
                   }
                 else
                 if ((value = get_tag_param_by_name(&ttag, "name")) != NULL)
                   {
-                    log_msg(warn, MSG_W_TAGNOTFACE);
-                    append_string(tags_buf, value, "\\fn", MAXLINE, 0);
+                    log_msg(ctx, warn, MSG_W_TAGNOTFACE);
+                    append_string(ctx, tags_buf, value, "\\fn", MAXLINE, 0);
                     font_params &= SRT_T_FONT_FACE;
                   }
 
@@ -136,7 +141,7 @@ srt_tags_to_ssa(char *string, ssa_file *file)
                     i = strlen(tags_buf);
                     i = (i < MAXLINE && i >= 0) ? i : MAXLINE;
                     snprintf((tags_buf + i), MAXLINE - i, "c&H%X&",
-                              parse_color(value));
+                              parse_color(ctx, value));
                     font_params &= SRT_T_FONT_COLOR;
                   }
                 chr = SRT_T_FONT;
@@ -148,7 +153,7 @@ srt_tags_to_ssa(char *string, ssa_file *file)
                 style = &ssa_style_template;
 
                 if (font_params & SRT_T_FONT_FACE)
-                  append_string(tags_buf, style->fontname, "\\fn", MAXLINE, 0);
+                  append_string(ctx, tags_buf, style->fontname, "\\fn", MAXLINE, 0);
 
                 if (font_params & SRT_T_FONT_COLOR)
                   {
@@ -162,7 +167,7 @@ srt_tags_to_ssa(char *string, ssa_file *file)
 
                 if (font_params & SRT_T_FONT_SIZE)
                   {
-                    append_string(tags_buf, "\\fs", "", MAXLINE, 0);
+                    append_string(ctx, tags_buf, "\\fs", "", MAXLINE, 0);
                     i = strlen(tags_buf);
                     snprintf((tags_buf + i), (MAXLINE - i),
                                "%.1f", style->fontsize);
@@ -175,7 +180,7 @@ srt_tags_to_ssa(char *string, ssa_file *file)
               {
                 /* as we don't know, how to handle this tag, *
                  * skip stack operations below               */
-                log_msg(warn, MSG_W_UNRECTAG, ttag.data, string);
+                log_msg(ctx, warn, MSG_W_UNRECTAG, ttag.data, string);
                 ttag.type = none; /* skip stack operations */
                 len =  -len; /* to handle as text in block below */
               }
@@ -185,17 +190,17 @@ srt_tags_to_ssa(char *string, ssa_file *file)
               {
                 case opening :
                   if (*top == chr)
-                    log_msg(warn, MSG_W_TAGTWICE, ttag.data, string);
+                    log_msg(ctx, warn, MSG_W_TAGTWICE, ttag.data, string);
                   stack_push(stack, &top, chr);
                   break;
                 case closing :
                   if (*top == chr)
                     stack_pop(stack, &top);
-                  else log_msg(warn, MSG_W_TAGUNCL, ttag.data, string);
+                  else log_msg(ctx, warn, MSG_W_TAGUNCL, ttag.data, string);
                   /* note: stack remains unchanged in second case! */
                   break;
                 case standalone :
-                  log_msg(info, MSG_W_TAGXMLSRT);
+                  log_msg(ctx, info, MSG_W_TAGXMLSRT);
                   /* break; */
                 case none :
                 default :
@@ -206,8 +211,8 @@ srt_tags_to_ssa(char *string, ssa_file *file)
 
         if (len < 0)
           {
-            commit_tags_buffer(common_buf, tags_buf);
-            append_string(common_buf, p, "", MAXLINE, -len);
+            commit_tags_buffer(ctx, common_buf, tags_buf);
+            append_string(ctx, common_buf, p, "", MAXLINE, -len);
           }
 
         p += (len > 0) ? len : -len ;
@@ -215,13 +220,13 @@ srt_tags_to_ssa(char *string, ssa_file *file)
 
     /* check stack for wrong opened / closed / deranged tags */
     if (top != stack)
-      log_msg(warn, MSG_W_TAGPROBLEM, string);
+      log_msg(ctx, warn, MSG_W_TAGPROBLEM, string);
 
     /* append remaining tags to resulting string *
      * (usually it is closing tags)              *
      * it's not necessarily strictly, but some   *
      * wrong-coded renders may need them         */
-    commit_tags_buffer(common_buf, tags_buf);
+    commit_tags_buffer(ctx, common_buf, tags_buf);
 
     /* copy temp buffer to right place ^_^ */
     strncpy(string, common_buf, MAXLINE);
@@ -229,71 +234,166 @@ srt_tags_to_ssa(char *string, ssa_file *file)
     return true;
   }
 
-/* options */
-unsigned long int line_num = 0;
-unsigned long parsed = 0;
-
-int main(int argc, char *argv[])
+/* options from command line, the same for all converted files */
+struct settings
+  {
+    uint8_t src_flags;  /* srt_file flags */
+    ssa_version type;
+    struct res res;
+  };
+
+/* converts ctx->opts.infile to ctx->opts.outfile */
+static bool
+convert(context * const ctx, void *arg)
   {
+    struct settings const *set = arg;
     srt_file source;
     ssa_file target;
     srt_event *src;
     ssa_event **dst;
-    char opt;
     char buf[MAXLINE] = "";
+    /* style, name, effect & text of each event */
+    struct span str[4] = { { "Default", 7 }, { "", 0 }, { "", 0 }, { NULL, 0 } };
 
-    if (argc < 2) usage(EXIT_SUCCESS);
+    /* validation only: nothing is parsed or allocated */
+    if (ctx->opts.i_test)
+      {
+        if (!check_srt_file(ctx, ctx->opts.infile, set->src_flags))
+          {
+            if (!ctx->failed)
+              log_msg(ctx, error, MSG_W_TESTFAIL);
+            return false;
+          }
+        log_msg(ctx, warn, MSG_W_TESTDONE);
+        return true;
+      }
 
-    /* init, stage 1 */
     memset(&source, 0, sizeof(srt_file));
+    source.flags = set->src_flags;
     init_ssa_file(&target);
+    target.type = set->type;
+    target.res  = set->res;
+
+    if (!parse_srt_file(ctx, ctx->opts.infile, &source))
+      return false;
+
+    /* init, stage 2 */
+    src = source.events;
+    dst = &target.events;
+    ACALLOC(target.styles, &target.mem, 1, sizeof(ssa_style));
+
+    memcpy(target.styles, &ssa_style_template, sizeof(ssa_style));
+    target.styles->name = "Default";
+    target.styles->fontname = "Sans";
+
+    while (src != (srt_event *) 0)
+      {
+        ACALLOC(*dst, &target.mem, 1, sizeof(ssa_event));
+
+        memcpy(*dst, &ssa_event_template, sizeof(ssa_event));
+
+        /* copy simple data */
+        (*dst)->type  = DIALOGUE;
+        (*dst)->start = double2cs(src->start);
+        (*dst)->end   = double2cs(src->end);
+
+        strncpy(buf, src->text, MAXLINE);
+
+        /* convert tags */
+        if (strchr(buf, '<') != NULL)
+          srt_tags_to_ssa(ctx, buf, &target);
+
+        /* text wrapping */
+        if      (ctx->opts.o_wrap == keep)
+          text_replace(ctx, buf, "\n", "\\n", MAXLINE, 0);
+        else if (ctx->opts.o_wrap == merge)
+          text_replace(ctx, buf, "\n", " ",   MAXLINE, 0);
+
+        /* FIXME: link against default style, code below is temporary hack */
+        str[3].ptr = buf, str[3].len = strlen(buf);
+        ssa_event_pack(&target.mem, *dst, str);
+
+        /* events list operations */
+        dst = &((*dst)->next);
+        source.events = src->next;
+        free(src->text);
+        free(src);
+        src = source.events;
+      }
+
+    font_size_normalize(&target.res, &target.styles->fontsize);
+
+    return write_ssa_file(ctx, ctx->opts.outfile, &target, true);
+  }
+
+int main(int argc, char *argv[])
+  {
+    struct settings set = { 0, ssa_unknown, { 0, 0 } };
+    context ctx;
+    char *batch = NULL;
+    uint8_t jobs = 0;
+    int k = 0;
+    char opt;
+
+    if (argc < 2) usage(EXIT_SUCCESS);
+
+    context_init(&ctx);
+
     fesetround(1); /* no nearest integer */
 
     /* parsing options */
-    while ((opt = getopt(argc, argv, "qvhi:o:" "e" "ST" "f:x:y:Fw:")) != -1)
+    while ((opt = getopt(argc, argv, "qvhi:o:" "b:j:" "e" "ST" "f:x:y:Fw:")) != -1)
       {
         switch (opt)
           {
             case 'f' :
-              if      (strcmp(optarg, "ssa") == 0) target.type = ssa_v4;
-              else if (strcmp(optarg, "ass") == 0) target.type = ssa_v4p;
+              if      (strcmp(optarg, "ssa") == 0) set.type = ssa_v4;
+              else if (strcmp(optarg, "ass") == 0) set.type = ssa_v4p;
               break;
             case 'q' :
             case 'v' :
-              msglevel_change(&opts.msglevel, (opt == 'q') ? '-' : '+');
+              msglevel_change(&ctx.opts.msglevel, (opt == 'q') ? '-' : '+');
               break;
             case 'i' :
-              if ((opts.infile = fopen(optarg, "r")) == NULL)
-                log_msg(error, MSG_F_ORDFAIL, optarg);
+              if ((ctx.opts.infile = fopen(optarg, "r")) == NULL)
+                log_msg(&ctx, error, MSG_F_ORDFAIL, optarg);
               break;
             case 'o' :
-              if ((opts.outfile = fopen(optarg, "w")) == NULL)
+              if ((ctx.opts.outfile = fopen(optarg, "w")) == NULL)
                 {
-                  log_msg(warn, MSG_F_OWRFAILSO, optarg);
-                  opts.outfile = stdout;
+                  log_msg(&ctx, warn, MSG_F_OWRFAILSO, optarg);
+                  ctx.opts.outfile = stdout;
                 }
               break;
+            case 'b' :
+              batch = optarg;
+              break;
+            case 'j' :
+              if ((k = atoi(optarg)) < 0 || k > BATCH_THREADS_MAX)
+                log_msg(&ctx, error, MSG_O_OOR, "-j");
+              jobs = k;
+              break;
             case 'e' :
-              log_msg(info, _("Strict mode. No mercy for malformed lines or uncommon extensions!"));
-              source.flags |= SRT_E_STRICT;
+              log_msg(&ctx, info, _("Strict mode. No mercy for malformed lines or uncommon extensions!"));
+              set.src_flags |= SRT_E_STRICT;
               break;
             case 'S' :
-              opts.i_sort = true;
+              ctx.opts.i_sort = true;
               break;
             case 'T' :
-              opts.i_test = true;
+              ctx.opts.i_test = true;
               break;
             case 'x' :
-              target.res.width  = atoi(optarg);
+              set.res.width  = atoi(optarg);
               break;
             case 'y' :
-              target.res.height = atoi(optarg);
+              set.res.height = atoi(optarg);
               break;
             case 'w' :
-              set_wrap(&opts.o_wrap, optarg);
+              set_wrap(&ctx, &ctx.opts.o_wrap, optarg);
               break;
             case 'F' :
-              opts.o_fsize_tune = true;
+              ctx.opts.o_fsize_tune = true;
               break;
             case 'h' :
               usage(EXIT_SUCCESS);
@@ -305,78 +405,29 @@ int main(int argc, char *argv[])
       }
 
     /* checks */
-    common_checks(&opts);
-
-    if (target.type == ssa_unknown)
-      log_msg(error, MSG_O_OREQUIRED, "-f");
+    if (set.type == ssa_unknown)
+      log_msg(&ctx, error, MSG_O_OREQUIRED, "-f");
 
-    if (opts.o_fsize_tune && !target.res.width && !target.res.height)
-      log_msg(error, _("'-F' option requires '-x' and/or '-y'."));
-
-    if (!parse_srt_file(opts.infile, &source))
-      log_msg(error, MSG_U_UNKNOWN);
-
-    if (opts.i_test)
-      {
-        log_msg(warn, MSG_W_TESTDONE);
-        exit(EXIT_SUCCESS);
-      }
-
-    /* init, stage 2 */
-    src = source.events;
-    dst = &target.events;
-    CALLOC(target.styles, 1, sizeof(ssa_style));
-
-    memcpy(target.styles, &ssa_style_template, sizeof(ssa_style));
-    target.styles->name = "Default";
-    target.styles->fontname = "Sans";
+    if (ctx.opts.o_fsize_tune && !set.res.width && !set.res.height)
+      log_msg(&ctx, error, _("'-F' option requires '-x' and/or '-y'."));
 
-    while (src != (srt_event *) 0)
+    if (batch != NULL)
       {
-        CALLOC(*dst, 1, sizeof(ssa_event));
-
-        memcpy(*dst, &ssa_event_template, sizeof(ssa_event));
-
-        /* copy simple data */
-        (*dst)->type  = DIALOGUE;
-        (*dst)->start = src->start;
-        (*dst)->end   = src->end;
-
-        strncpy(buf, src->text, MAXLINE);
-
-        /* convert tags */
-        if (strchr(buf, '<') != NULL)
-          srt_tags_to_ssa(buf, &target);
-
-        /* text wrapping */
-        if      (opts.o_wrap == keep)
-          text_replace(buf, "\n", "\\n", MAXLINE, 0);
-        else if (opts.o_wrap == merge)
-          text_replace(buf, "\n", " ",   MAXLINE, 0);
-
-        /* FIXME: link against default style, code below is temporary hack */
-        (*dst)->style = "Default";
-        (*dst)->name = "";
-        (*dst)->effect = "";
-
-        STRNDUP((*dst)->text, buf, MAXLINE);
-
-        /* events list operations */
-        dst = &((*dst)->next);
-        source.events = src->next;
-        free(src->text);
-        free(src);
-        src = source.events;
+        if (ctx.opts.infile != NULL || ctx.opts.outfile != NULL)
+          log_msg(&ctx, error, MSG_O_NOTWITHB);
+        exit(batch_run(&ctx, batch, (set.type == ssa_v4p) ? ".ass" : ".ssa",
+                       jobs, convert, &set) ? EXIT_SUCCESS : EXIT_FAILURE);
       }
 
-    font_size_normalize(&target.res, &target.styles->fontsize);
+    common_checks(&ctx);
 
-    write_ssa_file(opts.outfile, &target, true);
+    if (!convert(&ctx, &set) && !ctx.failed)
+      log_msg(&ctx, error, MSG_U_UNKNOWN);
 
     /* prepare to exit */
-    if (opts.infile  != NULL)   fclose(opts.infile);
-    if (opts.outfile != NULL &&
-        opts.outfile != stdout) fclose(opts.outfile);
+    if (ctx.opts.infile  != NULL)   fclose(ctx.opts.infile);
+    if (ctx.opts.outfile != NULL &&
+        ctx.opts.outfile != stdout) fclose(ctx.opts.outfile);
 
-    return 0;
+    return (ctx.failed) ? EXIT_FAILURE : EXIT_SUCCESS;
   }
@@ -0,0 +1,127 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+#include "arena.h"
+#include "outbuf.h"
+#include "reader.h"
+#include "ssa.h"
+#include "cache.h"
+
+#define PROG_NAME "ssa-cache"
+
+void usage(int exit_code)
+  {
+    fprintf(stderr, "%s v%.2f\n", COMMON_PROG_NAME, VERSION);
+    fprintf(stderr, \
+      _("Usage: %s [<options>] -i <input_file> [-o <output_file>]\n"),
+        PROG_NAME);
+    fputc('\n', stderr);
+
+    usage_common_opts();
+    fputc('\n', stderr);
+
+    usage_ssa_input_opts();
+    fputc('\n', stderr);
+
+    fprintf(stderr, _("\
+Compiles ssa file to binary form, which is loaded without parsing.\n\
+Compiled file is only for this machine (byte order) & version.\n\
+Stripped fonts & graphics stay stripped in it, '-R' is used with '-d'.\n\
+  -d                Decompile: input is compiled file, write it as text.\n"));
+    fputc('\n', stderr);
+
+    exit(exit_code);
+  }
+
+int main(int argc, char *argv[])
+  {
+    ssa_file file;
+    context ctx;
+    reader in;
+    bool decompile = false, result = false;
+    char opt;
+
+    if (argc < 2) usage(EXIT_SUCCESS);
+
+    context_init(&ctx);
+
+    while ((opt = getopt(argc, argv, "qvhi:o:" "MR:" "d")) != -1)
+      {
+        switch (opt)
+          {
+            case 'q' :
+            case 'v' :
+              msglevel_change(&ctx.opts.msglevel, (opt == 'q') ? '-' : '+');
+              break;
+            case 'i' :
+              if ((ctx.opts.infile = fopen(optarg, "r")) == NULL)
+                log_msg(&ctx, error, MSG_F_ORDFAIL, optarg);
+              break;
+            case 'o' :
+              if ((ctx.opts.outfile = fopen(optarg, "w")) == NULL)
+                {
+                  log_msg(&ctx, warn, MSG_F_OWRFAILSO, optarg);
+                  ctx.opts.outfile = stdout;
+                }
+              break;
+            case 'M' :
+              ctx.opts.i_nomedia = true;
+              break;
+            case 'R' :
+              ctx.opts.i_store = optarg;
+              break;
+            case 'd' :
+              decompile = true;
+              break;
+            case 'h' :
+              usage(EXIT_SUCCESS);
+              break;
+            default :
+              usage(EXIT_FAILURE);
+              break;
+          }
+      }
+
+    common_checks(&ctx);
+
+    init_ssa_file(&file);
+
+    if (decompile)
+      {
+        if (!cache_load(&ctx, ctx.opts.infile, &in, &file))
+          log_msg(&ctx, error, MSG_U_UNKNOWN);
+        result = write_ssa_file(&ctx, ctx.opts.outfile, &file, true);
+        reader_close(&in);
+      }
+    else
+      {
+        if (!parse_ssa_file(&ctx, ctx.opts.infile, &file))
+          return EXIT_FAILURE;
+        result = cache_write(&ctx, ctx.opts.outfile, &file);
+        free_ssa_file(&file);
+      }
+
+    if (!result)
+      log_msg(&ctx, error, MSG_F_WRFAIL);
+
+    /* prepare to exit */
+    if (ctx.opts.infile  != NULL)   fclose(ctx.opts.infile);
+    if (ctx.opts.outfile != NULL &&
+        ctx.opts.outfile != stdout) fclose(ctx.opts.outfile);
+
+    return (ctx.failed) ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
@@ -0,0 +1,259 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+#include "arena.h"
+#include "outbuf.h"
+#include "ssa.h"
+#include "seekidx.h"
+
+#define PROG_NAME "ssa-query"
+
+void usage(int exit_code)
+  {
+    fprintf(stderr, "%s v%.2f\n", COMMON_PROG_NAME, VERSION);
+    fprintf(stderr, \
+      _("Usage: %s [<options>] -i <input_file> [-o <output_file>]\n"),
+        PROG_NAME);
+    fputc('\n', stderr);
+
+    usage_common_opts();
+    fputc('\n', stderr);
+
+    usage_ssa_input_opts();
+    fputc('\n', stderr);
+
+    fprintf(stderr, _("\
+Query options:\n\
+  -t <time>         Print events, shown at this time.\n\
+  -s <time>         Print events, shown in period from this time...\n\
+  -e <time>         ...till this time, not including it.\n\
+                    Default: the latest time found in file.\n\
+  -c                Print only number of found events.\n\
+  -x                Extract: write file with header, styles and\n\
+                    only found events.\n\
+  -I                Make (or update) seek index '<input_file>%s'.\n\
+                    Later queries read only needed parts of file,\n\
+                    while index is up to date.\n"), SEEKIDX_EXT);
+    fputc('\n', stderr);
+
+    exit(exit_code);
+  }
+
+/* for print_event() */
+struct query
+  {
+    outbuf *out;
+    ssa_version type;
+    bool count_only;
+    bool *keep; /* extract mode: found events by number */
+  };
+
+static void
+print_event(ssa_event_ivl const * const v, void *arg)
+  {
+    struct query *q = arg;
+
+    if (q->keep != NULL)
+      q->keep[v->num] = true;
+    else if (!q->count_only)
+      write_ssa_event(q->out, v->event, q->type);
+  }
+
+/* leaves in list only found events, in their original order */
+static void
+extract_events(ssa_file * const file, bool const *keep)
+  {
+    ssa_event *e = NULL, *head = NULL, **tail = &head;
+    size_t i = 0;
+
+    for (e = file->events; e != NULL; e = e->next, i++)
+      if (keep[i])
+        ssa_event_append(&head, &tail, e);
+
+    if (head != NULL)
+      (*tail)->next = NULL;
+    file->events = head;
+  }
+
+int main(int argc, char *argv[])
+  {
+    ssa_file file;
+    ssa_event_index idx;
+    seekidx sidx;
+    struct query q = { NULL, ssa_unknown, false, NULL };
+    outbuf out;
+    context ctx;
+    FILE *in = NULL;
+    char *i_name = NULL, *idx_name = NULL;
+    double t = -1.0, from = 0.0, to = 0.0;
+    int32_t lo = 0, hi = INT32_MAX;
+    size_t found = 0;
+    bool extract = false, make_idx = false, use_idx = false;
+    char opt;
+
+    if (argc < 2) usage(EXIT_SUCCESS);
+
+    context_init(&ctx);
+
+    while ((opt = getopt(argc, argv, "qvhi:o:" "MR:" "t:s:e:cxI")) != -1)
+      {
+        switch (opt)
+          {
+            case 'q' :
+            case 'v' :
+              msglevel_change(&ctx.opts.msglevel, (opt == 'q') ? '-' : '+');
+              break;
+            case 'i' :
+              if ((ctx.opts.infile = fopen(optarg, "r")) == NULL)
+                log_msg(&ctx, error, MSG_F_ORDFAIL, optarg);
+              i_name = optarg;
+              break;
+            case 'o' :
+              if ((ctx.opts.outfile = fopen(optarg, "w")) == NULL)
+                {
+                  log_msg(&ctx, warn, MSG_F_OWRFAILSO, optarg);
+                  ctx.opts.outfile = stdout;
+                }
+              break;
+            case 'M' :
+              ctx.opts.i_nomedia = true;
+              break;
+            case 'R' :
+              ctx.opts.i_store = optarg;
+              break;
+            case 't' :
+              parse_time(&ctx, optarg, &t, true);
+              break;
+            case 's' :
+              parse_time(&ctx, optarg, &from, true);
+              break;
+            case 'e' :
+              parse_time(&ctx, optarg, &to, true);
+              break;
+            case 'c' :
+              q.count_only = true;
+              break;
+            case 'x' :
+              extract = true;
+              break;
+            case 'I' :
+              make_idx = true;
+              break;
+            case 'h' :
+              usage(EXIT_SUCCESS);
+              break;
+            default :
+              usage(EXIT_FAILURE);
+              break;
+          }
+      }
+
+    /* checks */
+    if (t >= 0.0 && (from != 0.0 || to != 0.0))
+      log_msg(&ctx, error, MSG_O_NOTTOGETHER, "-t", "-s/-e");
+    if (t < 0.0 && from == 0.0 && to == 0.0 && !make_idx)
+      log_msg(&ctx, error, MSG_O_OREQUIRED, "-t");
+    if (q.count_only && extract)
+      log_msg(&ctx, error, MSG_O_NOTTOGETHER, "-c", "-x");
+    if (make_idx && i_name == NULL)
+      log_msg(&ctx, error, MSG_O_OREQUIRED, "-i");
+    if (to != 0.0 && to < from)
+      log_msg(&ctx, error, _("Period end is before its start."));
+
+    common_checks(&ctx);
+
+    if (t >= 0.0)
+      lo = double2cs(t), hi = lo + 1;
+    else
+      lo = double2cs(from), hi = (to != 0.0) ? double2cs(to) : INT32_MAX;
+
+    /* seek index */
+    if (i_name != NULL)
+      {
+        CALLOC(idx_name, strlen(i_name) + strlen(SEEKIDX_EXT) + 1, sizeof(char));
+        strcat(strcpy(idx_name, i_name), SEEKIDX_EXT);
+      }
+
+    if (make_idx)
+      {
+        if (!seekidx_build(&ctx, ctx.opts.infile, &sidx) ||
+            !seekidx_write(&ctx, idx_name, &sidx))
+          log_msg(&ctx, error, _("Can't make seek index '%s'."), idx_name);
+        log_msg(&ctx, info, _("Seek index '%s': %lu blocks."), idx_name,
+                (unsigned long) sidx.count);
+        use_idx = true;
+      }
+    else if (idx_name != NULL)
+      use_idx = seekidx_read(&ctx, idx_name, ctx.opts.infile, &sidx);
+
+    free(idx_name);
+
+    if (make_idx && t < 0.0 && from == 0.0 && to == 0.0)
+      {
+        seekidx_free(&sidx);
+        fclose(ctx.opts.infile);
+        if (ctx.opts.outfile != stdout) fclose(ctx.opts.outfile);
+        return (ctx.failed) ? EXIT_FAILURE : EXIT_SUCCESS;
+      }
+
+    in = ctx.opts.infile;
+    if (use_idx)
+      {
+        if ((in = seekidx_extract(&ctx, ctx.opts.infile, &sidx, lo, hi)) == NULL)
+          in = ctx.opts.infile; /* read whole file then */
+        seekidx_free(&sidx);
+      }
+
+    init_ssa_file(&file);
+    file.event_fields = SSA_F_TIMES; /* events are found by time only */
+    if (!parse_ssa_file(&ctx, in, &file))
+      return EXIT_FAILURE;
+
+    ssa_event_index_build(&file, &idx);
+
+    memset(&out, 0, sizeof(outbuf));
+    if (!q.count_only && !extract && !outbuf_open(&out, &ctx, ctx.opts.outfile))
+      log_msg(&ctx, error, MSG_F_WRFAIL);
+    q.out = &out, q.type = file.type;
+    if (extract)
+      ACALLOC(q.keep, &file.mem, idx.count + 1, sizeof(bool));
+
+    found = ssa_event_index_overlap(&idx, lo, hi, print_event, &q);
+
+    if (extract)
+      {
+        extract_events(&file, q.keep);
+        if (!write_ssa_file(&ctx, ctx.opts.outfile, &file, false))
+          log_msg(&ctx, error, MSG_F_WRFAIL);
+      }
+    else if (!q.count_only)
+      outbuf_close(&out);
+    else
+      fprintf(ctx.opts.outfile, "%lu\n", (unsigned long) found);
+
+    log_msg(&ctx, info, _("Found %lu event(s)."), (unsigned long) found);
+
+    free_ssa_file(&file);
+
+    /* prepare to exit, media may be still read from 'in' till now */
+    if (in != ctx.opts.infile)      fclose(in);
+    if (ctx.opts.infile  != NULL)   fclose(ctx.opts.infile);
+    if (ctx.opts.outfile != NULL &&
+        ctx.opts.outfile != stdout) fclose(ctx.opts.outfile);
+
+    return (ctx.failed) ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
@@ -15,6 +15,8 @@
  */
 
 #include "common.h"
+#include "arena.h"
+#include "outbuf.h"
 #include "ssa.h"
 
 #define PROG_NAME "ssa-resize"
@@ -63,10 +65,6 @@ Specific options for 'percents' mode:\n\
 
 enum { not_set, resolution, percents } mode;
 
-extern struct options opts;
-
-uint32_t line_num = 0;
-
 int main(int argc, char *argv[])
 {
   char opt;
@@ -76,7 +74,9 @@ int main(int argc, char *argv[])
   unsigned int pct_w = 0;
   unsigned int pct_h = 0;
   ssa_file file;
+  context ctx;
 
+  context_init(&ctx);
   mode = ssa_unknown;
 
   if (argc >= 4)
@@ -94,28 +94,28 @@ int main(int argc, char *argv[])
       switch(opt)
         {
         case 'i':
-          if ((opts.infile = fopen(optarg, "r")) == NULL)
-            log_msg(error, MSG_F_ORDFAIL, optarg);
+          if ((ctx.opts.infile = fopen(optarg, "r")) == NULL)
+            log_msg(&ctx, error, MSG_F_ORDFAIL, optarg);
           break;
         case 'o':
-          if ((opts.outfile = fopen(optarg, "w")) == NULL)
+          if ((ctx.opts.outfile = fopen(optarg, "w")) == NULL)
             {
-              log_msg(warn, MSG_F_OWRFAILSO, optarg);
-              opts.outfile = stdout;
+              log_msg(&ctx, warn, MSG_F_OWRFAILSO, optarg);
+              ctx.opts.outfile = stdout;
             }
           break;
         case 'f':
           if (sscanf(optarg, "%u%*c%u", &src.width, &src.height) != 2)
-            log_msg(error, _("'-f': wrong resolution."));
+            log_msg(&ctx, error, _("'-f': wrong resolution."));
           break;
         case 't':
           if (sscanf(optarg, "%u%*c%u",
                 &file.res.width, &file.res.height) != 2)
-            log_msg(error, _("'-t': wrong resolution."));
+            log_msg(&ctx, error, _("'-t': wrong resolution."));
           break;
         case 'p':
           if ((i = sscanf(optarg, "%u%*c%u", &pct_w, &pct_h)) == 0)
-            log_msg(error, MSG_O_OVREQUIRED, "-p");
+            log_msg(&ctx, error, MSG_O_OVREQUIRED, "-p");
           if (i == 1) /* pct_w also acts as pct_h, if specified only 1 value */
             pct_h = pct_w;
           break;
@@ -127,26 +127,26 @@ int main(int argc, char *argv[])
     }
 
   /* args checks */
-  common_checks(&opts);
+  common_checks(&ctx);
 
   if (mode == percents)
     {
       if (pct_w == 0)
-        log_msg(error, MSG_O_OREQUIRED, "-p");
+        log_msg(&ctx, error, MSG_O_OREQUIRED, "-p");
       else if (pct_w > MAX_PCT || pct_h > MAX_PCT)
-        log_msg(error, MSG_O_OOR, "-p");
+        log_msg(&ctx, error, MSG_O_OOR, "-p");
     }
   else if (mode == resolution)
     {
       if (src.width == 0)
-        log_msg(error, MSG_O_OREQUIRED, "-f");
+        log_msg(&ctx, error, MSG_O_OREQUIRED, "-f");
       if (file.res.width == 0)
-        log_msg(error, MSG_O_OREQUIRED, "-t");
+        log_msg(&ctx, error, MSG_O_OREQUIRED, "-t");
     }
 
   /* init */
   init_ssa_file(&file);
-  parse_ssa_file(opts.infile, &file);
+  parse_ssa_file(&ctx, ctx.opts.infile, &file);
 
   printf("%s\n", line);
   while(true) break;
@@ -0,0 +1,508 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+#include "arena.h"
+#include "outbuf.h"
+#include "ssa.h"
+#include "uue.h"
+#include "store.h"
+
+#define PROG_NAME "ssa-resources"
+
+#define MSG_R_BROKEN    _("Broken uue data of embedded file.")
+#define MSG_R_UNSAFE    _("Unsafe name of embedded file, skipped.")
+#define MSG_R_NOTFOUND  _("No embedded file '%s' found.")
+#define MSG_R_EMPTY     _("File '%s' is empty, skipped.")
+#define MSG_R_STRIPPED  _("Embedded file is stripped, media store ('-R') needed.")
+
+#define RES_THREADS_MAX 64
+
+enum { unset, show, extract, embed, strip, restore } mode;
+
+void usage(int exit_code)
+  {
+    fprintf(stderr, "%s v%.2f\n", COMMON_PROG_NAME, VERSION);
+    fprintf(stderr, _("\
+Usage: %s show    [<options>] -i <input_file> [<name>...]\n\
+       %s extract [<options>] -i <input_file> [-d <dir>] [<name>...]\n\
+       %s embed   [<options>] -i <input_file> [-o <output_file>] -f <file> -g <file>\n\
+       %s strip   [<options>] -i <input_file> [-o <output_file>] -R <dir>\n\
+       %s restore [<options>] -i <input_file> [-o <output_file>] -R <dir>\n"),
+        PROG_NAME, PROG_NAME, PROG_NAME, PROG_NAME, PROG_NAME);
+    fputc('\n', stderr);
+
+    usage_common_opts();
+    fputc('\n', stderr);
+
+    fprintf(stderr, _("\
+Modes:\n\
+  show              List embedded fonts & graphics: type, size, name.\n\
+  extract           Decode embedded files to directory.\n\
+  embed             Write input file with given files embedded.\n\
+  strip             Put embedded files to media store, write input file\n\
+                    with only references to them. Each file is stored\n\
+                    once, by hash of it's content.\n\
+  restore           Write input file with stripped files embedded back.\n\
+\n\
+Mode options:\n\
+  -j <num>          Decode in <num> threads. (Default: number of cpus)\n\
+  -d <dir>          Extract files here. (Default: current directory)\n\
+  -f <file>         Embed font. May be given several times.\n\
+  -g <file>         Embed image. May be given several times.\n\
+  -R <dir>          Media store. Other tools take this option too,\n\
+                    stripped files are embedded back on output then.\n\
+\n\
+Names, if given, select embedded files to show or extract.\n"));
+    fputc('\n', stderr);
+
+    exit(exit_code);
+  }
+
+/* one embedded file to decode */
+struct res_job
+  {
+    ssa_media *m;
+    size_t size; /* decoded */
+    bool ok;
+    char hex[STORE_HEX_LEN + 1]; /* strip mode: hash of stored file */
+  };
+
+struct res_pool
+  {
+    struct res_job *jobs;
+    size_t count;
+    size_t next; /* first job, not taken yet */
+    pthread_mutex_t lock;
+    context *ctx;
+    char const *dir; /* extract mode: write files here */
+    bool strip;      /* put files to ctx->opts.i_store */
+  };
+
+/* only plain names: no paths, no hidden files, no '..' */
+static bool
+media_name_safe(char const *name)
+  {
+    return name != NULL && name[0] != '\0' && name[0] != '.' &&
+           strchr(name, '/') == NULL;
+  }
+
+/* reads uue lines of media, which are range of input *
+ * file or temporary file, see ssa_media in ssa.h     */
+static char *
+media_read(context * const ctx, ssa_media * const m, size_t *len)
+  {
+    struct stat st;
+    char *buf = NULL;
+    int fd = m->fd;
+    off_t offset = m->offset;
+    ssize_t r = 0;
+    size_t done = 0;
+
+    *len = m->len;
+    if (m->data != NULL)
+      {
+        fd = fileno(m->data), offset = 0;
+        if (fstat(fd, &st) != 0)
+          {
+            log_msg(ctx, warn, MSG_F_RDFAIL, strerror(errno));
+            return NULL;
+          }
+        *len = st.st_size;
+      }
+
+    CALLOC(buf, *len + 1, sizeof(char));
+
+    while (done < *len)
+      {
+        if ((r = pread(fd, buf + done, *len - done, offset + done)) <= 0)
+          {
+            log_msg(ctx, warn, MSG_F_RDFAIL, (r < 0) ? strerror(errno) : "EOF");
+            free(buf);
+            return NULL;
+          }
+        done += r;
+      }
+
+    return buf;
+  }
+
+static bool
+media_write(context * const ctx, char const *dir, char const *name,
+            uint8_t const *data, size_t len)
+  {
+    char *path = NULL;
+    FILE *f = NULL;
+    bool result = true;
+
+    CALLOC(path, strlen(dir) + strlen(name) + 2, sizeof(char));
+    sprintf(path, "%s/%s", dir, name);
+
+    if ((f = fopen(path, "w")) == NULL)
+      {
+        log_msg(ctx, warn, MSG_F_OWRFAIL, path);
+        free(path);
+        return false;
+      }
+
+    if (fwrite(data, sizeof(uint8_t), len, f) != len)
+      result = false;
+    if (fclose(f) != 0)
+      result = false;
+
+    if (!result)
+      log_msg(ctx, warn, MSG_F_WRFAIL), unlink(path);
+
+    free(path);
+
+    return result;
+  }
+
+/* decodes one file (or takes it from store, if it's stripped), *
+ * then writes it or puts to store, if needed. only warnings     *
+ * here, job just fails                                          */
+static void
+res_job_run(struct res_pool * const pool, struct res_job * const job)
+  {
+    context ctx = *pool->ctx;
+    char const *src = job->m->raw;
+    char *buf = NULL;
+    uint8_t *data = NULL;
+    size_t len = job->m->len;
+
+    ctx.name = job->m->filename;
+    ctx.abort = NULL;
+    job->ok = false;
+
+    if (pool->dir != NULL && !media_name_safe(job->m->filename))
+      {
+        log_msg(&ctx, warn, MSG_R_UNSAFE);
+        return;
+      }
+
+    if (job->m->ref != NULL)
+      {
+        if (pool->strip) /* already there */
+          job->ok = true;
+        else if (ctx.opts.i_store == NULL)
+          log_msg(&ctx, warn, MSG_R_STRIPPED);
+        else if ((data = store_get(&ctx, ctx.opts.i_store, job->m->ref, &job->size)) != NULL)
+          job->ok = true;
+      }
+    else if (src == NULL && (src = buf = media_read(&ctx, job->m, &len)) == NULL)
+      return;
+    else
+      {
+        CALLOC(data, UUE_DECODED_MAX(len), sizeof(uint8_t));
+        if ((job->ok = uue_decode(data, &job->size, src, len)) == false)
+          log_msg(&ctx, warn, MSG_R_BROKEN);
+        else if (pool->strip && job->size > 0) /* nothing to strip in empty one */
+          job->ok = store_put(&ctx, ctx.opts.i_store, data, job->size, job->hex);
+      }
+
+    if (job->ok && pool->dir != NULL)
+      job->ok = media_write(&ctx, pool->dir, job->m->filename, data, job->size);
+
+    free(data);
+    free(buf);
+  }
+
+static void *
+res_worker(void *arg)
+  {
+    struct res_pool *pool = arg;
+    size_t i = 0;
+
+    while (true)
+      {
+        pthread_mutex_lock(&pool->lock);
+        i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (i >= pool->count)
+          break;
+
+        res_job_run(pool, &pool->jobs[i]);
+      }
+
+    return NULL;
+  }
+
+/* decodes all jobs in 'threads' (0 - number of cpus) parallel *
+ * threads, one file at once, main thread is one of workers     */
+static void
+res_decode(struct res_pool * const pool, uint8_t threads)
+  {
+    pthread_t tids[RES_THREADS_MAX];
+    bool started[RES_THREADS_MAX];
+    uint8_t i = 0;
+
+    if (threads == 0)
+      threads = cpu_threads(RES_THREADS_MAX);
+    if (threads > RES_THREADS_MAX)
+      threads = RES_THREADS_MAX;
+    if (threads > pool->count)
+      threads = pool->count;
+
+    pthread_mutex_init(&pool->lock, NULL);
+
+    for (i = 1; i < threads; i++)
+      started[i] = (pthread_create(&tids[i], NULL, res_worker, pool) == 0);
+
+    res_worker(pool);
+
+    for (i = 1; i < threads; i++)
+      if (started[i])
+        pthread_join(tids[i], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+  }
+
+/* reads & encodes 'path', appends it to 'list' */
+static void
+media_embed(context * const ctx, ssa_file * const file, ssa_media **list,
+            char const *path, int type)
+  {
+    struct stat st;
+    FILE *f = NULL;
+    uint8_t *data = NULL;
+    char *enc = NULL;
+    char const *name = strrchr(path, '/');
+    ssa_media *m = NULL, **tail = list;
+    size_t size = 0;
+
+    name = (name != NULL) ? name + 1 : path;
+
+    if ((f = fopen(path, "r")) == NULL)
+      log_msg(ctx, error, MSG_F_ORDFAIL, path);
+    if (fstat(fileno(f), &st) != 0)
+      log_msg(ctx, error, MSG_F_RDFAIL, strerror(errno));
+
+    if ((size = st.st_size) == 0)
+      {
+        log_msg(ctx, warn, MSG_R_EMPTY, path);
+        fclose(f);
+        return;
+      }
+
+    CALLOC(data, size, sizeof(uint8_t));
+    if (fread(data, sizeof(uint8_t), size, f) != size)
+      log_msg(ctx, error, MSG_F_RDFAIL, strerror(errno));
+    fclose(f);
+
+    ACALLOC(m, &file->mem, 1, sizeof(ssa_media));
+    ACALLOC(enc, &file->mem, uue_encoded_len(size), sizeof(char));
+    m->type = type;
+    ASTRNDUP(m->filename, &file->mem, name, strlen(name));
+    m->raw = enc;
+    m->len = uue_encode(enc, data, size);
+    free(data);
+
+    while (*tail != NULL)
+      tail = &(*tail)->next;
+    *tail = m;
+  }
+
+/* media becomes reference to file in store */
+static void
+media_strip(ssa_file * const file, ssa_media * const m, char const *hex)
+  {
+    char *ref = NULL;
+    size_t len = strlen(STORE_REF) + STORE_HEX_LEN + 1;
+
+    ACALLOC(ref, &file->mem, len + 1, sizeof(char));
+    sprintf(ref, "%s%s\n", STORE_REF, hex);
+
+    if (m->data != NULL)
+      fclose(m->data), m->data = NULL;
+    m->raw = ref, m->len = len;
+    ASTRNDUP(m->ref, &file->mem, hex, STORE_HEX_LEN);
+  }
+
+int main(int argc, char *argv[])
+  {
+    ssa_file file;
+    struct res_pool pool;
+    struct slist *fonts = NULL, *images = NULL, *s = NULL;
+    context ctx;
+    ssa_media *m = NULL, *lists[2];
+    char const *dir = ".";
+    uint8_t threads = 0;
+    size_t i = 0, n = 0;
+    int k = 0;
+    bool found = false, rewrite = false;
+    char opt;
+
+    context_init(&ctx);
+    mode = unset;
+
+    if (argc >= 3)
+      {
+        if      (strcmp(argv[1], "show")    == 0) mode = show;
+        else if (strcmp(argv[1], "extract") == 0) mode = extract;
+        else if (strcmp(argv[1], "embed")   == 0) mode = embed;
+        else if (strcmp(argv[1], "strip")   == 0) mode = strip;
+        else if (strcmp(argv[1], "restore") == 0) mode = restore;
+        else usage(EXIT_FAILURE);
+
+        argc--, argv++;
+      }
+    else usage((argc < 2) ? EXIT_SUCCESS : EXIT_FAILURE);
+
+    rewrite = (mode == embed || mode == strip || mode == restore);
+
+    while ((opt = getopt(argc, argv, "qvhi:o:" "R:" "j:d:" "f:g:")) != -1)
+      {
+        switch (opt)
+          {
+            case 'q' :
+            case 'v' :
+              msglevel_change(&ctx.opts.msglevel, (opt == 'q') ? '-' : '+');
+              break;
+            case 'i' :
+              if ((ctx.opts.infile = fopen(optarg, "r")) == NULL)
+                log_msg(&ctx, error, MSG_F_ORDFAIL, optarg);
+              break;
+            case 'o' :
+              if ((ctx.opts.outfile = fopen(optarg, "w")) == NULL)
+                {
+                  log_msg(&ctx, warn, MSG_F_OWRFAILSO, optarg);
+                  ctx.opts.outfile = stdout;
+                }
+              break;
+            case 'R' :
+              ctx.opts.i_store = optarg;
+              break;
+            case 'j' :
+              if ((k = atoi(optarg)) < 0 || k > RES_THREADS_MAX)
+                log_msg(&ctx, error, MSG_O_OOR, "-j");
+              threads = k;
+              break;
+            case 'd' :
+              dir = optarg;
+              break;
+            case 'f' :
+              slist_add(&fonts, optarg);
+              break;
+            case 'g' :
+              slist_add(&images, optarg);
+              break;
+            case 'h' :
+              usage(EXIT_SUCCESS);
+              break;
+            default :
+              usage(EXIT_FAILURE);
+              break;
+          }
+      }
+
+    /* list goes to stdout, there is no output file in other modes */
+    if (!rewrite && ctx.opts.outfile == NULL)
+      ctx.opts.outfile = stdout;
+
+    common_checks(&ctx);
+
+    if (mode == embed && fonts == NULL && images == NULL)
+      log_msg(&ctx, error, MSG_O_OREQUIRED, "-f/-g");
+    if ((mode == strip || mode == restore) && ctx.opts.i_store == NULL)
+      log_msg(&ctx, error, MSG_O_OREQUIRED, "-R");
+
+    init_ssa_file(&file);
+    file.event_fields = SSA_F_TIMES; /* events are only written back */
+
+    if (!parse_ssa_file(&ctx, ctx.opts.infile, &file))
+      return EXIT_FAILURE;
+
+    for (s = fonts; s != NULL; s = s->next)
+      media_embed(&ctx, &file, &file.fonts, s->value, type_font);
+    for (s = images; s != NULL; s = s->next)
+      media_embed(&ctx, &file, &file.images, s->value, type_image);
+
+    if (mode == show || mode == extract || mode == strip)
+      {
+        memset(&pool, 0, sizeof(struct res_pool));
+        pool.ctx = &ctx;
+        pool.dir = (mode == extract) ? dir : NULL;
+        pool.strip = (mode == strip);
+
+        lists[0] = file.fonts, lists[1] = file.images;
+        for (k = 0; k < 2; k++)
+          for (m = lists[k]; m != NULL; m = m->next)
+            n++;
+        CALLOC(pool.jobs, (n > 0) ? n : 1, sizeof(struct res_job));
+
+        /* selected by names or all */
+        for (k = 0; k < 2; k++)
+          for (m = lists[k]; m != NULL; m = m->next)
+            {
+              for (found = (optind == argc), i = optind; i < (size_t) argc && !found; i++)
+                found = (m->filename != NULL && strcmp(m->filename, argv[i]) == 0);
+              if (found)
+                pool.jobs[pool.count++].m = m;
+            }
+
+        for (i = optind; i < (size_t) argc; i++)
+          {
+            for (found = false, n = 0; n < pool.count && !found; n++)
+              found = (strcmp(pool.jobs[n].m->filename, argv[i]) == 0);
+            if (!found)
+              log_msg(&ctx, warn, MSG_R_NOTFOUND, argv[i]);
+          }
+
+        if (pool.count > 0)
+          res_decode(&pool, threads);
+
+        for (i = 0; i < pool.count; i++)
+          {
+            m = pool.jobs[i].m;
+            if (!pool.jobs[i].ok)
+              ctx.failed = true;
+            if (mode == strip && pool.jobs[i].hex[0] != '\0')
+              media_strip(&file, m, pool.jobs[i].hex);
+            if (mode == show && pool.jobs[i].ok)
+              fprintf(ctx.opts.outfile, "%s\t%lu\t%s\n", (m->type == type_font) ? "font" : "image",
+                      (unsigned long) pool.jobs[i].size, m->filename);
+            else if (mode == show)
+              fprintf(ctx.opts.outfile, "%s\t-\t%s\n", (m->type == type_font) ? "font" : "image",
+                      m->filename);
+          }
+
+        free(pool.jobs);
+      }
+
+    if (rewrite)
+      {
+        /* references are written as is */
+        if (mode == strip)
+          ctx.opts.i_store = NULL;
+        if (!write_ssa_file(&ctx, ctx.opts.outfile, &file, true))
+          log_msg(&ctx, error, MSG_F_WRFAIL);
+      }
+    else
+      free_ssa_file(&file);
+
+    /* prepare to exit, media may be still read from input till now */
+    while ((s = fonts) != NULL)
+      fonts = s->next, free(s->value), free(s);
+    while ((s = images) != NULL)
+      images = s->next, free(s->value), free(s);
+
+    if (ctx.opts.infile  != NULL)   fclose(ctx.opts.infile);
+    if (ctx.opts.outfile != NULL &&
+        ctx.opts.outfile != stdout) fclose(ctx.opts.outfile);
+
+    return (ctx.failed) ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
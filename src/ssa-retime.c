@@ -15,15 +15,24 @@
  */
 
 #include "common.h"
+#include "arena.h"
+#include "batch.h"
+#include "outbuf.h"
 #include "ssa.h"
 
 #define PROG_NAME "ssa-retime"
-#define DEFAULT_FPS 25.0
+#define DEFAULT_FPS 25
 #define TIME_MAXLEN 50
+#define FPS_MAX          1000000 /* max numerator & denominator of framerate */
+#define FPS_RATIO_MAX    1048576 /* same for ratio of them, see times_scale() */
+#define FPS_TARGETS_MAX  8
+#define FPS_LABEL_MAXLEN 32
+#define PATCH_BLOCK      (256 * 1024) /* in place: input changed by such pieces */
+#define PATCH_TIME_MAX   16 /* longest time field, that may be changed in place */
 
 #define MSG_O_NOTNEGATIVE _("%s can't be negative.")
-#define MSG_O_NOTTOGETHER _("Options '%s' and '%s' can't be used together.")
 #define MSG_W_TMLESSZERO  _("Negative timing! Was: %.3fs, offset: %.3fs")
+#define MSG_O_BADFPS      _("Incorrect framerate: '%s'. Should be like '25', '23.976' or '24000/1001'.")
 
 void usage(int exit_code)
 {
@@ -42,6 +51,9 @@ Modes are: \n\
   usage_common_opts();
   fputc('\n', stderr);
 
+  usage_ssa_input_opts();
+  fputc('\n', stderr);
+
   fprintf(stderr, _("\
 Events selectors (does not work in 'points' mode):\n\
   -S <string>       Retime only events with specified style.\n\
@@ -62,150 +74,194 @@ Specific options for 'shift' mode:\n\
 
   fprintf(stderr, _("\
 Specific options for 'framerate' mode:\n\
-  -f <float>        Source framerate. Default: %2.2f fps.\n\
-  -F <float>        Target framerate.\n"), DEFAULT_FPS);
+  -f <fps>          Source framerate. Default: %u fps.\n\
+  -F <fps>          Target framerate. May be given up to %u times: first\n\
+                    target goes to output file, others to files with\n\
+                    framerate added to output name, like 'out.24.ssa'.\n\
+                    Framerate is '25', '23.976' or '24000/1001'.\n"),
+                    DEFAULT_FPS, FPS_TARGETS_MAX);
   fputc('\n', stderr);
 
   fprintf(stderr, _("\
 Specific options for 'points' mode:\n\
   -p <time>::<time> Point of fixup & time shift in it. Option can be\n\
                     specified more than once. (see man for details)\n\
-                    Both args must be in form of [-][[h:]m:]s[.ms].\n"));
+                    Both args must be in form of [-][[h:]m:]s[.ms].\n\
+  -T <time>         Latest time in file, where last point is added.\n\
+                    Default: found in file (with '-m' input is read twice).\n"));
+  fputc('\n', stderr);
+
+  fprintf(stderr, _("\
+Other options:\n\
+  -m                Streaming mode: each event is written right after\n\
+                    it's read, file is never kept in memory whole.\n\
+                    Styles, defined after events, are ignored.\n\
+  -P                Patch mode: only times of events are changed, all\n\
+                    other text is kept as is. Without '-o' input file\n\
+                    is changed in place. Implies '-m'.\n"));
+  fputc('\n', stderr);
+
+  usage_batch_opts();
   fputc('\n', stderr);
 
   exit(exit_code);
 }
 
+/* sync points, sorted by position, without duplicates */
+struct pts
+  {
+    struct time_pt *pt;
+    size_t count;
+    size_t size;
+  };
+
 /** use this for debug */
 void
-dump_pts_list(struct time_pt *list)
+dump_pts_list(context * const ctx, struct pts const * const pts)
   {
-    uint8_t i = 1;
-    struct time_pt *l = NULL;
+    size_t i = 0;
 
-    log_msg(debug, "Points:");
-    log_msg(debug, "  # |    time    | shift");
+    log_msg(ctx, debug, "Points:");
+    log_msg(ctx, debug, "  # |    time    | shift");
 
-    for (l = list; l != NULL; l = l->next, i++)
-      log_msg(debug, "% 3u | % 10.3f : % 8.3f", i, l->pos, l->shift);
+    for (i = 0; i < pts->count; i++)
+      log_msg(ctx, debug, "% 3u | % 10.3f : % 8.3f", (unsigned) i + 1,
+              pts->pt[i].pos, pts->pt[i].shift);
+
+  }
 
+/* first point in [lo, hi) at or after 'time', or 'hi' */
+static size_t
+pts_bsearch(struct pts const * const pts, size_t lo, size_t hi, double time)
+  {
+    size_t mid = 0;
+
+    while (lo < hi)
+      {
+        mid = lo + (hi - lo) / 2;
+        if (time <= pts->pt[mid].pos)
+          hi = mid;
+        else
+          lo = mid + 1;
+      }
+
+    return lo;
+  }
+
+/* puts point to its place, keeps array sorted. *
+ * point with already known position is ignored */
+static bool
+pts_insert(struct pts * const pts, struct time_pt const * const t)
+  {
+    struct time_pt *p = NULL;
+    size_t i = pts_bsearch(pts, 0, pts->count, t->pos);
+
+    if (i < pts->count && pts->pt[i].pos == t->pos)
+      return false;
+
+    if (pts->count == pts->size)
+      {
+        pts->size = (pts->size == 0) ? 16 : pts->size * 2;
+        if ((p = realloc(pts->pt, pts->size * sizeof(struct time_pt))) == NULL)
+          log_msg(NULL, error, MSG_M_OOM, __FILE__, __LINE__);
+        pts->pt = p;
+      }
+
+    memmove(&pts->pt[i + 1], &pts->pt[i], (pts->count - i) * sizeof(struct time_pt));
+    pts->pt[i] = *t;
+    pts->count++;
+
+    return true;
   }
 
 bool
-add_point(struct time_pt **list, char * const s)
+add_point(context * const ctx, struct pts * const pts, char * const s)
   {
     uint8_t i;
     char *p = NULL;
-    struct time_pt **l = list;
-    struct time_pt *t = NULL;
+    struct time_pt t = { 0.0, 0.0 };
     char buf[TIME_MAXLEN];
 
     if (s == NULL)
       return false;
 
-    CALLOC(t, 1, sizeof(struct time_pt));
-
     /* parse time and shift */
     if ((p = strstr(s, "::")) == NULL)
-      log_msg(error, _("Incorrect option arg: %s"), s);
+      log_msg(ctx, error, _("Incorrect option arg: %s"), s);
 
     i = _strtok(s, "::");
 
     if (i >= TIME_MAXLEN)
-      log_msg(error, MSG_W_TXTNOTFITS, "");
+      log_msg(ctx, error, MSG_W_TXTNOTFITS, "");
 
     strncpy(buf, s, i);
-    buf[TIME_MAXLEN] = '\0'; /* as strncpy can not copy trailing '\0' */
+    buf[i] = '\0'; /* as strncpy can not copy trailing '\0' */
     p += 2;
 
     /* if parse failed, program exits */
-    parse_time(buf, &t->pos,   true);
-    parse_time(p,   &t->shift, true);
-
-    /* put new point to list */
-    if (*l == NULL)
-    {
-      *l = t;
-      return true;
-    }
-
-    while ((*l != NULL) && (t->pos > (*l)->pos))
-      l = &((*l)->next);
-
-    if (*l == NULL)
-    {
-      *l = t;
-      return true;
-    }
-
-    if (t->pos < (*l)->pos)
-    {
-      t->next = *l;
-      *l = t;
-      return true;
-    }
-
-    free(t);
+    parse_time(ctx, buf, &t.pos,   true);
+    parse_time(ctx, p,   &t.shift, true);
 
-    return false;
+    return pts_insert(pts, &t);
   }
 
 /*
  * validate points list.
  */
 bool
-validate_pts_list(struct time_pt **list, double max_time)
+validate_pts_list(context * const ctx, struct pts * const pts, double max_time)
   {
-    struct time_pt *l = NULL;
+    struct time_pt end = { 0.0, 0.0 };
 
-    if (*list == NULL)
-      log_msg(error, _("At least one point must be specified."));
+    if (pts->count == 0)
+      log_msg(ctx, error, _("At least one point must be specified."));
 
     /* add zero-time point as start of time */
-    add_point(list, "0::0");
+    add_point(ctx, pts, "0::0");
 
     /* add end point if needed */
-    for (l = *list; l != NULL && l->next != NULL; l = l->next);
-
-    if (l->pos < max_time)
+    if (pts->pt[pts->count - 1].pos < max_time)
       {
-        CALLOC(l->next, 1, sizeof(struct time_pt));
-        l->next->pos = max_time;
-        l->next->shift = 0.0;
-        log_msg(info, _("Auto added new point at pos %.3fs"), max_time);
+        end.pos = max_time;
+        pts_insert(pts, &end);
+        log_msg(ctx, info, _("Auto added new point at pos %.3fs"), max_time);
       }
 
     return true;
   }
 
-void
-adjust_timing(double * const d, double shift)
-  {
-    double t = *d;
-    *d += shift;
-    if (*d < 0.0)
-      {
-        log_msg(warn, MSG_W_TMLESSZERO, t, shift);
-        *d = 0.0;
-      }
-  }
-
-/* FIXME: still broken */
+/* Shifts 'time' by line between two points around it. '*a' is index *
+ * of right point, found for previous time, and the search starts    *
+ * from it: for sorted times it only steps forward, so all of them   *
+ * takes O(n + p). backward or far jumps use binary search instead.  */
 bool
-shift_by_pts(struct time_pt *list, double *time)
+shift_by_pts(struct pts const * const pts, size_t * const a, double *time)
   {
-    struct time_pt *pb = NULL; /* point before *time */
-    struct time_pt *pa = NULL; /* point after  *time */
+    struct time_pt const *pb = NULL; /* point before *time */
+    struct time_pt const *pa = NULL; /* point after  *time */
     double pct_len  = 0.0;
+    size_t i = *a, last = pts->count - 1;
+    uint8_t step = 0;
 
-    if (list == NULL || list->next == NULL)
+    if (pts->count < 2)
       return false;
 
-    pb = list;
-    pa = list->next;
+    if (i < 1 || i > last)
+      i = 1;
+
+    if (i > 1 && *time <= pts->pt[i - 1].pos)
+      i = pts_bsearch(pts, 1, i - 1, *time);
+    else
+      {
+        for (step = 0; step < 4 && i < last && *time > pts->pt[i].pos; step++)
+          i++;
+        if (i < last && *time > pts->pt[i].pos)
+          i = pts_bsearch(pts, i + 1, last, *time);
+      }
 
-    while ((*time > pa->pos) && (pa->next != NULL))
-      pb = pb->next, pa = pa->next;
+    *a = i;
+    pb = &pts->pt[i - 1];
+    pa = &pts->pt[i];
 
     /* video: 40s 47s    64s         *                     (47.0 - 40.0) *
      * |-------*---*------*-----|    * t += (-3.0 - 0.5) * ------------- *
@@ -217,33 +273,1144 @@ shift_by_pts(struct time_pt *list, double *time)
     return true;
   }
 
+/* '-S' filter for one file: bit per style id, so *
+ * names not compared for each event over and over */
+static uint8_t *
+styles_mask(ssa_file const * const file, struct slist *names)
+  {
+    uint8_t *mask = NULL;
+    uint16_t id = 0;
+
+    CALLOC(mask, file->style_index.count / 8 + 1, sizeof(uint8_t));
+
+    for (; names != NULL; names = names->next)
+      {
+        id = ssa_style_id(&file->style_index, names->value, strlen(names->value));
+        if (id != SSA_STYLE_UNKNOWN)
+          mask[id / 8] |= 1 << (id % 8);
+      }
+
+    return mask;
+  }
+
+static bool
+style_selected(uint8_t const *mask, struct slist *names, ssa_event const *e)
+  {
+    struct span str[4];
+
+    if (e->style_id != SSA_STYLE_UNKNOWN)
+      return (mask[e->style_id / 8] & (1 << (e->style_id % 8))) ? true : false;
+
+    /* style, not defined in file, can be selected only by name */
+    ssa_event_strs(e, str);
+    for (; names != NULL; names = names->next)
+      if (strlen(names->value) == str[0].len &&
+          memcmp(names->value, str[0].ptr, str[0].len) == 0)
+        return true;
+
+    return false;
+  }
+
+/* event times as arrays, so retime kernels below walk memory *
+ * sequentially instead of chasing list. 'sel' is -1 for      *
+ * events to change, 0 - for events to leave as is            */
+struct times
+  {
+    int32_t *start;
+    int32_t *end;
+    int32_t *sel;
+    size_t count;
+  };
+
+/* copies times of events to arrays, marks events selected by '-S' */
+static void
+times_load(struct times * const tm, ssa_file const * const file,
+           uint8_t const *mask, struct slist *names)
+  {
+    ssa_event const *e = NULL;
+    size_t i = 0;
+
+    tm->count = 0;
+    for (e = file->events; e != NULL; e = e->next)
+      tm->count++;
+
+    CALLOC(tm->start, tm->count * 3, sizeof(int32_t));
+    tm->end = tm->start + tm->count;
+    tm->sel = tm->end   + tm->count;
+
+    for (e = file->events; e != NULL; e = e->next, i++)
+      {
+        tm->start[i] = e->start;
+        tm->end[i]   = e->end;
+        tm->sel[i]   = (mask == NULL || style_selected(mask, names, e)) ? -1 : 0;
+      }
+  }
+
+/* puts changed times back to events, changed ones are *
+ * marked, so only they are formatted again on output   */
+static void
+times_store(struct times const * const tm, ssa_file * const file)
+  {
+    ssa_event *e = NULL;
+    size_t i = 0;
+
+    for (e = file->events; e != NULL; e = e->next, i++)
+      {
+        if (e->start != tm->start[i] || e->end != tm->end[i])
+          e->flags |= SSA_DIRTY;
+        e->start = tm->start[i], e->end = tm->end[i];
+      }
+  }
+
+/* for times_window_hit() */
+struct window
+  {
+    int32_t const *sel; /* selection by style */
+    int32_t *out;       /* the same, but only inside of window */
+  };
+
+static void
+times_window_hit(ssa_event_ivl const * const v, void *arg)
+  {
+    struct window *w = arg;
+
+    w->out[v->num] = w->sel[v->num];
+  }
+
+/* unselects events, which starts at or before 'lo' or at or *
+ * after 'hi'. only events inside window are looked at       */
+static void
+times_window(struct times * const tm, ssa_event_index const * const idx,
+             int32_t lo, int32_t hi)
+  {
+    struct window w;
+
+    w.sel = tm->sel;
+    CALLOC(w.out, tm->count, sizeof(int32_t));
+
+    if (lo < INT32_MAX)
+      ssa_event_index_starts(idx, lo + 1, hi, times_window_hit, &w);
+
+    memcpy(tm->sel, w.out, tm->count * sizeof(int32_t));
+    free(w.out);
+  }
+
+/* adds 'shift' (centiseconds) to selected times, *
+ * negative results are clamped to zero           */
+static void
+times_shift(context * const ctx, struct times * const tm, int32_t shift)
+  {
+    size_t i = 0;
+    int32_t t = 0, s = 0;
+#ifdef __SSE2__
+    __m128i v, d, sh = _mm_set1_epi32(shift);
+#endif
+
+    /* only warnings here, times are changed below */
+    if (shift < 0)
+      for (i = 0; i < tm->count; i++)
+        {
+          if (tm->sel[i] && tm->start[i] + shift < 0)
+            log_msg(ctx, warn, MSG_W_TMLESSZERO, tm->start[i] / 100.0, shift / 100.0);
+          if (tm->sel[i] && tm->end[i] + shift < 0)
+            log_msg(ctx, warn, MSG_W_TMLESSZERO, tm->end[i] / 100.0, shift / 100.0);
+        }
+
+    i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= tm->count; i += 4)
+      {
+        d = _mm_and_si128(sh, _mm_loadu_si128((__m128i const *) (tm->sel + i)));
+
+        v = _mm_add_epi32(_mm_loadu_si128((__m128i const *) (tm->start + i)), d);
+        v = _mm_andnot_si128(_mm_srai_epi32(v, 31), v);
+        _mm_storeu_si128((__m128i *) (tm->start + i), v);
+
+        v = _mm_add_epi32(_mm_loadu_si128((__m128i const *) (tm->end + i)), d);
+        v = _mm_andnot_si128(_mm_srai_epi32(v, 31), v);
+        _mm_storeu_si128((__m128i *) (tm->end + i), v);
+      }
+#endif
+
+    for (; i < tm->count; i++)
+      {
+        s = shift & tm->sel[i];
+        t = tm->start[i] + s, tm->start[i] = t & ~(t >> 31);
+        t = tm->end[i]   + s, tm->end[i]   = t & ~(t >> 31);
+      }
+  }
+
+/* framerate or ratio of them as exact fraction */
+struct fps
+  {
+    uint32_t num;
+    uint32_t den;
+  };
+
+static uint64_t
+fps_gcd(uint64_t a, uint64_t b)
+  {
+    uint64_t t = 0;
+
+    while (b != 0)
+      t = a % b, a = b, b = t;
+
+    return a;
+  }
+
+/* "25", "23.976" or "24000/1001". decimals, that differ from *
+ * N * 1000/1001 less than in last given digit, are taken as  *
+ * NTSC rates, so "23.976" & "29.97" are exact too            */
+static void
+parse_fps(context * const ctx, char const *s, struct fps * const fps)
+  {
+    char *end = NULL;
+    char const *p = NULL;
+    unsigned long num = 0, den = 1, frac = 0, n = 0;
+    uint8_t digits = 0;
+    uint64_t g = 0;
+    double v = 0.0;
+
+    if (!isdigit((unsigned char) *s))
+      log_msg(ctx, error, MSG_O_BADFPS, s);
+
+    num = strtoul(s, &end, 10);
+
+    if (*end == '/')
+      {
+        if (!isdigit((unsigned char) end[1]))
+          log_msg(ctx, error, MSG_O_BADFPS, s);
+        den = strtoul(end + 1, &end, 10);
+      }
+    else if (*end == '.')
+      {
+        for (p = end + 1; isdigit((unsigned char) *p) && digits < 6; p++, digits++)
+          frac = frac * 10 + (*p - '0'), den *= 10;
+        end = (char *) p;
+
+        v = num + (double) frac / den;
+        n = (unsigned long) round(v * 1.001);
+        num = num * den + frac;
+
+        if (frac != 0 && digits >= 2 && fabs(n / 1.001 - v) < 0.5 / den)
+          num = n * 1000, den = 1001;
+      }
+
+    if (*end != '\0' || num == 0 || den == 0 || num > FPS_MAX || den > FPS_MAX)
+      log_msg(ctx, error, MSG_O_BADFPS, s);
+
+    g = fps_gcd(num, den);
+    fps->num = num / g, fps->den = den / g;
+  }
+
+/* "25", "23.976" - for messages & file names */
+static char *
+fps_tos(struct fps const * const fps, char * const buf, size_t len)
+  {
+    char *p = NULL;
+
+    if (fps->den == 1)
+      {
+        snprintf(buf, len, "%lu", (unsigned long) fps->num);
+        return buf;
+      }
+
+    snprintf(buf, len, "%.3f", (double) fps->num / fps->den);
+    for (p = buf + strlen(buf) - 1; *p == '0'; p--)
+      *p = '\0';
+    if (*p == '.')
+      *p = '\0';
+
+    return buf;
+  }
+
+/* times multiplier to convert from 'src' to 'dst' framerate */
+static void
+fps_ratio(context * const ctx, struct fps const * const src,
+          struct fps const * const dst, struct fps * const ratio)
+  {
+    uint64_t num = (uint64_t) src->num * dst->den;
+    uint64_t den = (uint64_t) src->den * dst->num;
+    uint64_t g = fps_gcd(num, den);
+
+    num /= g, den /= g;
+
+    if (num > FPS_RATIO_MAX || den > FPS_RATIO_MAX)
+      log_msg(ctx, error, _("Ratio of framerates is too complex: %llu/%llu."),
+              (unsigned long long) num, (unsigned long long) den);
+
+    ratio->num = num, ratio->den = den;
+  }
+
+/* "dir/out.ssa" -> "dir/out.23.976.ssa" */
+static char *
+fps_outname(char const *name, struct fps const * const fps,
+            char * const buf, size_t len)
+  {
+    char const *dot = strrchr(name, '.');
+    char const *slash = strrchr(name, '/');
+    char label[FPS_LABEL_MAXLEN];
+
+    if (dot == NULL || (slash != NULL && dot < slash))
+      dot = name + strlen(name);
+
+    snprintf(buf, len, "%.*s.%s%s", (int) (dot - name), name,
+             fps_tos(fps, label, FPS_LABEL_MAXLEN), dot);
+
+    return buf;
+  }
+
+/* Exact multiplication of times by fraction: (2 * t * num + den) / (2 * den) *
+ * is t * num / den, rounded to nearest. with num & den up to FPS_RATIO_MAX  *
+ * dividend stays below 2^53, so it's exact in double & truncated quotient   *
+ * is exact too: double division is correctly rounded and the nearest       *
+ * non-integer quotient is far enough from integer. also this vectorizes.    */
+#ifdef __SSE2__
+/* 4 times * 'num' / 'den', not above INT32_MAX */
+static inline __m128i
+times_mul_sse2(__m128i v, __m128d num2, __m128d den, __m128d den2)
+  {
+    __m128d max = _mm_set1_pd(INT32_MAX);
+    __m128d lo = _mm_cvtepi32_pd(v);
+    __m128d hi = _mm_cvtepi32_pd(_mm_srli_si128(v, 8));
+
+    lo = _mm_div_pd(_mm_add_pd(_mm_mul_pd(lo, num2), den), den2);
+    hi = _mm_div_pd(_mm_add_pd(_mm_mul_pd(hi, num2), den), den2);
+    lo = _mm_min_pd(lo, max);
+    hi = _mm_min_pd(hi, max);
+
+    return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+  }
+#endif
+
+/* scalar version of the above, for one time */
+static inline int32_t
+time_mul(int32_t t, double num2, double den, double den2)
+  {
+    return (int32_t) fmin((t * num2 + den) / den2, INT32_MAX);
+  }
+
+/* multiplies selected times by 'ratio', rounding to *
+ * nearest centisecond. times are never negative here */
+static void
+times_scale(struct times * const tm, struct fps const * const ratio)
+  {
+    size_t i = 0;
+    int32_t sel = 0;
+    double num2 = 2.0 * ratio->num, den = ratio->den, den2 = 2.0 * ratio->den;
+#ifdef __SSE2__
+    __m128d n2 = _mm_set1_pd(num2), d = _mm_set1_pd(den), d2 = _mm_set1_pd(den2);
+    __m128i v, s;
+
+    for (; i + 4 <= tm->count; i += 4)
+      {
+        s = _mm_loadu_si128((__m128i const *) (tm->sel + i));
+
+        v = _mm_loadu_si128((__m128i const *) (tm->start + i));
+        v = _mm_or_si128(_mm_and_si128(s, times_mul_sse2(v, n2, d, d2)), _mm_andnot_si128(s, v));
+        _mm_storeu_si128((__m128i *) (tm->start + i), v);
+
+        v = _mm_loadu_si128((__m128i const *) (tm->end + i));
+        v = _mm_or_si128(_mm_and_si128(s, times_mul_sse2(v, n2, d, d2)), _mm_andnot_si128(s, v));
+        _mm_storeu_si128((__m128i *) (tm->end + i), v);
+      }
+#endif
+
+    for (; i < tm->count; i++)
+      {
+        sel = tm->sel[i];
+        tm->start[i] = (time_mul(tm->start[i], num2, den, den2) & sel) | (tm->start[i] & ~sel);
+        tm->end[i]   = (time_mul(tm->end[i],   num2, den, den2) & sel) | (tm->end[i]   & ~sel);
+      }
+  }
+
 enum { unset, framerate, shift, points } mode;
 
-extern struct options opts;
+/* options from command line, the same for all files */
+struct settings
+{
+  double shift_start;
+  double shift_end;
+  double time_shift;
+  struct fps src_fps;
+  struct fps dst_fps[FPS_TARGETS_MAX];
+  struct fps ratio[FPS_TARGETS_MAX]; /* times multiplier for each target */
+  uint8_t targets;
+  struct pts pts; /* without auto added end point */
+  double max_time; /* '-T': latest time of input, 0 - find it */
+  struct slist *affected_styles;
+  bool stream;     /* '-m': don't keep parsed file in memory */
+  bool patch;      /* '-P': change only times, keep other bytes */
+  char const *in_place; /* '-P' without '-o': input file name */
+};
+
+/* only times & style of events are needed to select & change *
+ * them, other fields are decoded for changed events only, on  *
+ * output. if all events are changed, all is decoded at once   */
+static uint8_t
+retime_fields(struct settings const * const set)
+  {
+    if (!set->patch && (mode == points || (set->shift_start == 0.0 &&
+        set->shift_end == 0.0 && set->affected_styles == NULL)))
+      return SSA_F_ALL;
+
+    return SSA_F_TIMES | ((set->affected_styles != NULL) ? SSA_F_STYLE : 0);
+  }
 
-uint32_t line_num = 0;
+/* Writes file once for each target framerate, all from one parse: *
+ * first to outfile, others to files, named after it. 'tm' keeps   *
+ * source times, so each target is converted from them             */
+static bool
+retime_fps(context * const ctx, struct settings const * const set,
+           ssa_file * const file, struct times * const tm)
+  {
+    int32_t *src = NULL;
+    char name[MAXLINE];
+    FILE *out = NULL;
+    bool result = true, last = false;
+    uint8_t i = 0;
 
-int main(int argc, char *argv[])
+    if (set->targets > 1)
+      {
+        if (ctx->opts.o_name == NULL)
+          log_msg(ctx, error, _("Several target framerates require output file name."));
+        CALLOC(src, tm->count * 2, sizeof(int32_t));
+        memcpy(src, tm->start, tm->count * 2 * sizeof(int32_t));
+      }
+
+    for (i = 0; i < set->targets && result; i++)
+      {
+        last = (i == set->targets - 1);
+        out = ctx->opts.outfile;
+
+        if (i > 0)
+          {
+            memcpy(tm->start, src, tm->count * 2 * sizeof(int32_t));
+            fps_outname(ctx->opts.o_name, &set->dst_fps[i], name, MAXLINE);
+            if ((out = fopen(name, "w")) == NULL)
+              {
+                free(src), free_ssa_file(file);
+                log_msg(ctx, error, MSG_F_OWRFAIL, name);
+              }
+          }
+
+        times_scale(tm, &set->ratio[i]);
+        times_store(tm, file);
+        result = write_ssa_file(ctx, out, file, last);
+
+        if (i > 0)
+          {
+            fclose(out);
+            if (!result)
+              unlink(name);
+          }
+      }
+
+    if (!last) /* write failed before last target */
+      free_ssa_file(file);
+
+    free(src);
+
+    return result;
+  }
+
+/* Streaming retime ('-m'): each event is changed and written right  *
+ * after it's parsed, so memory use does not depend on size of input */
+struct stream
+  {
+    struct settings const *set;
+    struct pts pts;        /* 'points': with start & end points */
+    size_t a_start, a_end; /* ...and hints for shift_by_pts()   */
+    int32_t shift;         /* 'shift': in centiseconds          */
+    uint8_t *mask;         /* see styles_mask()                 */
+    int32_t lo, hi;        /* events, that starts in (lo, hi), are changed */
+    outbuf out[FPS_TARGETS_MAX]; /* first is outfile, see retime_fps() */
+    FILE *files[FPS_TARGETS_MAX];
+    uint8_t outs;
+    bool events_head;      /* events section is written */
+    size_t count;          /* events seen */
+    /* patch mode, see convert_patch() */
+    int fd;                /* input */
+    off_t copied;          /* input is copied to outputs up to here */
+    bool in_place;         /* ...or input itself is changed */
+    bool check;            /* in place: only check, that new times fit */
+    bool fits;
+    char *blk;             /* in place: changed piece of input */
+    off_t blk_pos;
+    size_t blk_len;
+  };
+
+static void
+txt_params_free(ssa_file * const file)
+  {
+    struct slist *p = NULL;
+
+    while ((p = file->txt_params) != NULL)
+      {
+        file->txt_params = p->next;
+        free(p->value), free(p);
+      }
+  }
+
+/* the same checks, as in convert() & times_window() */
+static bool
+stream_selected(struct stream const * const st, ssa_event const * const e)
+  {
+    if (mode == points)
+      return true;
+
+    if (st->mask != NULL && !style_selected(st->mask, st->set->affected_styles, e))
+      return false;
+
+    return (st->lo < INT32_MAX && e->start > st->lo && e->start < st->hi);
+  }
+
+/* header & styles go to each output before first event, *
+ * so nothing is written for file without events          */
+static void
+stream_head(struct stream * const st, ssa_file * const file)
+  {
+    uint8_t i = 0;
+
+    for (i = 0; i < st->outs; i++)
+      {
+        write_ssa_header(&st->out[i], file, false);
+        if (file->styles)
+          write_ssa_styles(&st->out[i], file->styles, file->type, false);
+        st->events_head = write_ssa_events_head(&st->out[i], file->type);
+      }
+  }
+
+/* new times of event for target 'i', see convert() */
+static void
+stream_retime(context * const ctx, struct stream * const st,
+              ssa_event const * const e, uint8_t i,
+              int32_t * const start, int32_t * const end)
+  {
+    struct fps const *ratio = &st->set->ratio[i];
+    double time = 0.0;
+
+    *start = e->start, *end = e->end;
+
+    if (!stream_selected(st, e))
+      return;
+
+    switch (mode)
+      {
+        case shift :
+          if (st->shift < 0 && e->start + st->shift < 0)
+            log_msg(ctx, warn, MSG_W_TMLESSZERO, e->start / 100.0, st->shift / 100.0);
+          if (st->shift < 0 && e->end + st->shift < 0)
+            log_msg(ctx, warn, MSG_W_TMLESSZERO, e->end / 100.0, st->shift / 100.0);
+          *start = (e->start + st->shift < 0) ? 0 : e->start + st->shift;
+          *end   = (e->end   + st->shift < 0) ? 0 : e->end   + st->shift;
+          break;
+        case points :
+          time = e->start / 100.0;
+          shift_by_pts(&st->pts, &st->a_start, &time);
+          *start = double2cs(time);
+          time = e->end / 100.0;
+          shift_by_pts(&st->pts, &st->a_end, &time);
+          *end = double2cs(time);
+          break;
+        case framerate :
+          *start = time_mul(e->start, 2.0 * ratio->num, ratio->den, 2.0 * ratio->den);
+          *end   = time_mul(e->end,   2.0 * ratio->num, ratio->den, 2.0 * ratio->den);
+          break;
+        default :
+          break;
+      }
+  }
+
+static bool
+stream_event(context * const ctx, ssa_file * const file,
+             ssa_event * const e, void *arg)
+  {
+    struct stream *st = arg;
+    int32_t start = 0, end = 0, src_start = 0, src_end = 0;
+    uint8_t i = 0, flags = 0;
+
+    if (e == NULL) /* header & styles are complete */
+      {
+        if (st->set->affected_styles != NULL && mode != points && st->mask == NULL)
+          st->mask = styles_mask(file, st->set->affected_styles);
+        return true;
+      }
+
+    if (st->count++ == 0)
+      stream_head(st, file);
+
+    src_start = e->start, src_end = e->end, flags = e->flags;
+
+    for (i = 0; i < st->outs; i++)
+      {
+        e->start = src_start, e->end = src_end;
+        stream_retime(ctx, st, e, i, &start, &end);
+        e->start = start, e->end = end;
+        e->flags = (start != src_start || end != src_end) ? (flags | SSA_DIRTY) : flags;
+        if (st->events_head)
+          write_ssa_event(&st->out[i], e, file->type);
+      }
+
+    return true;
+  }
+
+/* for stream_max_time() */
+static bool
+stream_max_hit(context * const ctx, ssa_file * const file,
+               ssa_event * const e, void *arg)
+  {
+    int32_t *max_time = arg;
+
+    if (e != NULL)
+      {
+        if (*max_time < e->start) *max_time = e->start;
+        if (*max_time < e->end)   *max_time = e->end;
+      }
+
+    return true;
+  }
+
+/* 'points' mode needs the latest time of file before first event is *
+ * written, so input is read twice: this pass only looks for it and  *
+ * skips media. input, that can't be read again, requires '-T'       */
+static bool
+stream_max_time(context * const ctx, int32_t * const max_time)
+  {
+    ssa_file file;
+    int fd = fileno(ctx->opts.infile);
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+    verbosity level = ctx->opts.msglevel;
+    bool nomedia = ctx->opts.i_nomedia;
+    bool result = true;
+
+    if (pos < 0)
+      log_msg(ctx, error, _("Input can't be read twice, give the latest time in it with '-T'."));
+
+    init_ssa_file(&file);
+    file.event_fields = SSA_F_TIMES;
+    ctx->opts.i_nomedia = true;
+    if (ctx->opts.msglevel > error) /* they will be shown on second pass */
+      ctx->opts.msglevel = error;
+
+    result = stream_ssa_file(ctx, ctx->opts.infile, &file, stream_max_hit, max_time);
+
+    ctx->opts.msglevel = level, ctx->opts.i_nomedia = nomedia;
+    ctx->line_num = 0;
+    txt_params_free(&file);
+    free_ssa_file(&file);
+
+    if (lseek(fd, pos, SEEK_SET) < 0)
+      log_msg(ctx, error, MSG_F_RDFAIL, strerror(errno));
+
+    return result;
+  }
+
+/* outputs are opened before parsing, for each target framerate */
+static void
+stream_open(context * const ctx, struct stream * const st)
+  {
+    char name[MAXLINE];
+    uint8_t i = 0;
+
+    if (st->outs > 1 && ctx->opts.o_name == NULL)
+      log_msg(ctx, error, _("Several target framerates require output file name."));
+
+    for (i = 0; i < st->outs; i++)
+      {
+        st->files[i] = ctx->opts.outfile;
+        if (i > 0)
+          {
+            fps_outname(ctx->opts.o_name, &st->set->dst_fps[i], name, MAXLINE);
+            if ((st->files[i] = fopen(name, "w")) == NULL)
+              log_msg(ctx, error, MSG_F_OWRFAIL, name);
+          }
+        if (!outbuf_open(&st->out[i], ctx, st->files[i]))
+          log_msg(ctx, error, MSG_F_WRFAIL);
+      }
+  }
+
+/* on failure unfinished outputs of extra targets are removed */
+static void
+stream_close(context * const ctx, struct stream * const st, bool ok)
+  {
+    char name[MAXLINE];
+    uint8_t i = 0;
+
+    for (i = 0; i < st->outs; i++)
+      {
+        if (!ok)
+          st->out[i].used = 0;
+        outbuf_close(&st->out[i]);
+        if (i == 0 || st->files[i] == NULL)
+          continue;
+        fclose(st->files[i]);
+        if (!ok)
+          unlink(fps_outname(ctx->opts.o_name, &st->set->dst_fps[i], name, MAXLINE));
+      }
+  }
+
+/* settings for one file, the same as in convert() */
+static bool
+stream_init(context * const ctx, struct settings const * const set,
+            struct stream * const st)
+  {
+    int32_t max_time = 0;
+    /* limits in centiseconds, but with ms precision of command line */
+    double from = round(set->shift_start * 1000.0) / 10.0;
+    double to   = round(set->shift_end   * 1000.0) / 10.0;
+
+    memset(st, 0, sizeof(struct stream));
+    st->set = set;
+    st->a_start = st->a_end = 1;
+    st->shift = double2cs(set->time_shift);
+    st->lo = (from < INT32_MAX) ? (int32_t) floor(from) : INT32_MAX;
+    st->hi = (set->shift_end != 0.0 && to < INT32_MAX) ? (int32_t) ceil(to) : INT32_MAX;
+    st->outs = (mode == framerate) ? set->targets : 1;
+
+    if (mode != points)
+      return true;
+
+    if (set->max_time > 0.0)
+      max_time = double2cs(set->max_time);
+    else if (!stream_max_time(ctx, &max_time))
+      return false;
+
+    st->pts.size = set->pts.count + 2;
+    CALLOC(st->pts.pt, st->pts.size, sizeof(struct time_pt));
+    memcpy(st->pts.pt, set->pts.pt, set->pts.count * sizeof(struct time_pt));
+    st->pts.count = set->pts.count;
+
+    validate_pts_list(ctx, &st->pts, max_time / 100.0 + 0.001);
+    dump_pts_list(ctx, &st->pts);
+
+    return true;
+  }
+
+static bool
+convert_stream(context * const ctx, struct settings const * const set)
 {
-  char opt;
-  char *m;
+  struct stream st;
+  ssa_file file;
+  bool parsed = true;
+  uint8_t i = 0;
+
+  if (!stream_init(ctx, set, &st))
+    return false;
+
+  stream_open(ctx, &st);
+
+  init_ssa_file(&file);
+  file.event_fields = retime_fields(set);
+  parsed = stream_ssa_file(ctx, ctx->opts.infile, &file, stream_event, &st);
+
+  for (i = 0; i < st.outs && parsed && st.count > 0; i++)
+    {
+      if (st.events_head)
+        outbuf_putc(&st.out[i], '\n');
+      if (file.fonts)
+        write_ssa_media(&st.out[i], file.fonts, i == st.outs - 1);
+      if (file.images)
+        write_ssa_media(&st.out[i], file.images, i == st.outs - 1);
+    }
+
+  stream_close(ctx, &st, parsed);
+
+  txt_params_free(&file);
+  free_ssa_file(&file);
+  free(st.mask);
+  free(st.pts.pt);
+
+  if (parsed && st.count == 0)
+    log_msg(ctx, error, _("There is no events in this file, nothing to do."));
+
+  return parsed && st.events_head; /* as write_ssa_file() does */
+}
+
+/* common end of convert_patch() */
+static bool
+patch_done(context * const ctx, struct stream * const st, bool nomedia, bool result)
+  {
+    ctx->opts.i_nomedia = nomedia;
+    free(st->mask);
+    free(st->pts.pt);
+
+    if (result && st->count == 0)
+      log_msg(ctx, error, _("There is no events in this file, nothing to do."));
+
+    return result;
+  }
+
+/* 'cs' as "H:MM:SS.CC", like outbuf_time() does. if 'width' isn't 0, *
+ * hours are padded with zeroes up to it, 0 returned for wider time   */
+static size_t
+time_format(char * const buf, int32_t cs, size_t width)
+  {
+    char tmp[PATCH_TIME_MAX];
+    char *p = tmp + PATCH_TIME_MAX;
+    int32_t i = 0;
+    size_t len = 0;
+
+    if (cs < 0)
+      cs = 0;
+
+    i = cs % 100, cs /= 100;
+    *(--p) = '0' + i % 10, *(--p) = '0' + i / 10, *(--p) = '.';
+    i = cs % 60, cs /= 60;
+    *(--p) = '0' + i % 10, *(--p) = '0' + i / 10, *(--p) = ':';
+    i = cs % 60, cs /= 60;
+    *(--p) = '0' + i % 10, *(--p) = '0' + i / 10, *(--p) = ':';
+    do
+      *(--p) = '0' + cs % 10, cs /= 10;
+    while (cs > 0);
+
+    len = tmp + PATCH_TIME_MAX - p;
+    if (width > PATCH_TIME_MAX || len > width)
+      {
+        if (width != 0)
+          return 0;
+      }
+    else
+      for (; len < width; len++)
+        *(--p) = '0';
+
+    memcpy(buf, p, len);
+
+    return len;
+  }
+
+/* in place: input is changed by blocks, which are read, changed and *
+ * written back, when change past the current block comes. parser is *
+ * always past the block then, so it never sees changed data         */
+static void
+patch_flush(context * const ctx, struct stream * const st)
+  {
+    if (st->blk_len > 0 &&
+        pwrite(st->fd, st->blk, st->blk_len, st->blk_pos) != (ssize_t) st->blk_len)
+      log_msg(ctx, error, MSG_F_WRFAIL);
+
+    st->blk_len = 0;
+  }
+
+static void
+patch_in_place(context * const ctx, struct stream * const st,
+               off_t pos, char const *buf, size_t len)
+  {
+    ssize_t got = 0;
+
+    if (st->blk_len > 0 && pos + len > st->blk_pos + st->blk_len)
+      patch_flush(ctx, st);
+
+    if (st->blk_len == 0)
+      {
+        if ((got = pread(st->fd, st->blk, PATCH_BLOCK, pos)) < (ssize_t) len)
+          log_msg(ctx, error, MSG_F_RDFAIL,
+                  (got < 0) ? strerror(errno) : _("unexpected end of file"));
+        st->blk_pos = pos, st->blk_len = got;
+      }
+
+    memcpy(st->blk + (pos - st->blk_pos), buf, len);
+  }
+
+/* Replaces time field 'old' at 'pos' in input with 'cs[i]' in each *
+ * output. input before it is copied as is, unchanged time is kept  *
+ * as it was written, new one takes the same width, if it can.      */
+static bool
+patch_time(context * const ctx, struct stream * const st,
+           struct span const * const old, off_t pos,
+           int32_t src, int32_t const *cs)
+  {
+    char buf[PATCH_TIME_MAX];
+    size_t len = 0, gap = pos - st->copied;
+    uint8_t i = 0;
+
+    if (st->in_place)
+      {
+        if (cs[0] == src)
+          return true;
+        len = time_format(buf, cs[0], old->len);
+        if (st->check)
+          st->fits &= (len > 0);
+        else
+          patch_in_place(ctx, st, pos, buf, len);
+        return true;
+      }
+
+    for (i = 0; i < st->outs; i++)
+      {
+        outbuf_put(&st->out[i], old->ptr - gap, gap);
+        if (cs[i] == src)
+          {
+            outbuf_put(&st->out[i], old->ptr, old->len);
+            continue;
+          }
+        if ((len = time_format(buf, cs[i], old->len)) == 0)
+          len = time_format(buf, cs[i], 0);
+        outbuf_put(&st->out[i], buf, len);
+      }
+
+    st->copied = pos + old->len;
+
+    return true;
+  }
+
+static bool
+stream_patch(context * const ctx, ssa_file * const file,
+             ssa_event * const e, void *arg)
+  {
+    struct stream *st = arg;
+    ssa_event_src const *src = &file->src;
+    int32_t times[2][FPS_TARGETS_MAX];
+    int32_t old[2];
+    uint8_t i = 0, k = 0, first = 0;
+
+    if (e == NULL) /* for '-S' */
+      return stream_event(ctx, file, e, arg);
+
+    st->count++;
+    old[0] = e->start, old[1] = e->end;
+
+    for (i = 0; i < st->outs; i++)
+      stream_retime(ctx, st, e, i, &times[0][i], &times[1][i]);
+
+    /* input goes forward, fields too: 'End' may be before 'Start' */
+    first = (src->times[1].ptr < src->times[0].ptr);
+    for (i = 0; i < 2; i++)
+      {
+        k = i ^ first;
+        patch_time(ctx, st, &src->times[k],
+                   src->offset + (src->times[k].ptr - src->line.ptr),
+                   old[k], times[k]);
+      }
+
+    return true;
+  }
+
+/* one more pass over input for patch mode */
+static bool
+patch_pass(context * const ctx, struct stream * const st,
+           ssa_event_f fn, verbosity level)
+  {
+    ssa_file file;
+    verbosity saved = ctx->opts.msglevel;
+    bool result = true;
+
+    st->a_start = st->a_end = 1;
+    st->copied = 0, st->count = 0;
+    ctx->line_num = 0;
+    if (ctx->opts.msglevel > level)
+      ctx->opts.msglevel = level;
+
+    init_ssa_file(&file);
+    file.event_fields = retime_fields(st->set);
+    result = stream_ssa_file(ctx, ctx->opts.infile, &file, fn, st);
+
+    ctx->opts.msglevel = saved;
+    txt_params_free(&file);
+    free_ssa_file(&file);
+
+    return result;
+  }
+
+/* Patch mode ('-P'): output is input, where only changed times are *
+ * replaced, all other bytes are copied. without output file input  *
+ * is changed in place, if all new times fit in old fields, and    *
+ * is rewritten via temporary file otherwise                        */
+static bool
+convert_patch(context * const ctx, struct settings const * const set)
+{
+  struct stream st;
+  struct stat sb;
+  FILE *outfile = ctx->opts.outfile;
+  char tmpname[MAXLINE];
+  int tmpfd = -1;
+  bool nomedia = ctx->opts.i_nomedia;
+  bool result = true;
+  uint8_t i = 0;
+
+  if (!stream_init(ctx, set, &st))
+    return false;
+
+  st.fd = fileno(ctx->opts.infile);
+  if (fstat(st.fd, &sb) != 0 || !S_ISREG(sb.st_mode))
+    {
+      free(st.pts.pt);
+      log_msg(ctx, error, _("Patch mode requires regular input file."));
+    }
+
+  ctx->opts.i_nomedia = true; /* media are copied as is */
+
+  if (set->in_place != NULL)
+    {
+      st.in_place = st.check = st.fits = true;
+      result = patch_pass(ctx, &st, stream_patch, ctx->opts.msglevel);
+
+      if (result && st.fits && st.count > 0)
+        {
+          st.check = false;
+          CALLOC(st.blk, PATCH_BLOCK, sizeof(char));
+          /* messages were shown on first pass */
+          if ((result = patch_pass(ctx, &st, stream_patch, error)) == true)
+            patch_flush(ctx, &st);
+          free(st.blk);
+        }
+
+      if (!result || st.fits || st.count == 0)
+        return patch_done(ctx, &st, nomedia, result);
+
+      log_msg(ctx, info, _("New times don't fit in place, file is rewritten."));
+      snprintf(tmpname, MAXLINE, "%s.XXXXXX", set->in_place);
+      if ((tmpfd = mkstemp(tmpname)) < 0 ||
+          (ctx->opts.outfile = fdopen(tmpfd, "w")) == NULL)
+        log_msg(ctx, error, MSG_F_OWRFAIL, tmpname);
+      fchmod(tmpfd, sb.st_mode & 07777);
+      st.in_place = false;
+    }
+
+  stream_open(ctx, &st);
+
+  result = patch_pass(ctx, &st, stream_patch, (tmpfd < 0) ? ctx->opts.msglevel : error);
+
+  for (i = 0; i < st.outs && result; i++)
+    outbuf_copy(&st.out[i], st.fd, st.copied, sb.st_size - st.copied);
+
+  stream_close(ctx, &st, result);
+
+  if (tmpfd >= 0)
+    {
+      fclose(ctx->opts.outfile);
+      ctx->opts.outfile = outfile;
+      if (result && rename(tmpname, set->in_place) != 0)
+        log_msg(ctx, error, MSG_F_OWRFAIL, set->in_place);
+      if (!result)
+        unlink(tmpname);
+    }
+
+  return patch_done(ctx, &st, nomedia, result);
+}
+
+/* retimes ctx->opts.infile to ctx->opts.outfile */
+static bool
+convert(context * const ctx, void *arg)
+{
+  struct settings const *set = arg;
   ssa_file file;
   ssa_event *e = NULL;
+  struct pts pts = { NULL, 0, 0 };
+  struct times tm;
+  ssa_event_index idx;
+  int32_t max_time = 0;
+  /* limits in centiseconds, but with ms precision of command line */
+  double from = round(set->shift_start * 1000.0) / 10.0;
+  double to   = round(set->shift_end   * 1000.0) / 10.0;
+  double time = 0.0;
+  bool result = true;
+  uint8_t *mask = NULL;
+  size_t i = 0, a_start = 1, a_end = 1;
+
+  if (set->patch)
+    return convert_patch(ctx, set);
+  if (set->stream)
+    return convert_stream(ctx, set);
 
-  double shift_start  = 0.0;
-  double shift_end    = 0.0;
-  double shift_lenght = 0.0;
-  double time_shift = 0.0; /* used in all modes */
+  init_ssa_file(&file);
+  file.event_fields = retime_fields(set);
+  if (!parse_ssa_file(ctx, ctx->opts.infile, &file))
+    return false;
+
+  if ((e = file.events) == NULL)
+    log_msg(ctx, error, _("There is no events in this file, nothing to do."));
+
+  if (set->affected_styles != NULL && mode != points)
+    mask = styles_mask(&file, set->affected_styles);
+
+  times_load(&tm, &file, mask, set->affected_styles);
+
+  if (mode != points && (set->shift_start != 0.0 || set->shift_end != 0.0))
+    {
+      ssa_event_index_build(&file, &idx);
+      times_window(&tm, &idx, (from < INT32_MAX) ? (int32_t) floor(from) : INT32_MAX,
+                   (set->shift_end != 0.0 && to < INT32_MAX) ? (int32_t) ceil(to) : INT32_MAX);
+    }
+  else if (mode != points)
+    /* no limits - window is the whole file, without index. *
+     * but events at 0:00 are never retimed, as there      */
+    for (i = 0; i < tm.count; i++)
+      if (tm.start[i] <= 0)
+        tm.sel[i] = 0;
+
+  switch (mode)
+  {
+    case shift :
+      times_shift(ctx, &tm, double2cs(set->time_shift));
+      break;
+    case framerate :
+      result = retime_fps(ctx, set, &file, &tm);
+      break;
+    case points :
+      /* start & end points depends on file, so use own copy of list */
+      pts.size = set->pts.count + 2;
+      CALLOC(pts.pt, pts.size, sizeof(struct time_pt));
+      memcpy(pts.pt, set->pts.pt, set->pts.count * sizeof(struct time_pt));
+      pts.count = set->pts.count;
+
+      if (set->max_time > 0.0)
+        max_time = double2cs(set->max_time);
+      else
+        for (i = 0; i < tm.count; i++)
+          {
+            if (max_time < tm.start[i]) max_time = tm.start[i];
+            if (max_time < tm.end[i])   max_time = tm.end[i];
+          }
+
+      validate_pts_list(ctx, &pts, max_time / 100.0 + 0.001);
+      dump_pts_list(ctx, &pts);
+
+      for (i = 0; i < tm.count; i++)
+        {
+          time = tm.start[i] / 100.0;
+          shift_by_pts(&pts, &a_start, &time);
+          tm.start[i] = double2cs(time);
+          time = tm.end[i] / 100.0;
+          shift_by_pts(&pts, &a_end, &time);
+          tm.end[i] = double2cs(time);
+        }
+      break;
+    default :
+      break;
+  }
 
-  double src_fps = 0.0;
-  double dst_fps = 0.0;
-  double multiplier = 0.0;
+  if (mode != framerate)
+    {
+      times_store(&tm, &file);
+      result = write_ssa_file(ctx, ctx->opts.outfile, &file, true);
+    }
 
-  struct time_pt *pts_list = NULL;
-  double max_time = 0.0;
+  free(tm.start);
+  free(mask);
+
+  free(pts.pt);
+
+  return result;
+}
 
-  struct slist *affected_styles = NULL;
+int main(int argc, char *argv[])
+{
+  char opt;
+  char *m;
+  struct settings set;
+  context ctx;
+  char *batch = NULL;
+  char *i_name = NULL;
+  uint8_t jobs = 0;
+  int k = 0;
+
+  double shift_lenght = 0.0;
+  char label[FPS_LABEL_MAXLEN];
+  uint8_t i = 0;
 
+  memset(&set, 0, sizeof(struct settings));
+  context_init(&ctx);
   mode = unset;
 
   if (argc >= 4)
@@ -257,52 +1424,80 @@ int main(int argc, char *argv[])
     }
   else usage(EXIT_FAILURE);
 
-  while ((opt = getopt(argc, argv, "qvhi:o:" "S:" "f:F:" "p:" "t:s:e:l:")) != -1)
+  while ((opt = getopt(argc, argv, "qvhi:o:" "b:j:" "MR:" "mP" "S:" "f:F:" "p:T:" "t:s:e:l:")) != -1)
     {
       switch(opt)
         {
           case 'q':
           case 'v':
-            msglevel_change(&opts.msglevel, (opt == 'q') ? '-' : '+');
+            msglevel_change(&ctx.opts.msglevel, (opt == 'q') ? '-' : '+');
             break;
           case 'i':
-            if ((opts.infile = fopen(optarg, "r")) == NULL)
-              log_msg(error, MSG_F_ORDFAIL, optarg);
+            if ((ctx.opts.infile = fopen(optarg, "r")) == NULL)
+              log_msg(&ctx, error, MSG_F_ORDFAIL, optarg);
+            i_name = optarg;
             break;
           case 'o':
-            if ((opts.outfile = fopen(optarg, "w")) == NULL)
+            if ((ctx.opts.outfile = fopen(optarg, "w")) == NULL)
               {
-                log_msg(warn, MSG_F_OWRFAILSO, optarg);
-                opts.outfile = stdout;
+                log_msg(&ctx, warn, MSG_F_OWRFAILSO, optarg);
+                ctx.opts.outfile = stdout;
               }
+            else
+              ctx.opts.o_name = optarg;
+            break;
+          case 'b':
+            batch = optarg;
+            break;
+          case 'j':
+            if ((k = atoi(optarg)) < 0 || k > BATCH_THREADS_MAX)
+              log_msg(&ctx, error, MSG_O_OOR, "-j");
+            jobs = k;
+            break;
+          case 'M':
+            ctx.opts.i_nomedia = true;
+            break;
+          case 'R':
+            ctx.opts.i_store = optarg;
+            break;
+          case 'm':
+            set.stream = true;
+            break;
+          case 'P':
+            set.patch = true;
             break;
 
           case 'S':
-            slist_add(&affected_styles, optarg);
+            slist_add(&set.affected_styles, optarg);
             break;
 
           case 'f':
-            src_fps = atof(optarg);
+            parse_fps(&ctx, optarg, &set.src_fps);
             break;
           case 'F':
-            dst_fps = atof(optarg);
+            if (set.targets == FPS_TARGETS_MAX)
+              log_msg(&ctx, error, _("Too many target framerates, max: %u."), FPS_TARGETS_MAX);
+            parse_fps(&ctx, optarg, &set.dst_fps[set.targets++]);
             break;
 
           case 'p':
-            add_point(&pts_list, optarg);
+            add_point(&ctx, &set.pts, optarg);
+            break;
+          case 'T':
+            parse_time(&ctx, optarg, &set.max_time, true);
             break;
 
           case 't':
-            parse_time(optarg, &time_shift, true);
+            parse_time(&ctx, optarg, &set.time_shift, true);
             break;
           case 's':
-            parse_time(optarg, &shift_start, true);
+            parse_time(&ctx, optarg, &set.shift_start, true);
             break;
           case 'e':
-            parse_time(optarg, &shift_end, true);
+            parse_time(&ctx, optarg, &set.shift_end, true);
             break;
           case 'l':
-            parse_time(optarg, &shift_lenght, true);
+            parse_time(&ctx, optarg, &shift_lenght, true);
             break;
 
           case 'h':
@@ -312,112 +1507,87 @@ int main(int argc, char *argv[])
         }
     }
 
-  /* args checks */
-  common_checks(&opts);
-
-  /* init */
-  init_ssa_file(&file);
-  if (!parse_ssa_file(opts.infile, &file))
-    log_msg(error, MSG_U_UNKNOWN);
-
-  fclose(opts.infile);
-
-  if ((e = file.events) == NULL)
-    log_msg(error, _("There is no events in this file, nothing to do."));
-
   /* set some variables and check options */
   if (mode != points)
     {
-      if (shift_start < 0.0)
-        log_msg(error, MSG_O_NOTNEGATIVE, _("Period start"));
-      if (shift_end   < 0.0)
-        log_msg(error, MSG_O_NOTNEGATIVE, _("Period end"));
-      if (shift_end != 0.0 && shift_end < shift_start)
-        log_msg(error, MSG_O_NOTNEGATIVE, _("Period duration"));
+      if (set.shift_start < 0.0)
+        log_msg(&ctx, error, MSG_O_NOTNEGATIVE, _("Period start"));
+      if (set.shift_end   < 0.0)
+        log_msg(&ctx, error, MSG_O_NOTNEGATIVE, _("Period end"));
+      if (set.shift_end != 0.0 && set.shift_end < set.shift_start)
+        log_msg(&ctx, error, MSG_O_NOTNEGATIVE, _("Period duration"));
       if (shift_lenght < 0.0)
-        log_msg(error, MSG_O_NOTNEGATIVE, _("Shift offset"));
-      if (shift_end != 0.0 && shift_lenght != 0.0)
-        log_msg(error, MSG_O_NOTTOGETHER, "-l", "-e");
+        log_msg(&ctx, error, MSG_O_NOTNEGATIVE, _("Shift offset"));
+      if (set.shift_end != 0.0 && shift_lenght != 0.0)
+        log_msg(&ctx, error, MSG_O_NOTTOGETHER, "-l", "-e");
     }
 
   if (mode == shift)
     {
-      if (time_shift == 0.0)
-        log_msg(error, MSG_O_OREQUIRED, "-t");
+      if (set.time_shift == 0.0)
+        log_msg(&ctx, error, MSG_O_OREQUIRED, "-t");
 
       if (shift_lenght != 0.0)
-        shift_end = shift_start + shift_lenght;
+        set.shift_end = set.shift_start + shift_lenght;
     }
 
   if (mode == framerate)
     {
       /* checks */
-      if (src_fps == 0.0)
+      if (set.src_fps.num == 0)
         {
-          m = _("No option '-f' given. Assuming source framerate = %2.2f");
-          log_msg(warn, m, DEFAULT_FPS);
-          src_fps = DEFAULT_FPS;
+          m = _("No option '-f' given. Assuming source framerate = %u");
+          log_msg(&ctx, warn, m, DEFAULT_FPS);
+          set.src_fps.num = DEFAULT_FPS, set.src_fps.den = 1;
         }
-      if (dst_fps == 0.0)
-        log_msg(error, MSG_O_OREQUIRED, "-F");
-      if (src_fps < 0.0)
-        log_msg(error, MSG_O_NOTNEGATIVE, _("Source framerate"));
-      if (dst_fps < 0.0)
-        log_msg(error, MSG_O_NOTNEGATIVE, _("Target framerate"));
-      if (src_fps == dst_fps && src_fps != 0.0)
-        log_msg(error, _("Framerates are equal. Nothing to do."));
+      if (set.targets == 0)
+        log_msg(&ctx, error, MSG_O_OREQUIRED, "-F");
+      if (set.targets > 1 && batch == NULL && ctx.opts.o_name == NULL)
+        log_msg(&ctx, error, _("Several target framerates require output file name."));
 
       /* work */
-      multiplier = (double) src_fps / (double) dst_fps;
-    }
-
-  if (mode == points)
-    {
-      for (e = file.events; e != NULL; e = e->next)
+      for (i = 0; i < set.targets; i++)
         {
-          if (max_time < e->start) max_time = e->start;
-          if (max_time < e->end)   max_time = e->end;
+          if (set.src_fps.num == set.dst_fps[i].num &&
+              set.src_fps.den == set.dst_fps[i].den)
+            log_msg(&ctx, error, _("Framerates are equal. Nothing to do."));
+          fps_ratio(&ctx, &set.src_fps, &set.dst_fps[i], &set.ratio[i]);
+          log_msg(&ctx, info, _("Target framerate: %s fps, times multiplied by %lu/%lu"),
+                  fps_tos(&set.dst_fps[i], label, FPS_LABEL_MAXLEN),
+                  (unsigned long) set.ratio[i].num, (unsigned long) set.ratio[i].den);
         }
-
-      validate_pts_list(&pts_list, max_time + 0.001);
-      dump_pts_list(pts_list);
     }
 
-  for (e = file.events; e != NULL; e = e->next)
-  {
-    if (mode != points)
-    {
-      if ((affected_styles != NULL) && \
-          (slist_match(affected_styles, e->style) == false))
-        continue;
+  if (mode == points && set.pts.count == 0)
+    log_msg(&ctx, error, _("At least one point must be specified."));
 
-      if ((e->start <= shift_start) || \
-          (shift_end != 0.0 && e->start >= shift_end))
-        continue;
+  /* patch without output file: input is changed in place */
+  if (set.patch && batch == NULL && ctx.opts.infile != NULL && ctx.opts.outfile == NULL)
+    {
+      if (set.targets > 1)
+        log_msg(&ctx, error, _("Several target framerates require output file name."));
+      if ((ctx.opts.infile = freopen(i_name, "r+", ctx.opts.infile)) == NULL)
+        log_msg(&ctx, error, MSG_F_OWRFAIL, i_name);
+      set.in_place = i_name;
+      ctx.opts.outfile = stdout; /* nothing is written here */
     }
 
-    switch (mode)
+  if (batch != NULL)
     {
-      case shift :
-        adjust_timing(&e->start, time_shift);
-        adjust_timing(&e->end,   time_shift);
-        break;
-      case framerate :
-        e->start *= multiplier;
-        e->end   *= multiplier;
-        break;
-      case points :
-        shift_by_pts(pts_list, &e->start);
-        shift_by_pts(pts_list, &e->end);
-        break;
-      default :
-        break;
+      if (ctx.opts.infile != NULL || ctx.opts.outfile != NULL)
+        log_msg(&ctx, error, MSG_O_NOTWITHB);
+      /* no default output name, input is ssa already */
+      exit(batch_run(&ctx, batch, NULL, jobs, convert, &set) ? EXIT_SUCCESS : EXIT_FAILURE);
     }
-  }
 
-  write_ssa_file(opts.outfile, &file, true);
+  /* args checks */
+  common_checks(&ctx);
+
+  if (!convert(&ctx, &set) && !ctx.failed)
+    log_msg(&ctx, error, MSG_U_UNKNOWN);
 
-  fclose(opts.outfile);
+  fclose(ctx.opts.infile);
+  fclose(ctx.opts.outfile);
 
-  return 0;
+  return (ctx.failed) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
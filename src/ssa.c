@@ -15,7 +15,14 @@
  */
 
 #include "common.h"
+#include "arena.h"
+#include "reader.h"
+#include "outbuf.h"
+#include "sort.h"
 #include "ssa.h"
+#include "uue.h"
+#include "store.h"
+#include "cache.h"
 
 #define MSG_W_WRONGFORDER   _("Wrong fields order in %s.")
 #define MSG_W_UNRECFIELD    _("Unrecognized field '%s'.")
@@ -25,9 +32,7 @@
 #define MSG_W_SKIPEPARAM    _("Skipping parameter '%s' with empty value at line '%u'.")
 
 /* variables */
-extern uint32_t line_num;
 extern struct unicode_test BOMs[6];
-extern struct options opts;
 
 /* to use from outer space :-) */
 int8_t fields_order[MAX_FIELDS] = { 0 };
@@ -69,6 +74,9 @@ ssa_file ssa_file_template =
     (struct slist *) 0,
 
     0x0, /* flags */
+    SSA_F_ALL, /* event fields to decode */
+    NULL, /* header source */
+    0,    /* ...and length */
 
     /** arrays */
     { 0 }, /* style field order */
@@ -78,7 +86,19 @@ ssa_file ssa_file_template =
     (ssa_style *) 0, /* styles list */
     (ssa_event *) 0, /* events list */
     (ssa_media *) 0, /* fonts list  */
-    (ssa_media *) 0  /* images list */
+    (ssa_media *) 0, /* images list */
+
+    (ssa_event_rec *) 0, /* compiled events  */
+    0,                   /* ...their number  */
+    NULL,                /* ...their strings */
+    0,                   /* ...and length    */
+
+    (ssa_style **) 0,   /* styles list tail */
+    { NULL, 0, 0 },     /* styles index     */
+    { { NULL, 0 }, { { NULL, 0 }, { NULL, 0 } }, 0 }, /* event source */
+    NULL,               /* kept input       */
+
+    { NULL }         /* memory arena */
   };
 
 ssa_style ssa_style_template =
@@ -109,25 +129,344 @@ ssa_style ssa_style_template =
     10,        /* margin right  */
     20,        /* margin bottom */
     0,         /* alpha level */
-    0          /* 0 - ansi, 204 - russian */
+    0,         /* 0 - ansi, 204 - russian */
+    SSA_STYLE_UNKNOWN, /* id, set by ssa_style_add() */
+    0x0,       /* flags */
+    NULL       /* source line */
   };
 
+/* designated, so fields may be reordered in struct safely */
 ssa_event ssa_event_template =
 {
-    (ssa_event *) 0,
-    DIALOGUE,  /* event type */
-    0,         /* layer    */
-    0.0,       /* start    */
-    0.0,       /* end      */
-    NULL,      /* style    */
-    NULL,      /* name     */
-    0,         /* margin_r */
-    0,         /* margin_l */
-    0,         /* margin_l */
-    NULL,      /* effect   */
-    NULL       /* text     */
+    .style_id = SSA_STYLE_UNKNOWN, /* till resolved by name */
+    .type     = DIALOGUE,
+    .fields   = SSA_F_ALL          /* nothing to decode lazily */
 };
 
+/* part of [Events] section, parsed by one thread */
+struct events_job
+  {
+    struct span chunk;     /* line-aligned, whole lines only   */
+    char const *section;   /* start of section & it's line num */
+    uint32_t section_line; /* ...needed only for warnings      */
+    uint32_t lines;        /* lines in chunk, counted by thread */
+    int8_t *fieldlist;
+    uint8_t fields;        /* to decode, SSA_F_*         */
+    ssa_style_index const *styles; /* read-only here */
+    context ctx;           /* copy of parent's one, for warnings */
+    arena mem;             /* events of this chunk lives here  */
+    ssa_event *events;     /* partial list, in input order     */
+    ssa_event **tail;      /* ...and it's tail for appending   */
+  };
+
+/* detects type of event in line and parses it. on failure *
+ * returns NULL and sets 'err' to message format, that     *
+ * takes line number, length of line and line itself       */
+static ssa_event *
+ssa_event_line(arena * const mem, ssa_style_index const * const styles,
+               struct span const * const line, int8_t *fieldlist,
+               struct span * const times, uint8_t fields, char const **err)
+  {
+    ssa_event_type type = DIALOGUE;
+    ssa_event *e = NULL;
+
+    switch (toupper(*line->ptr))
+      {
+        case 'D' : type = DIALOGUE; break;
+        case 'M' : type = MOVIE;    break;
+        case 'P' : type = PICTURE;  break;
+        case 'S' : type = SOUND;    break;
+        case 'C' :
+          type = (span_starts(line, "Command")) ? COMMAND : COMMENT;
+          break;
+        default  :
+          *err = _("Unknown event type at line '%u': %.*s");
+          return NULL;
+          break;
+      }
+
+    ACALLOC(e, mem, 1, sizeof(ssa_event));
+    e->type = type;
+    e->style_id = SSA_STYLE_UNKNOWN;
+
+    if (!get_ssa_event(mem, styles, line, e, fieldlist, times, fields))
+      {
+        *err = _("Can't get timing at line '%u'.");
+        return NULL;
+      }
+
+    /* event is kept, but caller should warn */
+    if (e->flags & SSA_CUT)
+      *err = _("Style, name or effect is too long at line '%u', it's cut.");
+
+    return e;
+  }
+
+static void *
+ssa_events_thread(void *arg)
+  {
+    struct events_job *job = arg;
+    struct span line = { NULL, 0 };
+    ssa_event *e = NULL;
+    char const *err = NULL;
+    uint32_t base = 0;
+    reader in; /* over chunk memory, never closed */
+
+    job->tail = &job->events;
+    memset(&in, 0, sizeof(reader));
+    in.data = (char *) job->chunk.ptr;
+    in.size = job->chunk.len;
+
+    while (reader_next_line(&in, &line))
+      {
+        job->lines++;
+        span_trim(&line, LINE_START | LINE_END);
+
+        if (line.len == 0)
+          continue;
+
+        /* 'Format:' should be the first line of section, *
+         * too late to change fields order in the middle  */
+        err = NULL;
+        if (*line.ptr == 'F' || *line.ptr == 'f')
+          err = _("Misplaced 'Format:' line ignored at line '%u': %.*s");
+        else if ((e = ssa_event_line(&job->mem, job->styles, &line,
+                                     job->fieldlist, NULL, job->fields, &err)) != NULL)
+          {
+            ssa_event_append(&job->events, &job->tail, e);
+            if (err == NULL)
+              continue;
+          }
+
+        /* warnings are rare, count absolute line number only for them */
+        if (base == 0)
+          base = job->section_line + count_lines(job->section, job->chunk.ptr);
+        log_msg(&job->ctx, warn, err, base + job->lines - 1, (int) line.len, line.ptr);
+      }
+
+    if (job->ctx.opts.i_sort) /* merged later, tail is useless */
+      events_sort((void **) &job->events, ssa_event_start);
+
+    return NULL;
+  }
+
+/* how many threads is worth to use for section of 'size' bytes */
+static uint8_t
+ssa_events_threads(size_t size)
+  {
+    return (size < SSA_EVENTS_MT_SIZE) ? 1 : cpu_threads(SSA_THREADS_MAX);
+  }
+
+/* Parses all [Events] section, starting from 'first' line, in  *
+ * several threads, if it's big enough. Section splitted to     *
+ * line-aligned chunks, each chunk parsed to own list with own  *
+ * arena, then lists concatenated in input order (or merged, if *
+ * sorting requested) and appended to file->events. Returns     *
+ * false, if section was left untouched for usual parsing.      */
+static bool
+ssa_events_parallel(context * const ctx, ssa_file * const file, reader * const in,
+                    struct span const * const first, ssa_event *** const tail)
+  {
+    struct events_job jobs[SSA_THREADS_MAX];
+    pthread_t threads[SSA_THREADS_MAX];
+    bool started[SSA_THREADS_MAX];
+    char const *from = first->ptr, *end = in->data + in->size;
+    char const *p = from, *cut = NULL;
+    ssa_event *events = NULL;
+    uint8_t parts = 1, i = 0;
+
+    /* section ends right before next "\n[" or at the end of input */
+    while ((p = memchr(p, '[', end - p)) != NULL && p[-1] != '\n')
+      p++;
+    if (p != NULL)
+      end = p;
+
+    if ((parts = ssa_events_threads(end - from)) < 2)
+      return false;
+
+    memset(jobs, 0, sizeof(jobs));
+    for (i = 0, p = from; i < parts; i++)
+      {
+        cut = (i + 1 < parts) ? from + (end - from) * (i + 1) / parts : end;
+        if (cut < p)
+          cut = p;
+        if (cut < end && (cut = memchr(cut, '\n', end - cut)) != NULL)
+          cut++;
+        else
+          cut = end;
+
+        jobs[i].chunk.ptr = p, jobs[i].chunk.len = cut - p;
+        jobs[i].section = from;
+        jobs[i].section_line = ctx->line_num;
+        jobs[i].fieldlist = file->event_fields_order;
+        jobs[i].fields = file->event_fields;
+        jobs[i].styles = &file->style_index;
+        jobs[i].ctx = *ctx;
+        jobs[i].ctx.abort = NULL; /* only warnings are possible there */
+        p = cut;
+      }
+
+    log_msg(ctx, debug, _("Parsing events in %u threads."), parts);
+
+    for (i = 0; i < parts; i++)
+      {
+        started[i] = (pthread_create(&threads[i], NULL, ssa_events_thread, &jobs[i]) == 0);
+        if (!started[i]) /* no more threads? do it by self */
+          ssa_events_thread(&jobs[i]);
+      }
+
+    for (i = 0; i < parts; i++)
+      if (started[i])
+        pthread_join(threads[i], NULL);
+
+    /* first line of section is already counted by caller */
+    ctx->line_num--;
+    for (i = 0; i < parts; i++)
+      {
+        ctx->line_num += jobs[i].lines;
+        arena_join(&file->mem, &jobs[i].mem);
+
+        if (jobs[i].events == NULL)
+          continue;
+
+        if (ctx->opts.i_sort)
+          {
+            events_merge((void **) &events, jobs[i].events, ssa_event_start);
+            continue;
+          }
+
+        ssa_event_append(&file->events, tail, jobs[i].events);
+        if (jobs[i].tail != &jobs[i].events) /* more than one event */
+          *tail = jobs[i].tail;
+      }
+
+    if (events != NULL)
+      {
+        ssa_event_append(&file->events, tail, events);
+        while ((**tail)->next != NULL)
+          *tail = &(**tail)->next;
+      }
+
+    reader_seek(in, end);
+
+    return true;
+  }
+
+/* true, if all chars of line are in uue alphabet, see doc/embeded_files */
+bool
+ssa_media_chars(struct span const * const line)
+  {
+    size_t i = 0;
+
+    for (i = 0; i < line->len; i++)
+      if (line->ptr[i] < '!' || line->ptr[i] > '`')
+        return false;
+
+    return true;
+  }
+
+/* uue lines are kept as range of input, while they go one by one, *
+ * each with single '\n' after it. otherwise (blank lines, "\r\n",  *
+ * spaces around) all of them are copied to temporary file         */
+static void
+ssa_media_line(context * const ctx, ssa_media * const m,
+               struct span const * const line, char const *end)
+  {
+    char const *next = line->ptr + line->len;
+
+    if (m->data == NULL)
+      {
+        if (m->raw == NULL)
+          m->raw = line->ptr;
+
+        if (line->ptr == m->raw + m->len && next < end && *next == '\n')
+          {
+            m->len += line->len + 1;
+            return;
+          }
+
+        TMPFILE(ctx, m->data);
+        fwrite(m->raw, sizeof(char), m->len, m->data);
+        m->raw = NULL, m->len = 0;
+      }
+
+    fwrite(line->ptr, sizeof(char), line->len, m->data);
+    fputs("\n", m->data);
+  }
+
+/* Input memory is gone after parsing, so uue lines there become *
+ * range of 'infile', if it was mapped (nothing is read till     *
+ * writing, if ever), or are copied to arena, if input was read  *
+ * to buffer (pipe). temporary files are flushed                 */
+static void
+ssa_media_detach(ssa_file * const file, reader const * const in, FILE *infile)
+  {
+    ssa_media *m = NULL, *lists[2];
+    char *p = NULL;
+    uint8_t i = 0;
+
+    lists[0] = file->fonts, lists[1] = file->images;
+
+    for (i = 0; i < 2; i++)
+      for (m = lists[i]; m != NULL; m = m->next)
+        {
+          if (m->data != NULL)
+            fflush(m->data);
+
+          if (m->data != NULL || m->raw == NULL)
+            continue;
+
+          if (in->mapped)
+            {
+              m->fd = fileno(infile);
+              m->offset = m->raw - in->data;
+              m->raw = NULL;
+              continue;
+            }
+
+          ACALLOC(p, &file->mem, m->len, sizeof(char));
+          memcpy(p, m->raw, m->len);
+          m->raw = p;
+        }
+  }
+
+/* appends trimmed line of header to it's source, kept in arena. *
+ * buffer grows twice, so old copies are not too much of waste    */
+static void
+ssa_head_line(ssa_file * const file, size_t * const cap,
+              struct span const * const line)
+  {
+    char *p = NULL;
+
+    if (file->head_len + line->len + 1 > *cap)
+      {
+        *cap = (*cap + line->len + 1) * 2;
+        ACALLOC(p, &file->mem, *cap, sizeof(char));
+        if (file->head_len > 0)
+          memcpy(p, file->head_src, file->head_len);
+        file->head_src = p;
+      }
+
+    memcpy(file->head_src + file->head_len, line->ptr, line->len);
+    file->head_len += line->len;
+    file->head_src[file->head_len++] = '\n';
+  }
+
+/* sources of events point right into input, so it stays *
+ * open till free_ssa_file(). streaming input is closed  */
+static void
+ssa_input_keep(ssa_file * const file, reader * const in)
+  {
+    if (in->stream)
+      {
+        reader_close(in);
+        return;
+      }
+
+    ACALLOC(file->input, &file->mem, 1, sizeof(reader));
+    memcpy(file->input, in, sizeof(reader));
+  }
+
 /* top-level functions */
 bool
 init_ssa_file(ssa_file * const file)
@@ -136,139 +475,312 @@ init_ssa_file(ssa_file * const file)
 
     memcpy(file, &ssa_file_template, sizeof(ssa_file));
 
-    if (opts.i_sort)
-      file->flags |= SSA_E_SORTED;
+    return true;
+  }
+
+/* releases all memory of parsed file and it's input */
+void
+free_ssa_file(ssa_file * const file)
+  {
+    if (!file) return;
+
+    if (file->input != NULL)
+      reader_close(file->input);
+    file->input = NULL;
+
+    arena_free(&file->mem);
+  }
+
+/* checks & fixes of header and styles, done after parsing. *
+ * returns true, if default style was added                  */
+static bool
+ssa_file_fixup(context * const ctx, ssa_file * const file, bool get_styles)
+  {
+    ssa_style *s = NULL;
+
+    if (file->type == ssa_unknown)
+      log_msg(ctx, error, _("Missing 'Script Type' line in input file."));
+
+    if (file->timer == 0)
+      {
+        log_msg(ctx, warn, _("Undefined or zero 'Timer' value. Default value assumed."));
+        file->timer = 100;
+        file->flags |= SSA_H_DIRTY;
+      }
+
+    if ((get_styles && file->styles == (ssa_style *) 0) || !get_styles)
+      {
+        log_msg(ctx, warn, _("No styles was defined. Default style assumed."));
+        ACALLOC(s, &file->mem, 1, sizeof(ssa_style));
+        memcpy(s, &ssa_style_template, sizeof(ssa_style));
+        s->name = "Default";
+        s->fontname = SSA_DEFAULT_FONT;
+        file->styles = NULL, file->styles_tail = NULL;
+        memset(&file->style_index, 0, sizeof(ssa_style_index));
+        ssa_style_add(file, s);
+        return true;
+      }
+
+    return false;
+  }
+
+/* compiled file (see ssa-cache) is loaded instead of parsing, *
+ * it's events turned to usual list. input stays open, strings *
+ * of events and media are there                               */
+static bool
+ssa_parse_cache(context * const ctx, reader * const in, ssa_file * const file,
+                bool stream)
+  {
+    jmp_buf env, *outer = ctx->abort;
+
+    if (setjmp(env) != 0)
+      {
+        ctx->abort = outer;
+        reader_close(in);
+        return false;
+      }
+    ctx->abort = &env;
+
+    if (stream)
+      log_msg(ctx, error, _("Compiled file can't be read in streaming mode."));
+
+    if (!cache_open(ctx, in, file))
+      log_msg(ctx, error, _("Can't load compiled file."));
+
+    cache_events(file);
+
+    if (ctx->opts.i_sort)
+      {
+        events_sort((void **) &file->events, ssa_event_start);
+        file->flags |= SSA_E_SORTED;
+      }
+
+    ssa_input_keep(file, in);
+    ctx->abort = outer;
 
     return true;
   }
 
-bool
-parse_ssa_file(FILE *infile, ssa_file *file)
+/* Parses whole file to 'file', if 'fn' is NULL. otherwise  *
+ * events are not kept: each one is given to 'fn' right     *
+ * after it's parsed and dropped then. header & styles are  *
+ * complete at this time, and 'fn' is called once with NULL *
+ * event before the first one (or at end, if there is none) */
+static bool
+ssa_parse(context * const ctx, FILE *infile, ssa_file *file,
+          ssa_event_f fn, void *arg)
   {
-    uint16_t len = 0;
     bool get_styles = true; /* skip or not styles? */
-    bool get_fonts  = true; /* ... embedded fonts? */
-    bool get_graph  = true; /* ... embedded graphics? */
-    char line[MAXLINE] = "";
+    bool get_fonts  = !ctx->opts.i_nomedia; /* ... embedded fonts? */
+    bool get_graph  = !ctx->opts.i_nomedia; /* ... embedded graphics? */
+    reader in;
+    struct span line = { NULL, 0 };
     ssa_event *e = NULL;
     ssa_event **elist_tail  = &file->events;
+    char const *err = NULL;
+    bool try_mt = (!fn && ctx->opts.msglevel < debug); /* keeps debug output in order */
+    bool late_styles = false; /* some styles defined after events? */
+    bool head_done = false; /* streaming: 'fn' got header & styles? */
+    arena tmp = { NULL }; /* streaming: current event lives here */
+    char const *input_end = NULL;
+    struct span str[4]; /* style, name, effect & text of event */
+    size_t head_cap = 0; /* of file->head_src */
     ssa_media *f = NULL; /* fonts list handler */
     ssa_media *g = NULL; /* graphics list handler */
 
     ssa_section section = NONE;
+    jmp_buf env, *outer = ctx->abort;
+
+    if (!(fn ? reader_open_stream : reader_open)(&in, ctx, infile))
+      return false;
+
+    if (cache_detect(&in))
+      return ssa_parse_cache(ctx, &in, file, fn != NULL);
+
+    /* media are kept as input ranges, if input stays reachable */
+    if (!in.stream || in.mapped)
+      input_end = in.data + in.size;
+
+    /* on error input is closed, data parsed so far stays in file */
+    if (setjmp(env) != 0)
+      {
+        ctx->abort = outer;
+        ssa_media_detach(file, &in, infile);
+        ssa_input_keep(file, &in);
+        arena_free(&tmp);
+        return false;
+      }
+    ctx->abort = &env;
 
-    while (fgets(line, MAXLINE, infile) != NULL)
+    while (reader_next_line(&in, &line))
       {
-        line_num++;
+        ctx->line_num++;
 
         /* unicode handle */
-        if (line_num == 1)
-          opts.i_chs_type = unicode_check(line, uc_t_ssa);
+        if (ctx->line_num == 1)
+          ctx->charset = unicode_check_span(ctx, &line, uc_t_ssa);
 
-        trim_newline(line);
-        log_msg(raw, "%s", line);
-        trim_spaces(line, LINE_START | LINE_END);
-        len = strlen(line);
+        log_msg(ctx, raw, "%.*s", (int) line.len, line.ptr);
+        span_trim(&line, LINE_START | LINE_END);
 
-        if (len == 0)
+        if (line.len == 0)
           continue;
 
-        if (len != 80 && !(section == FONTS || section == GRAPHICS))
-          if (ssa_section_switch(&section, line) == true)
+        /* uue lines may start with '[' too, but any section *
+         * name has chars, that are out of uue alphabet      */
+        if (line.len != 80 && line.ptr[0] == '[' &&
+            (!(section == FONTS || section == GRAPHICS) || !ssa_media_chars(&line)))
+          if (ssa_section_switch(ctx, &section, &line) == true)
             continue;
 
         switch (section)
           {
             case HEADER :
-              if (line[0] == ';')
+              ssa_head_line(file, &head_cap, &line);
+              if (line.ptr[0] == ';')
                 continue;
-              log_msg(debug, MSG_W_CURRSECTION, line_num, _("header"));
-              get_ssa_param(line, file);
+              log_msg(ctx, debug, MSG_W_CURRSECTION, ctx->line_num, _("header"));
+              get_ssa_param(ctx, &line, file);
               break;
             case STYLES :
-              log_msg(debug, MSG_W_CURRSECTION, line_num, _("styles"));
-              if      (*line == 'F' || *line == 'f')
-                get_styles = set_style_fields_order(line,
+              log_msg(ctx, debug, MSG_W_CURRSECTION, ctx->line_num, _("styles"));
+              if      (*line.ptr == 'F' || *line.ptr == 'f')
+                get_styles = set_style_fields_order(ctx, &line,
                     file->type, file->style_fields_order);
-              else if (get_styles && toupper(line[0]) == 'S')
-                get_ssa_style(line, &file->styles, file->style_fields_order);
+              else if (head_done && toupper(line.ptr[0]) == 'S')
+                {
+                  if (!late_styles)
+                    log_msg(ctx, warn, _("Styles after events are skipped, from line %i."),
+                            ctx->line_num);
+                  late_styles = true;
+                }
+              else if (get_styles && toupper(line.ptr[0]) == 'S')
+                {
+                  get_ssa_style(file, &line, file->style_fields_order);
+                  late_styles |= (file->events != NULL);
+                }
               break;
             case EVENTS :
-              log_msg(debug, MSG_W_CURRSECTION, line_num, _("events"));
-              if      (*line == 'F' || *line == 'f')
-                set_event_fields_order(line,
-                    file->type, file->event_fields_order);
-              else
+              log_msg(ctx, debug, MSG_W_CURRSECTION, ctx->line_num, _("events"));
+              if      (*line.ptr == 'F' || *line.ptr == 'f')
                 {
-                  CALLOC(e, 1, sizeof(ssa_event));
-                  switch (toupper(*line))
-                    {
-                      case 'D' : e->type = DIALOGUE; break;
-                      case 'M' : e->type = MOVIE;    break;
-                      case 'P' : e->type = PICTURE;  break;
-                      case 'S' : e->type = SOUND;    break;
-                      case 'C' :
-                        if (strncmp(line, "Comment", 7) == 0)
-                          e->type = COMMENT;
-                        if (strncmp(line, "Command", 7) == 0)
-                          e->type = COMMAND;
-                        break;
-                      default  :
-                        log_msg(warn, _("W: Unknown event type at line '%lu': %s"), line_num, line);
-                        continue; /* main loop */
-                        break;
-                    }
-                  if (get_ssa_event(line, e, file->event_fields_order) != false)
-                    ssa_event_append(&file->events, &elist_tail, e, opts.i_sort);
-                  else free(e);
+                  set_event_fields_order(ctx, &line,
+                      file->type, file->event_fields_order);
+                  break;
                 }
+              if (try_mt && ssa_events_parallel(ctx, file, &in, &line, &elist_tail))
+                {
+                  try_mt = false;
+                  continue;
+                }
+              try_mt = false;
+              if (fn && !head_done)
+                {
+                  head_done = true;
+                  ssa_file_fixup(ctx, file, get_styles);
+                  if (!fn(ctx, file, NULL, arg))
+                    longjmp(env, 1);
+                }
+              err = NULL;
+              e = ssa_event_line(fn ? &tmp : &file->mem, &file->style_index,
+                        &line, file->event_fields_order,
+                        fn ? file->src.times : NULL, file->event_fields, &err);
+              if (err != NULL)
+                log_msg(ctx, warn, err, ctx->line_num, (int) line.len, line.ptr);
+              if (e == NULL)
+                break;
+              if (!fn)
+                {
+                  ssa_event_append(&file->events, &elist_tail, e);
+                  break;
+                }
+              file->src.line = line;
+              file->src.offset = in.offset + (line.ptr - in.data);
+              if (!fn(ctx, file, e, arg))
+                longjmp(env, 1);
+              arena_reset(&tmp);
               break;
+            /* media sections are mostly uue lines, *
+             * so gettext() is not called for each  */
             case FONTS :
-              log_msg(debug, MSG_W_CURRSECTION, line_num, _("fonts"));
+              if (ctx->opts.msglevel >= debug)
+                log_msg(ctx, debug, MSG_W_CURRSECTION, ctx->line_num, _("fonts"));
               if (get_fonts == false)
                 continue;
-              get_ssa_media(&file->fonts, &f, line);
+              get_ssa_media(ctx, &file->mem, &file->fonts, &f, &line, input_end);
               break;
             case GRAPHICS :
-              log_msg(debug, MSG_W_CURRSECTION, line_num, _("graphics"));
+              if (ctx->opts.msglevel >= debug)
+                log_msg(ctx, debug, MSG_W_CURRSECTION, ctx->line_num, _("graphics"));
               if (get_graph == false)
                 continue;
-              get_ssa_media(&file->images, &g, line);
+              get_ssa_media(ctx, &file->mem, &file->images, &g, &line, input_end);
               break;
             case UNKNOWN :
-              log_msg(debug, MSG_W_CURRSECTION, line_num, _("unknown"));
+              log_msg(ctx, debug, MSG_W_CURRSECTION, ctx->line_num, _("unknown"));
               break;
             case NONE :
             default :
-              log_msg(warn, _("Skipping line %i: not in any ssa section."), line_num);
+              log_msg(ctx, warn, _("Skipping line %i: not in any ssa section."), ctx->line_num);
               break;
           }
-        }
+      }
 
-      /* some checks and fixes */
-      if (file->type == ssa_unknown)
-        log_msg(error, _("Missing 'Script Type' line in input file."));
+    ssa_media_detach(file, &in, infile);
+    ssa_input_keep(file, &in);
+    arena_free(&tmp);
 
-      /* this is needed, if last line was 80 chars also */
-      if (f != NULL) fflush(f->data);
-      if (g != NULL) fflush(g->data);
+    if (fn)
+      {
+        if (!head_done)
+          {
+            ssa_file_fixup(ctx, file, get_styles);
+            if (!fn(ctx, file, NULL, arg))
+              longjmp(env, 1);
+          }
+        ctx->abort = outer;
+        return true;
+      }
 
-      if (file->timer == 0)
-        {
-          log_msg(warn, _("Undefined or zero 'Timer' value. Default value assumed."));
-          file->timer = 100;
-        }
+    if (ctx->opts.i_sort)
+      {
+        events_sort((void **) &file->events, ssa_event_start);
+        file->flags |= SSA_E_SORTED;
+      }
 
-      if ((get_styles && file->styles == (ssa_style *) 0) || !get_styles)
-        {
-          log_msg(warn, _("No styles was defined. Default style assumed."));
-          CALLOC(file->styles, 1, sizeof(ssa_style));
-          memcpy(file->styles, &ssa_style_template, sizeof(ssa_style));
-          STRNDUP(file->styles->name, "Default", MAXLINE);
-          STRNDUP(file->styles->fontname, SSA_DEFAULT_FONT, MAXLINE);
-        }
+    /* some checks and fixes */
+    late_styles |= ssa_file_fixup(ctx, file, get_styles);
+
+    /* events, parsed before it's style, still has unknown style id */
+    if (late_styles)
+      for (e = file->events; e != NULL; e = e->next)
+        if (e->style_id == SSA_STYLE_UNKNOWN && (e->fields & SSA_F_STYLE))
+          {
+            ssa_event_strs(e, str);
+            e->style_id = ssa_style_id(&file->style_index, str[0].ptr, str[0].len);
+          }
+
+    ctx->abort = outer;
 
-      return true;
+    return true;
+  }
+
+bool
+parse_ssa_file(context * const ctx, FILE *infile, ssa_file *file)
+  {
+    return ssa_parse(ctx, infile, file, NULL, NULL);
+  }
+
+/* see ssa_parse(). memory use does not depend on count of events, *
+ * and input, which is read by pieces, is never kept whole         */
+bool
+stream_ssa_file(context * const ctx, FILE *infile, ssa_file *file,
+                ssa_event_f fn, void *arg)
+  {
+    if (!fn)
+      return false;
+
+    return ssa_parse(ctx, infile, file, fn, arg);
   }
 
 
@@ -278,25 +790,33 @@ parse_ssa_file(FILE *infile, ssa_file *file)
  * false - if line stays unhandled */
 
 bool
-get_ssa_param(char * const line, ssa_file * const h)
+get_ssa_param(context * const ctx, struct span const * const span,
+              ssa_file * const h)
   {
     /* line: "Param: Value" */
+    char *line = NULL;
     char *v = NULL;
     int p_len = 0;
 
-    if ((v = strchr(line, ':')) == NULL)
+    if (memchr(span->ptr, ':', span->len) == NULL)
       {
-        log_msg(warn, _("Can't get parameter value at line '%u'."), line_num);
+        log_msg(ctx, warn, _("Can't get parameter value at line '%u'."), ctx->line_num);
+        h->flags |= SSA_H_DIRTY;
         return false;
       }
 
+    /* header is small, so simply work with it's copy */
+    STRNDUP(line, span->ptr, span->len);
+
+    v = strchr(line, ':');
     p_len = v - line;
 
     for (v += 1; *v != '\0' && isspace(*v); v++);
 
     if (strlen(v) == 0)
       {
-        log_msg(info, MSG_W_SKIPEPARAM, line, line_num);
+        log_msg(ctx, info, MSG_W_SKIPEPARAM, line, ctx->line_num);
+        free(line);
         return true;
       }
 
@@ -313,7 +833,11 @@ get_ssa_param(char * const line, ssa_file * const h)
     else if (strncmp(line, "WrapStyle", p_len) == 0)
       {
         if (h->type == ssa_v4p) h->wrap = atoi(v);
-        else log_msg(warn, MSG_W_NOTALLOWED, "Parameter", line);
+        else
+          {
+            log_msg(ctx, warn, MSG_W_NOTALLOWED, "Parameter", line);
+            h->flags |= SSA_H_DIRTY;
+          }
       }
     else if (strncmp(line, "ScriptType", p_len) == 0)
       {
@@ -332,26 +856,30 @@ get_ssa_param(char * const line, ssa_file * const h)
       {
         slist_add(&(h->txt_params), line);
       }
-    else if (opts.i_strict == true)
-      log_msg(warn, MSG_W_SKIPSTRICT, line, line_num);
-    else if (opts.i_strict == false)
+    else if (ctx->opts.i_strict == true)
       {
-        log_msg(warn, MSG_W_UNCOMMON, _("parameter"), line_num, line);
+        log_msg(ctx, warn, MSG_W_SKIPSTRICT, line, ctx->line_num);
+        h->flags |= SSA_H_DIRTY;
+      }
+    else if (ctx->opts.i_strict == false)
+      {
+        log_msg(ctx, warn, MSG_W_UNCOMMON, _("parameter"), ctx->line_num, line);
         slist_add(&(h->txt_params), line);
       }
 
+    free(line);
+
     return true;
   }
 
 bool
-set_style_fields_order(char *format, ssa_version v, int8_t *fieldlist)
+set_style_fields_order(context * const ctx, struct span const * const format,
+                       ssa_version v, int8_t *fieldlist)
   {
     bool result = true;
     int8_t *fields_order;
     char compare[MAXLINE];
-    char buf[MAXLINE + 1] = "";
-
-    strncpy(buf, format, MAXLINE);
+    char *buf = NULL;
 
     switch (v)
       {
@@ -371,6 +899,7 @@ set_style_fields_order(char *format, ssa_version v, int8_t *fieldlist)
       }
 
     /* prepare provided 'Format:' string */
+    STRNDUP(buf, format->ptr, format->len);
     string_skip_chars(buf, " ");
     string_lowercase(buf, 0);
 
@@ -380,30 +909,32 @@ set_style_fields_order(char *format, ssa_version v, int8_t *fieldlist)
 
     if (strcmp(compare,  buf) == 0)
       memcpy(fieldlist, fields_order, sizeof(uint8_t) * MAX_FIELDS);
-    else if ((result = detect_style_fields_order(buf, fieldlist)) == true)
-      log_msg(warn, MSG_W_WRONGFORDER, _("styles"));
+    else if ((result = detect_style_fields_order(ctx, buf, fieldlist)) == true)
+      log_msg(ctx, warn, MSG_W_WRONGFORDER, _("styles"));
     else
       {
-        log_msg(warn, MSG_W_CANTDETECT, _("styles"));
+        log_msg(ctx, warn, MSG_W_CANTDETECT, _("styles"));
         memcpy(fieldlist, fields_order, sizeof(uint8_t) * MAX_FIELDS);
       }
 
+    free(buf);
+
     return result;
   }
 
 /* 'format' passed to this function must be lowercase string, *
  * contains only alphanumeric chars, commas and no spaces    */
 bool
-detect_style_fields_order(char *format, int8_t *fieldlist)
+detect_style_fields_order(context * const ctx, char *format, int8_t *fieldlist)
   {
-    char *p, *token;
+    char *p, *token, *save = NULL;
     bool result;
     int i;
     int8_t *field = fieldlist;
 
     if ((p = strchr(format, ':')) == 0)
       {
-        log_msg(error, _("Malformed 'Format:' line."));
+        log_msg(ctx, error, _("Malformed 'Format:' line."));
         return false;
       }
 
@@ -415,7 +946,7 @@ detect_style_fields_order(char *format, int8_t *fieldlist)
 
     field = fieldlist;
 
-    token = strtok(++p, ",");
+    token = strtok_r(++p, ",", &save);
     do
       {
              if (!strcmp(token, "name"))            *field = STYLE_NAME;
@@ -444,14 +975,14 @@ detect_style_fields_order(char *format, int8_t *fieldlist)
         else if (!strcmp(token, "encoding"))        *field = STYLE_ENC;
         else if (!strcmp(token, "alphalevel"))      *field = STYLE_ALPHA;
         else
-          log_msg(warn, MSG_W_UNRECFIELD, token), result = false;
+          log_msg(ctx, warn, MSG_W_UNRECFIELD, token), result = false;
 
         field++;
       }
-    while ((token = strtok(NULL, ",")) != 0 && *field != 0);
+    while ((token = strtok_r(NULL, ",", &save)) != 0 && *field != 0);
 
     if (*field == 0)
-      log_msg(error, MSG_W_TOOMANYFIELDS, _("styles"));
+      log_msg(ctx, error, MSG_W_TOOMANYFIELDS, _("styles"));
     else
       *field = 0; /* set new list terminator after last param */
 
@@ -459,76 +990,71 @@ detect_style_fields_order(char *format, int8_t *fieldlist)
   }
 
 bool
-get_ssa_style(char * const line, ssa_style ** style,
+get_ssa_style(ssa_file * const file, struct span const * const line,
               int8_t * fieldlist)
   {
-    int8_t *field = fieldlist;
-    ssa_style *ptr = *style, **ptr_alloc;
-    char *p = line, *delim = ",";
-    char token[MAXLINE] = "";
-    int len = -1;
+    int8_t *field = fieldlist, *order = NULL;
+    arena *mem = &file->mem;
+    ssa_style *ptr = NULL;
+    char const *p = NULL, *end = line->ptr + line->len;
+    struct span rest = { NULL, 0 };
+    struct span tokens[MAX_FIELDS + 1], *token = tokens;
+    size_t count = 0, n = 0;
+
+    if ((p = memchr(line->ptr, ':', line->len)) == NULL)
+      return false;
 
-    if (ptr != (ssa_style *) 0) /* list has no entries */
-      {
-        while (ptr->next != (ssa_style *) 0)
-          ptr = ptr->next;
-        ptr_alloc = &ptr->next;
-      }
-    else
-      ptr_alloc = style;
+    ACALLOC(ptr, mem, 1, sizeof(ssa_style));
+    memcpy(ptr, &ssa_style_template, sizeof(ssa_style));
 
-    if ((p = strchr(line, ':')) == NULL)
-      return false;
+    p = p + 1; /* "Style:| " */
 
-    CALLOC(*ptr_alloc, 1, sizeof(ssa_style));
-    memcpy(*ptr_alloc, &ssa_style_template, sizeof(ssa_style));
+    /* one extra field catches everything after the last known one */
+    while (count < MAX_FIELDS && fieldlist[count] != 0)
+      count++;
+    rest.ptr = p, rest.len = end - p;
+    n = span_split(&rest, ',', tokens, count + 1);
 
-    ptr = *ptr_alloc;
+    /* line is kept, if it's written back the same way */
+    order = (file->type == ssa_v4p) ? style_fields_order_ssa_v4p
+          : (file->type == ssa_v4)  ? style_fields_order_ssa_v4 : NULL;
+    if (n == count && count < MAX_FIELDS && order != NULL &&
+        memcmp(fieldlist, order, count + 1) == 0)
+      ASTRNDUP(ptr->src, mem, line->ptr, line->len);
 
-    p = p + 1; /* "Style:| " */
+    for (; n < count; n++) /* missing fields are empty */
+      tokens[n].ptr = end, tokens[n].len = 0;
 
-    while (*field != 0)
+    for (; field < fieldlist + count; field++, token++)
       {
-        len = _strtok(p, delim);
-        if (len < 0)
-          return false;
-        else if (len > 0 && len < MAXLINE)
-          {
-            strncpy(token, p, len);
-            p += (len + strlen(delim));
-            token[len] = '\0';
-          }
-        else /* len == 0 || len > MAXLINE */
-          token[0] = '\0', p++;
-
         switch (*field)
           {
             case STYLE_NAME :
-                trim_spaces(token, LINE_START | LINE_END);
-                STRNDUP(ptr->name, token, MAXLINE);
+                span_trim(token, LINE_START | LINE_END);
+                ASTRNDUP(ptr->name, mem, token->ptr, token->len);
               break;
             case STYLE_FONTNAME :
-                trim_spaces(token, LINE_START | LINE_END);
-                STRNDUP(ptr->fontname, token, MAXLINE);
+                span_trim(token, LINE_START | LINE_END);
+                ASTRNDUP(ptr->fontname, mem, token->ptr, token->len);
               break;
-            case STYLE_FONTSIZE : ptr->fontsize = atof(token);   break;
-            case STYLE_BOLD     : ptr->bold = atoi(token);       break;
-            case STYLE_ITALIC   : ptr->italic = atoi(token);     break;
-            case STYLE_UNDER    : ptr->underlined = atoi(token); break;
-            case STYLE_STRIKE   : ptr->strikeout = atoi(token);  break;
-            case STYLE_SCALEX   : ptr->scale_x = atoi(token);    break;
-            case STYLE_SCALEY   : ptr->scale_y = atoi(token);    break;
-            case STYLE_SPACING  : ptr->spacing = atoi(token);    break;
-            case STYLE_ANGLE    : ptr->angle = atof(token);      break;
-            case STYLE_OUTLINE  : ptr->outline = atoi(token);    break;
-            case STYLE_SHADOW   : ptr->shadow = atoi(token);     break;
-            case STYLE_ALIGN    : ptr->alignment = atoi(token);  break;
-            case STYLE_MARGINL  : ptr->margin_l = atoi(token);   break;
-            case STYLE_MARGINR  : ptr->margin_r = atoi(token);   break;
-            case STYLE_MARGINV  : ptr->margin_v = atoi(token);   break;
-            case STYLE_ENC      : ptr->codepage = atoi(token);   break;
-            case STYLE_BORDER   : ptr->brd_style = atoi(token);  break;
-            case STYLE_ALPHA    : ptr->a_level  = atoi(token);   break;
+            case STYLE_FONTSIZE : ptr->fontsize = strntod(token->ptr, token->len);   break;
+            case STYLE_BOLD     : ptr->bold = strntoi(token->ptr, token->len);       break;
+            case STYLE_ITALIC   : ptr->italic = strntoi(token->ptr, token->len);     break;
+            case STYLE_UNDER    : ptr->underlined = strntoi(token->ptr, token->len); break;
+            case STYLE_STRIKE   : ptr->strikeout = strntoi(token->ptr, token->len);  break;
+            case STYLE_SCALEX   : ptr->scale_x = strntoi(token->ptr, token->len);    break;
+            case STYLE_SCALEY   : ptr->scale_y = strntoi(token->ptr, token->len);    break;
+            case STYLE_SPACING  : ptr->spacing = strntoi(token->ptr, token->len);    break;
+            case STYLE_ANGLE    : ptr->angle = strntod(token->ptr, token->len);      break;
+            case STYLE_OUTLINE  : ptr->outline = strntoi(token->ptr, token->len);    break;
+            case STYLE_SHADOW   : ptr->shadow = strntoi(token->ptr, token->len);     break;
+            case STYLE_ALIGN    : ptr->alignment = strntoi(token->ptr, token->len);  break;
+            case STYLE_MARGINL  : ptr->margin_l = strntoi(token->ptr, token->len);   break;
+            case STYLE_MARGINR  : ptr->margin_r = strntoi(token->ptr, token->len);   break;
+            case STYLE_MARGINV  : ptr->margin_v = strntoi(token->ptr, token->len);   break;
+            case STYLE_ENC      : ptr->codepage = strntoi(token->ptr, token->len);   break;
+            case STYLE_BORDER   : ptr->brd_style = strntoi(token->ptr, token->len);  break;
+            case STYLE_ALPHA    : ptr->a_level  = strntoi(token->ptr, token->len);   break;
             case STYLE_PCOLOR   : ptr->pr_color = ssa_color(token); break;
             case STYLE_SCOLOR   : ptr->se_color = ssa_color(token); break;
             case STYLE_TCOLOR   : ptr->tr_color = ssa_color(token); break;
@@ -536,21 +1062,20 @@ get_ssa_style(char * const line, ssa_style ** style,
             default :
               break;
           }
-        field++;
-        if (*field == 0) delim = "";
       }
 
+    ssa_style_add(file, ptr);
+
     return true;
   }
 
 bool
-set_event_fields_order(char * const format, ssa_version v, int8_t * fieldlist)
+set_event_fields_order(context * const ctx, struct span const * const line,
+                       ssa_version v, int8_t * fieldlist)
   {
     bool result = true;
     char compare[MAXLINE];
-
-    string_skip_chars(format, " ");
-    string_lowercase(format, 0);
+    char *format = NULL;
 
     switch (v)
       {
@@ -567,30 +1092,36 @@ set_event_fields_order(char * const format, ssa_version v, int8_t * fieldlist)
           break;
       }
 
+    STRNDUP(format, line->ptr, line->len);
+    string_skip_chars(format, " ");
+    string_lowercase(format, 0);
+
     string_skip_chars(compare, " ");
     string_lowercase(compare, 0);
 
     if (strcmp(compare,  format) == 0)
       memcpy(fieldlist, event_fields_normal_order, sizeof(uint8_t) * MAX_FIELDS);
-    else if ((result = detect_event_fields_order(format, fieldlist)) == true)
-      log_msg(warn, MSG_W_WRONGFORDER, _("events"));
+    else if ((result = detect_event_fields_order(ctx, format, fieldlist)) == true)
+      log_msg(ctx, warn, MSG_W_WRONGFORDER, _("events"));
     else
       {
-        log_msg(warn, MSG_W_CANTDETECT, _("events"));
+        log_msg(ctx, warn, MSG_W_CANTDETECT, _("events"));
         memcpy(fieldlist, event_fields_normal_order, sizeof(uint8_t) * MAX_FIELDS);
       }
 
+    free(format);
+
     return result;
   }
 
 /* 'format' passed to this function must be lowercase string, *
  * contains only alphanumeric chars, commas and no spaces    */
 bool
-detect_event_fields_order(char *format, int8_t *fieldlist)
+detect_event_fields_order(context * const ctx, char *format, int8_t *fieldlist)
   {
-    char *p, *token;
+    char *p, *token, *save = NULL;
     char buf[MAXLINE + 1] = "";
-    bool result;
+    bool result = true;
     int i;
     int8_t *field = fieldlist;
 
@@ -599,7 +1130,7 @@ detect_event_fields_order(char *format, int8_t *fieldlist)
     strncpy(buf, format, MAXLINE);
     if ((p = strchr(buf, ':')) == 0)
       {
-        log_msg(error, _("Malformed 'Format:' line."));
+        log_msg(ctx, error, _("Malformed 'Format:' line."));
         return false;
       }
 
@@ -608,7 +1139,9 @@ detect_event_fields_order(char *format, int8_t *fieldlist)
     *(field + MAX_FIELDS) = 0; /* set list-terminator */
     for (i = 0; i < MAX_FIELDS; i++) *field++ = -1;
 
-    token = strtok(++p, ",");
+    field = fieldlist;
+
+    token = strtok_r(++p, ",", &save);
     do
       {
              if (!strcmp(token, "layer"))   *field = EVENT_LAYER;
@@ -621,136 +1154,290 @@ detect_event_fields_order(char *format, int8_t *fieldlist)
         else if (!strcmp(token, "marginv")) *field = EVENT_MARGINV;
         else if (!strcmp(token, "effect"))  *field = EVENT_EFFECT;
         else if (!strcmp(token, "text"))    *field = EVENT_TEXT;
-        else log_msg(warn, MSG_W_UNRECFIELD, token), result = false;
+        else log_msg(ctx, warn, MSG_W_UNRECFIELD, token), result = false;
 
         field++;
       }
-    while ((token = strtok(NULL, ",")) != 0 && *field != 0);
+    while ((token = strtok_r(NULL, ",", &save)) != 0 && *field != 0);
 
     if (*field == 0)
-      log_msg(error, MSG_W_TOOMANYFIELDS, _("events"));
+      log_msg(ctx, error, MSG_W_TOOMANYFIELDS, _("events"));
     else
       *field = 0; /* set new list terminator after last param */
 
     return result;
   }
 
-bool
-get_ssa_event(char * const line, ssa_event * const event, int8_t *fieldlist)
+/* length of 'i'-th string of event, as it's packed, see ssa_event_pack() */
+static size_t
+ssa_event_str_len(struct span const * const str, uint8_t i)
   {
-    int8_t *field = fieldlist;
-    subtime st = { 0, 0, 0, 0.0 };
-    char *p = line, *delim = ",";
-    char buf[MAXLINE];
-    int len = -1;
-    double *t;
+    char const *nul = NULL;
+    size_t len = str->len;
 
-    if (!event || !line || !fieldlist)
-      return false;
+    if (len > 0 && (nul = memchr(str->ptr, '\0', len)) != NULL)
+      len = nul - str->ptr;
+    if (i < 3 && len > SSA_EVENT_FIELD_MAX)
+      len = SSA_EVENT_FIELD_MAX;
 
-    if ((p = strchr(line, ':')) == NULL) return false;
+    return len;
+  }
+
+/* splits event line to 'count' fields of 'fieldlist', missing ones *
+ * are empty. 'found' - how many fields are really in line           */
+static bool
+ssa_event_split(struct span const * const line, int8_t const *fieldlist,
+                struct span * const tokens, size_t * const count,
+                size_t * const found)
+  {
+    char const *p = NULL, *end = line->ptr + line->len;
+    struct span rest = { NULL, 0 };
+    size_t n = 0;
+    bool text = false;
+
+    if ((p = memchr(line->ptr, ':', line->len)) == NULL)
+      return false;
 
     p = p + 1; /* "EventType:|" */
 
-    while (*field != 0)
-      {
-        len = _strtok(p, delim);
-        if (len < 0) return false;
+    /* 'Text' field takes all rest of line, so no need to look further. *
+     * without it, one extra field catches the tail, like in styles     */
+    *count = 0;
+    while (*count < MAX_FIELDS && fieldlist[*count] != 0 && !text)
+      text = (fieldlist[(*count)++] == EVENT_TEXT);
+    rest.ptr = p, rest.len = end - p;
+    *found = n = span_split(&rest, ',', tokens, text ? *count : *count + 1);
 
-        if (len > 0 && len < MAXLINE)
-          {
-            strncpy(buf, p, len);
-            p += (len + strlen(delim));
-            buf[len] = '\0';
-          }
-        else /* len == 0 || len > MAXLINE */
-          buf[0] = '\0', p++;
+    for (; n < *count; n++) /* missing fields are empty */
+      tokens[n].ptr = end, tokens[n].len = 0;
+
+    return true;
+  }
+
+/* decodes 'fields' (SSA_F_*) of event from it's split line. *
+ * strings are only set to 'str', they are packed by caller  */
+static bool
+ssa_event_fields(ssa_event * const event, int8_t const *fieldlist, size_t count,
+                 struct span const *token, uint8_t fields,
+                 ssa_style_index const * const styles,
+                 struct span * const times, struct span str[4])
+  {
+    int8_t const *field = fieldlist;
+    subtime st = { 0, 0, 0, 0.0 };
+    char const *p = NULL;
+    size_t len = 0;
+
+    for (; field < fieldlist + count; field++, token++)
+      {
+        p = token->ptr, len = token->len;
 
         switch (*field)
           {
             case EVENT_LAYER :
-              event->layer = atoi(buf); /* little hack */
+              if (fields & SSA_F_NUMS)
+                event->layer = strntoi(p, len); /* little hack */
               break;
             case EVENT_START :
             case EVENT_END :
-              t = (*field == EVENT_START) ? &event->start : &event->end;
-              if (!str2subtime(buf, &st))
-                {
-                  log_msg(warn, _("Can't get timing at line '%u'."), line_num);
-                  return false;
-                }
+              if (!(fields & SSA_F_TIMES))
+                break;
+              if (!strn2subtime(p, len, &st))
+                return false;
+              if (*field == EVENT_START)
+                event->start = subtime2cs(&st);
               else
-                subtime2double(&st, t);
+                event->end   = subtime2cs(&st);
+              if (times == NULL)
+                break;
+              times[*field == EVENT_END] = *token;
+              span_trim(&times[*field == EVENT_END], LINE_START | LINE_END);
               break;
             case EVENT_STYLE :
-              STRNDUP(event->style, buf, MAXLINE);
+              str[0] = *token;
+              if (fields & SSA_F_STYLE)
+                event->style_id = ssa_style_id(styles, p, len);
               break;
             case EVENT_NAME :
-              STRNDUP(event->name, buf, MAXLINE);
+              str[1] = *token;
               break;
             case EVENT_MARGINL :
-              event->margin_l = atoi(buf);
+              if (fields & SSA_F_NUMS)
+                event->margin_l = strntoi(p, len);
               break;
             case EVENT_MARGINR :
-              event->margin_r = atoi(buf);
+              if (fields & SSA_F_NUMS)
+                event->margin_r = strntoi(p, len);
               break;
             case EVENT_MARGINV :
-              event->margin_v = atoi(buf);
+              if (fields & SSA_F_NUMS)
+                event->margin_v = strntoi(p, len);
               break;
             case EVENT_EFFECT :
-              STRNDUP(event->effect, buf, MAXLINE);
+              str[2] = *token;
               break;
             case EVENT_TEXT :
-              STRNDUP(event->text, buf, MAXLINE);
+              str[3] = *token;
               break;
             default :
               break;
           }
-        field++;
-        if (*field == EVENT_TEXT) delim = "";
       }
 
     return true;
   }
 
+/* Parses event line. Only 'fields' (SSA_F_*) are decoded, if    *
+ * line is kept as source of event (see ssa_event.src), others  *
+ * are decoded from it on first access. Times are always done   */
 bool
-get_ssa_media(ssa_media **list, ssa_media **h, char const * const line)
+get_ssa_event(arena * const mem, ssa_style_index const * const styles,
+              struct span const * const line, ssa_event * const event,
+              int8_t *fieldlist, struct span * const times, uint8_t fields)
   {
-    char *p = NULL;
+    struct span tokens[MAX_FIELDS + 1];
+    struct span str[4]; /* style, name, effect, text */
+    char const *end = NULL;
+    size_t count = 0, n = 0;
+
+    if (!event || !line || !fieldlist)
+      return false;
+
+    if (!ssa_event_split(line, fieldlist, tokens, &count, &n))
+      return false;
+
+    /* line is kept, if it's written back the same way */
+    if (n == count && count < MAX_FIELDS &&
+        memcmp(fieldlist, event_fields_normal_order, count + 1) == 0)
+      event->src = line->ptr, event->src_len = line->len;
+    else
+      fields = SSA_F_ALL; /* nothing to decode later from */
+
+    fields |= SSA_F_TIMES;
+    end = line->ptr + line->len;
+    for (n = 0; n < 4; n++)
+      str[n].ptr = end, str[n].len = 0;
+
+    if (!ssa_event_fields(event, fieldlist, count, tokens, fields,
+                          styles, times, str))
+      return false;
+
+    /* checked here, as lazy decoding has no way to warn */
+    for (n = 0; n < 3; n++)
+      if (str[n].len > SSA_EVENT_FIELD_MAX)
+        event->flags |= SSA_CUT;
+
+    if (fields & SSA_F_STRS)
+      ssa_event_pack(mem, event, str);
+    event->fields = fields;
+
+    return true;
+  }
+
+/* decodes 'fields' of event from it's source line, *
+ * which always has fields in normal order          */
+static void
+ssa_event_src_fields(ssa_event * const e, uint8_t fields,
+                     ssa_style_index const * const styles, struct span str[4])
+  {
+    struct span line = { NULL, 0 };
+    struct span tokens[MAX_FIELDS + 1];
+    struct span tmp[4];
+    size_t count = 0, n = 0;
+
+    line.ptr = e->src, line.len = e->src_len;
+    for (n = 0; n < 4; n++)
+      tmp[n].ptr = (e->src != NULL) ? e->src + e->src_len : "", tmp[n].len = 0;
+
+    if (e->src != NULL &&
+        ssa_event_split(&line, event_fields_normal_order, tokens, &count, &n))
+      ssa_event_fields(e, event_fields_normal_order, count, tokens,
+                       fields & ~SSA_F_TIMES, styles, NULL, tmp);
+
+    if (str == NULL)
+      return;
+
+    for (n = 0; n < 4; n++) /* the same, as packed ones */
+      str[n].ptr = tmp[n].ptr, str[n].len = ssa_event_str_len(&tmp[n], n);
+  }
+
+/* lazy part of parsing: decodes 'fields' of event, that was skipped *
+ * while parsing (see ssa_file.event_fields). strings go to arena    */
+void
+ssa_event_decode(ssa_file * const file, ssa_event * const e, uint8_t fields)
+  {
+    struct span str[4];
+
+    fields &= ~e->fields;
+    if (fields == 0 || e->src == NULL)
+      return;
+
+    ssa_event_src_fields(e, fields, &file->style_index, str);
+    if (fields & SSA_F_STRS)
+      ssa_event_pack(&file->mem, e, str);
+    e->fields |= fields;
+  }
+
+/* string fields of event without decoding: from packed strings, *
+ * or right from source line. empty, if event has none of them   */
+void
+ssa_event_strs(ssa_event const * const e, struct span str[4])
+  {
+    ssa_event tmp;
+
+    if (e->str != NULL)
+      {
+        str[0].ptr = e->str,             str[0].len = e->name - 1;
+        str[1].ptr = SSA_EVENT_NAME(e),   str[1].len = e->effect - e->name - 1;
+        str[2].ptr = SSA_EVENT_EFFECT(e), str[2].len = e->text - e->effect - 1;
+        str[3].ptr = SSA_EVENT_TEXT(e),   str[3].len = strlen(SSA_EVENT_TEXT(e));
+        return;
+      }
+
+    memcpy(&tmp, e, sizeof(ssa_event));
+    ssa_event_src_fields(&tmp, 0, NULL, str);
+  }
+
+bool
+get_ssa_media(context * const ctx, arena * const mem, ssa_media **list,
+              ssa_media **h, struct span const * const line, char const *input_end)
+  {
+    char const *p = NULL;
+    char const *end = NULL;
+    char hex[STORE_HEX_LEN + 1];
 
     if (list == NULL || h == NULL || line == NULL)
       return false;
 
-    switch (detect_media_line_type(line))
+    switch (detect_media_line_type(ctx, line))
       {
         case MEDIA_HEADER :
           if ((*h) != NULL) {
-              fflush((*h)->data);
-              CALLOC((*h)->next, 1, sizeof(ssa_media));
+              ACALLOC((*h)->next, mem, 1, sizeof(ssa_media));
               *h = (*h)->next;
             } else {
-              CALLOC((*h), 1, sizeof(ssa_media));
+              ACALLOC((*h), mem, 1, sizeof(ssa_media));
               *list = *h;
             }
-          if (strncmp(line, "fontname", 8) == 0)
+          if (span_starts(line, "fontname"))
             (*h)->type = type_font;
-          if (strncmp(line, "filename", 8) == 0)
+          if (span_starts(line, "filename"))
             (*h)->type = type_image;
-          if ((p = strchr(line, ':')) != NULL)
+          if ((p = memchr(line->ptr, ':', line->len)) != NULL)
           {
-            for (p += 1; *p != '\0' && isspace(*p); p++);
-            STRNDUP((*h)->filename, p, MAXLINE);
+            end = line->ptr + line->len;
+            for (p += 1; p < end && isspace(*p); p++);
+            ASTRNDUP((*h)->filename, mem, p, end - p);
           }
-          TMPFILE((*h)->data);
           break;
         case MEDIA_UUE_LINE :
-          fputs(line, (*h)->data);
-          fputs("\n", (*h)->data);
-          break;
         case MEDIA_UUE_TAIL :
-          fputs(line, (*h)->data);
-          fputs("\n", (*h)->data);
-          fflush((*h)->data);
+          if ((*h) == NULL)
+            break;
+          /* line of stripped media, it stays as data too */
+          if ((*h)->len == 0 && (*h)->data == NULL && (*h)->ref == NULL &&
+              store_ref(line->ptr, line->len, hex))
+            ASTRNDUP((*h)->ref, mem, hex, STORE_HEX_LEN);
+          ssa_media_line(ctx, *h, line, input_end);
           break;
         default :
           /* do nothing */
@@ -763,42 +1450,80 @@ get_ssa_media(ssa_media **list, ssa_media **h, char const * const line)
 /* write functions */
 
 bool
-write_ssa_file(FILE *outfile, ssa_file *f, bool memfree)
+write_ssa_file(context * const ctx, FILE *outfile, ssa_file *f, bool memfree)
   {
     bool result = true;
+    outbuf out;
+    jmp_buf env, *outer = ctx->abort;
 
     if (!outfile || !f)
       return false;
 
-    result &= write_ssa_header(outfile, f, memfree);
+    memset(&out, 0, sizeof(outbuf));
+
+    /* on error buffered data is dropped, file is incomplete */
+    if (setjmp(env) != 0)
+      {
+        ctx->abort = outer;
+        out.used = 0;
+        outbuf_close(&out);
+        if (memfree)
+          free_ssa_file(f);
+        return false;
+      }
+    ctx->abort = &env;
+
+    if (!outbuf_open(&out, ctx, outfile))
+      log_msg(ctx, error, MSG_F_WRFAIL);
+
+    result &= write_ssa_header(&out, f, memfree);
 
     if (f->styles)
-      result &= write_ssa_styles(outfile, f->styles, f->type, memfree);
+      result &= write_ssa_styles(&out, f->styles, f->type, memfree);
 
     if (f->events)
-      result &= write_ssa_events(outfile, f->events, f->type, memfree);
+      result &= write_ssa_events(&out, f->events, f->type, memfree);
+    else if (f->event_recs)
+      result &= write_ssa_event_recs(&out, f->event_recs, f->event_recs_count,
+                                     f->event_strs, f->event_strs_len, f->type);
 
     if (f->fonts)
-      result &= write_ssa_media(outfile, f->fonts, memfree);
+      result &= write_ssa_media(&out, f->fonts, memfree);
 
     if (f->images)
-      result &= write_ssa_media(outfile, f->images, memfree);
+      result &= write_ssa_media(&out, f->images, memfree);
+
+    outbuf_close(&out);
+
+    if (memfree)
+      free_ssa_file(f);
+
+    ctx->abort = outer;
 
     return result;
   }
 
 bool
-write_ssa_txt_param(FILE *outfile, char *name,\
+write_ssa_txt_param(outbuf * const out, char *name,\
                     char *data, bool flag, bool memfree)
   {
-    if (!outfile || !name)
+    if (!out || !name)
       return false;
 
     /* data CAN be NULL */
     if (flag && data)
-      fprintf(outfile, "%s: %s\n", name, data);
+      {
+        outbuf_puts(out, name);
+        outbuf_put(out, ": ", 2);
+        outbuf_puts(out, data);
+      }
     else
-      fprintf(outfile, ";%s:\n", name);
+      {
+        outbuf_putc(out, ';');
+        outbuf_puts(out, name);
+        outbuf_putc(out, ':');
+      }
+    outbuf_putc(out, '\n');
 
     if (memfree && data)
       free(data);
@@ -807,57 +1532,77 @@ write_ssa_txt_param(FILE *outfile, char *name,\
   }
 
 bool
-write_ssa_header(FILE *outfile, ssa_file * const f, bool memfree)
+write_ssa_header(outbuf * const out, ssa_file * const f, bool memfree)
   {
     struct slist *p = NULL, *l = NULL;
+    bool verbatim = false;
 
-    if (!outfile || !f) return false;
+    if (!out || !f) return false;
 
-    if (fprintf(outfile, "%s\n", "[Script Info]") < 0)
-      log_msg(error, MSG_F_WRFAIL);
+    outbuf_puts(out, "[Script Info]\n");
 
-    fprintf(outfile, "; Generated by: %s %.2f\n",
-              COMMON_PROG_NAME, VERSION);
+    /* untouched header goes as is, with comments */
+    verbatim = (f->head_src != NULL && !(f->flags & SSA_H_DIRTY));
+    if (verbatim)
+      outbuf_put(out, f->head_src, f->head_len);
+    else
+      outbuf_printf(out, "; Generated by: %s %.2f\n",
+                      COMMON_PROG_NAME, VERSION);
 
     /* text fields. validity should be checked during parsing */
     for (p = f->txt_params; p != NULL;)
       {
-        fprintf(outfile, "%s\n", p->value);
+        if (!verbatim)
+          outbuf_puts(out, p->value), outbuf_putc(out, '\n');
         l = p, p = p->next;
         if (memfree) free(l->value), free(l);
       }
 
-    if (f->sync != 0)
-      fprintf(outfile, "%s: %.0f\n", "Synch Point", f->sync);
+    if (verbatim)
+      {
+        outbuf_putc(out, '\n'); /* blank line after header */
+        return true;
+      }
 
-    fprintf(outfile, "%s%s: %i\n", (f->res.width) ? "" : ";",
-                        "PlayResX", f->res.width);
-    fprintf(outfile, "%s%s: %i\n", (f->res.height) ? "" : ";",
-                        "PlayResY", f->res.height);
-    fprintf(outfile, "%s%s: %i\n", (f->depth) ? "" : ";",
-                        "PlayDepth", f->depth);
+    if (f->sync != 0)
+      outbuf_printf(out, "%s: %.0f\n", "Synch Point", f->sync);
+
+    outbuf_puts(out, (f->res.width)  ? "PlayResX: "  : ";PlayResX: ");
+    outbuf_int(out, (int) f->res.width, 0);
+    outbuf_putc(out, '\n');
+    outbuf_puts(out, (f->res.height) ? "PlayResY: "  : ";PlayResY: ");
+    outbuf_int(out, (int) f->res.height, 0);
+    outbuf_putc(out, '\n');
+    outbuf_puts(out, (f->depth)      ? "PlayDepth: " : ";PlayDepth: ");
+    outbuf_int(out, f->depth, 0);
+    outbuf_putc(out, '\n');
 
     /* theses fields MUST present */
-    fprintf(outfile, "%s: %s\n", "ScriptType", ssa_version_tos(f->type));
-    fprintf(outfile, "%s: %.4f\n", "Timer",              f->timer);
+    outbuf_puts(out, "ScriptType: ");
+    outbuf_puts(out, ssa_version_tos(f->type));
+    outbuf_putc(out, '\n');
+    outbuf_printf(out, "%s: %.4f\n", "Timer", f->timer);
 
     if (f->type >= ssa_v4p)
-        fprintf(outfile, "%s: %i\n", "WrapStyle",          f->wrap);
+      {
+        outbuf_puts(out, "WrapStyle: ");
+        outbuf_int(out, f->wrap, 0);
+        outbuf_putc(out, '\n');
+      }
 
-    fputc('\n', outfile); /* blank line after header */
+    outbuf_putc(out, '\n'); /* blank line after header */
 
     return true;
   }
 
 bool
-write_ssa_styles(FILE * outfile, ssa_style  * const style, ssa_version v, bool memfree)
+write_ssa_styles(outbuf * const out, ssa_style  * const style, ssa_version v, bool memfree)
   {
     char *s = "";
     char *format;
-    int write = 0;
     bool section_header = true;
     bool format_string = true;
-    ssa_style *ptr = style, *prev;
+    ssa_style *ptr = style;
 
     switch (v)
       {
@@ -880,89 +1625,109 @@ write_ssa_styles(FILE * outfile, ssa_style  * const style, ssa_version v, bool m
       }
 
     if (section_header)
-      write = fprintf(outfile, "[V4%s Styles]\n", s);
+      {
+        outbuf_puts(out, "[V4");
+        outbuf_puts(out, s);
+        outbuf_puts(out, " Styles]\n");
+      }
 
     if (format_string)
-      write = fprintf(outfile, format);
-
-    if (write < 0)
-      log_msg(error, MSG_F_WRFAIL);
+      outbuf_puts(out, format);
 
-    putc('\n', outfile);
+    outbuf_putc(out, '\n');
 
-    while (ptr != NULL)
-      {
-        write_ssa_style(outfile, ptr, v);
-        prev = ptr;
-        ptr = ptr->next;
-        if (memfree) free(prev);
-      }
+    /* memory will be freed with arena in write_ssa_file() */
+    for (; ptr != NULL; ptr = ptr->next)
+      write_ssa_style(out, ptr, v);
 
-    fputc('\n', outfile);
+    outbuf_putc(out, '\n');
 
     return true;
   }
 
+/* puts integer field with trailing comma */
+#define OUT_INT(out, num) \
+  outbuf_int((out), (num), 0), outbuf_putc((out), ',')
+
 bool
-write_ssa_style(FILE * outfile, ssa_style  * const style, ssa_version v)
+write_ssa_style(outbuf * const out, ssa_style  * const style, ssa_version v)
   {
-    char *color_format;
     bool alphalevel = true;
 
-    fprintf(outfile, "Style: %s,%s,%.0f,", \
-              style->name, style->fontname, style->fontsize);
+    if (style->src != NULL && !(style->flags & SSA_DIRTY))
+      {
+        outbuf_puts(out, style->src);
+        outbuf_putc(out, '\n');
+        return true;
+      }
+
+    outbuf_put(out, "Style: ", 7);
+    outbuf_puts(out, style->name);
+    outbuf_putc(out, ',');
+    outbuf_puts(out, style->fontname);
+    outbuf_printf(out, ",%.0f,", style->fontsize);
 
     /* various versions have a different color format representation */
     switch (v)
       {
         case ssa_v4p : /* ssa_v4+ uses more nice-looking hex format */
-          color_format = "&H%08X,&H%08X,&H%08X,&H%08X,";
+          outbuf_put(out, "&H", 2), outbuf_hex(out, style->pr_color, 8);
+          outbuf_put(out, ",&H", 3), outbuf_hex(out, style->se_color, 8);
+          outbuf_put(out, ",&H", 3), outbuf_hex(out, style->tr_color, 8);
+          outbuf_put(out, ",&H", 3), outbuf_hex(out, style->bg_color, 8);
+          outbuf_putc(out, ',');
           alphalevel = false;
           break;
         case ssa_v4 : /* all other uses raw integer */
         case ssa_v3 :
         case ssa_unknown:
         default :
-          color_format = "%i,%i,%i,%i,";
+          OUT_INT(out, (int32_t) style->pr_color);
+          OUT_INT(out, (int32_t) style->se_color);
+          OUT_INT(out, (int32_t) style->tr_color);
+          OUT_INT(out, (int32_t) style->bg_color);
           break;
       }
 
-    fprintf(outfile, color_format, \
-              style->pr_color, style->se_color, \
-              style->tr_color, style->bg_color);
-
-    fprintf(outfile, "%i,%i,", style->bold, style->italic);
+    OUT_INT(out, style->bold);
+    OUT_INT(out, style->italic);
 
     /* ssa v4+ specific parameters ^_^ */
     if (v == ssa_v4p)
-      fprintf(outfile, "%i,%i,%i,%i,%i,%.0f,", \
-                style->underlined, style->strikeout, \
-                style->scale_x, style->scale_y, \
-                style->spacing, style->angle);
+      {
+        OUT_INT(out, style->underlined);
+        OUT_INT(out, style->strikeout);
+        OUT_INT(out, style->scale_x);
+        OUT_INT(out, style->scale_y);
+        OUT_INT(out, style->spacing);
+        outbuf_printf(out, "%.0f,", style->angle);
+      }
 
-    fprintf(outfile, "%i,%i,%i,%i,",  \
-                style->brd_style, style->outline, \
-                style->shadow,    style->alignment);
+    OUT_INT(out, style->brd_style);
+    OUT_INT(out, style->outline);
+    OUT_INT(out, style->shadow);
+    OUT_INT(out, style->alignment);
 
-    fprintf(outfile, "%i,%i,%i,",  \
-                style->margin_l, style->margin_r, style->margin_v);
+    OUT_INT(out, style->margin_l);
+    OUT_INT(out, style->margin_r);
+    OUT_INT(out, style->margin_v);
 
     if (alphalevel)
-        fprintf(outfile, "%i,", style->a_level);
+      OUT_INT(out, style->a_level);
 
-    fprintf(outfile, "%i\n", style->codepage);
+    outbuf_int(out, style->codepage, 0);
+    outbuf_putc(out, '\n');
 
     return true;
   }
 
+/* section name & 'Format:' line, false for unknown version */
 bool
-write_ssa_events(FILE * outfile, ssa_event * const events, ssa_version v, bool memfree)
+write_ssa_events_head(outbuf * const out, ssa_version v)
   {
     char *format;
-    int write = 0;
     bool section_header = true;
     bool format_string = true;
-    ssa_event *ptr = events, *prev;
 
     switch (v)
       {
@@ -983,104 +1748,202 @@ write_ssa_events(FILE * outfile, ssa_event * const events, ssa_version v, bool m
       }
 
     if (section_header)
-      write = fprintf(outfile, "[Events]\n");
+      outbuf_puts(out, "[Events]\n");
 
     if (format_string)
-      write = fprintf(outfile, "%s\n", format);
+      {
+        outbuf_puts(out, format);
+        outbuf_putc(out, '\n');
+      }
+
+    return true;
+  }
+
+bool
+write_ssa_events(outbuf * const out, ssa_event * const events, ssa_version v, bool memfree)
+  {
+    ssa_event *ptr = events;
+
+    if (!write_ssa_events_head(out, v))
+      return false;
+
+    for (; ptr != NULL; ptr = ptr->next)
+      write_ssa_event(out, ptr, v);
+
+    outbuf_putc(out, '\n');
+
+    return true;
+  }
 
-    if (write < 0)
-      log_msg(error, MSG_F_WRFAIL);
+/* same as write_ssa_events(), but for 'count' records of compiled *
+ * file with 'len' bytes of strings in 'strs', which should end    *
+ * with '\0'. each record is copied to stack, so nothing is        *
+ * allocated or changed in (read-only) mapped memory. records with *
+ * strings out of 'strs' are skipped                               */
+bool
+write_ssa_event_recs(outbuf * const out, ssa_event_rec const *recs,
+                     size_t count, char const *strs, size_t len, ssa_version v)
+  {
+    ssa_event e;
+    size_t i = 0;
+
+    if (!write_ssa_events_head(out, v))
+      return false;
 
-    while (ptr != NULL)
+    memset(&e, 0, sizeof(ssa_event));
+    for (i = 0; i < count; i++, recs++)
       {
-        write_ssa_event(outfile, ptr, v);
-        prev = ptr;
-        ptr = ptr->next;
-        if (memfree) free(prev->text), free(prev);
+        if ((size_t) recs->str + recs->text >= len)
+          continue;
+        e.str   = (char *) strs + recs->str;
+        e.start = recs->start,      e.end = recs->end;
+        e.layer = recs->layer,      e.style_id = recs->style_id;
+        e.margin_r = recs->margin_r, e.margin_l = recs->margin_l;
+        e.margin_v = recs->margin_v;
+        e.name  = recs->name,       e.effect = recs->effect;
+        e.text  = recs->text,       e.type = recs->type;
+        e.fields = SSA_F_ALL;
+        write_ssa_event(out, &e, v);
       }
 
-    fputc('\n', outfile);
+    outbuf_putc(out, '\n');
 
     return true;
   }
 
 bool
-write_ssa_event(FILE *outfile, ssa_event * const event, ssa_version v)
+write_ssa_event(outbuf * const out, ssa_event * const event, ssa_version v)
   {
-    struct subtime st;
     char *type = "";
+    ssa_event const *e = event;
+    ssa_event tmp;
+    struct span str[4]; /* style, name, effect, text */
 
-    switch (event->type)
+    if (event->src != NULL && !(event->flags & SSA_DIRTY))
+      {
+        outbuf_put(out, event->src, event->src_len);
+        outbuf_putc(out, '\n');
+        return true;
+      }
+
+    /* fields, not decoded yet, are taken from source line */
+    if (event->src != NULL && (event->str == NULL || !(event->fields & SSA_F_NUMS)))
+      {
+        memcpy(&tmp, event, sizeof(ssa_event));
+        ssa_event_src_fields(&tmp, SSA_F_NUMS & ~event->fields, NULL, str);
+        e = &tmp;
+      }
+    if (event->str != NULL || event->src == NULL)
+      ssa_event_strs(event, str);
+
+    switch (e->type)
       {
         case COMMAND  :
-        case DIALOGUE : type = "Dialogue"; break;
-        case COMMENT  : type = "Comment";  break;
-        case MOVIE    : type = "Movie";    break;
-        case PICTURE  : type = "Picture";  break;
-        case SOUND    : type = "Sound";    break;
-        default       : type = "";         break;
-      }
-    fprintf(outfile, "%s: %s%i,", type, (v == ssa_v4) ? "Marked=" : "", event->layer);
-
-    event->start = round(event->start * 100.0) / 100.0;
-    double2subtime(event->start, &st);
-    fprintf(outfile, "%i:%02i:%02i.%02i,",
-        st.hrs, st.min, st.sec, st.msec / 10);
-
-    event->end   = round(event->end   * 100.0) / 100.0;
-    double2subtime(event->end, &st);
-    fprintf(outfile, "%i:%02i:%02i.%02i,",
-        st.hrs, st.min, st.sec, st.msec / 10);
-
-    fprintf(outfile, "%s,%s,%04i,%04i,%04i,%s,%s", \
-                    event->style, event->name,\
-                    event->margin_l, event->margin_r, event->margin_v, \
-                    event->effect, event->text);
-    fputc('\n', outfile);
+        case DIALOGUE : type = "Dialogue: "; break;
+        case COMMENT  : type = "Comment: ";  break;
+        case MOVIE    : type = "Movie: ";    break;
+        case PICTURE  : type = "Picture: ";  break;
+        case SOUND    : type = "Sound: ";    break;
+        default       : type = ": ";         break;
+      }
+    outbuf_puts(out, type);
+    if (v == ssa_v4)
+      outbuf_put(out, "Marked=", 7);
+    OUT_INT(out, (int32_t) e->layer);
+
+    /* timing rounded to centiseconds, event itself untouched */
+    outbuf_time(out, e->start), outbuf_putc(out, ',');
+    outbuf_time(out, e->end),   outbuf_putc(out, ',');
+
+    outbuf_put(out, str[0].ptr, str[0].len), outbuf_putc(out, ',');
+    outbuf_put(out, str[1].ptr, str[1].len), outbuf_putc(out, ',');
+
+    outbuf_int(out, e->margin_l, 4), outbuf_putc(out, ',');
+    outbuf_int(out, e->margin_r, 4), outbuf_putc(out, ',');
+    outbuf_int(out, e->margin_v, 4), outbuf_putc(out, ',');
+
+    outbuf_put(out, str[2].ptr, str[2].len), outbuf_putc(out, ',');
+    outbuf_put(out, str[3].ptr, str[3].len);
+    outbuf_putc(out, '\n');
 
     return true;
   }
 
+/* stripped media, encoded back from store by pieces of whole lines */
+static void
+write_ssa_media_stored(outbuf * const out, ssa_media * const m)
+  {
+    uint8_t *data = NULL;
+    char *buf = NULL;
+    size_t len = 0, pos = 0, n = 0;
+    size_t const piece = UUE_LINE_BYTES * 1024;
+
+    if ((data = store_get(out->ctx, out->ctx->opts.i_store, m->ref, &len)) == NULL)
+      log_msg(out->ctx, error, MSG_F_RDFAIL, m->filename);
+
+    CALLOC(buf, uue_encoded_len(piece), sizeof(char));
+
+    for (pos = 0; pos < len; pos += n)
+      {
+        n = (len - pos < piece) ? len - pos : piece;
+        outbuf_put(out, buf, uue_encode(buf, data + pos, n));
+      }
+
+    free(buf);
+    free(data);
+  }
+
+/* uue lines of one font or image, wherever they are */
+void
+write_ssa_media_data(outbuf * const out, ssa_media * const m)
+  {
+    size_t read = 0;
+    char buf[MAXLINE];
+
+    if (m->ref != NULL && out->ctx->opts.i_store != NULL)
+      write_ssa_media_stored(out, m);
+    else if (m->raw != NULL) /* compiled or piped file */
+      outbuf_put(out, m->raw, m->len);
+    else if (m->data == NULL) /* range of input file */
+      outbuf_copy(out, m->fd, m->offset, m->len);
+    else
+      {
+        rewind(m->data);
+        while ((read = fread(buf, sizeof(char), MAXLINE, m->data)) > 0)
+          outbuf_put(out, buf, read);
+
+        if (ferror(m->data))
+          log_msg(out->ctx, error, "%s", strerror(errno));
+      }
+  }
+
 bool
-write_ssa_media(FILE * outfile, ssa_media * const list, bool memfree)
+write_ssa_media(outbuf * const out, ssa_media * const list, bool memfree)
   {
     ssa_media *h = NULL;
     ssa_media *t = NULL;
-    char *media_type = NULL;
-    size_t read = 0;
-    uint8_t buf[MAXLINE];
 
-    if (!outfile || !list)
+    if (!out || !list)
       return false;
 
     h = list;
-    media_type = (h->type == type_font) ? "Fonts" : "Graphics";
-    fprintf(outfile, "[%s]\n", media_type);
+    outbuf_puts(out, (h->type == type_font) ? "[Fonts]\n" : "[Graphics]\n");
 
     while (h != NULL)
       {
-        media_type = (h->type == type_font) ? "fontname" : "filename";
-        fprintf(outfile, "%s: %s\n", media_type, h->filename);
-
-        rewind(h->data);
-        while ((read = fread(buf, sizeof(uint8_t), MAXLINE, h->data)) > 0)
-          fwrite(buf, sizeof(uint8_t), read, outfile);
+        outbuf_puts(out, (h->type == type_font) ? "fontname: " : "filename: ");
+        outbuf_puts(out, h->filename);
+        outbuf_putc(out, '\n');
 
-        if (errno)
-          log_msg(error, "%s", strerror(errno));
-        fflush(outfile);
+        write_ssa_media_data(out, h);
 
         t = h;
         h = h->next;
-        if (memfree == true)
-          {
-            free(t->filename);
-            fclose(t->data);
-            free(t);
-          }
+        if (memfree == true && t->data != NULL)
+          fclose(t->data);
       }
 
-    fputc('\n', outfile);
+    outbuf_putc(out, '\n');
 
     return true;
   }
@@ -1088,17 +1951,20 @@ write_ssa_media(FILE * outfile, ssa_media * const list, bool memfree)
 /* other */
 
 uint32_t
-ssa_color(char * const line)
+ssa_color(struct span const * const line)
   {
     uint32_t color = 0;
-    int len = strlen(line);
+    char const *p = line->ptr;
+    char const *end = line->ptr + line->len;
 
-    if (len < 1) /* empty line */
+    if (line->len < 1) /* empty line */
       return (uint32_t) 0xFFFFFFFF; /* pure white */
-    else if (len > 2 && line[0] == '&')
-      sscanf(line + 2, "%X", &color);
-    else if (isdigit(*line))
-      color = atoi(line);
+    else if (line->len > 2 && *p == '&')
+      for (p += 2; p < end && isxdigit(*p); p++)
+        color = color * 16 + ((isdigit(*p)) ? *p - '0' : toupper(*p) - 'A' + 10);
+    else if (isdigit(*p))
+      for (; p < end && isdigit(*p); p++)
+        color = color * 10 + (*p - '0');
 
     return color;
   }
@@ -1126,17 +1992,18 @@ ssa_version_tos(ssa_version version)
 
 /* returns true, if changes section and false otherwise */
 bool
-ssa_section_switch(enum ssa_section *section, char const * const line)
+ssa_section_switch(context * const ctx, enum ssa_section *section,
+                   struct span const * const line)
   {
     char buf[MAXLINE] = "";
 
     if (!section || !line)
       return false;
 
-    if (line[0] != '[')
+    if (line->len == 0 || line->ptr[0] != '[')
       return false;
 
-    strncpy(buf, line, MAXLINE);
+    memcpy(buf, line->ptr, (line->len < MAXLINE) ? line->len : MAXLINE - 1);
     string_lowercase(buf, 0);
 
          if (!strcmp(buf, "[script info]")) *section = HEADER;
@@ -1147,7 +2014,8 @@ ssa_section_switch(enum ssa_section *section, char const * const line)
     else if (!strcmp(buf, "[v4+ styles]"))  *section = STYLES;
     else
       {
-        log_msg(warn, _("Unknown ssa section '%s' at line '%u'."), line, line_num);
+        log_msg(ctx, warn, _("Unknown ssa section '%.*s' at line '%u'."),
+                (int) line->len, line->ptr, ctx->line_num);
         *section = UNKNOWN; /* by default */
         return false;
       }
@@ -1155,37 +2023,168 @@ ssa_section_switch(enum ssa_section *section, char const * const line)
     return true;
   }
 
+/* events always appended to the end of list, *
+ * sorting, if needed, done after parsing     */
 void
-ssa_event_append(ssa_event **head, ssa_event ***tail,
-                 ssa_event * const e, bool sort)
+ssa_event_append(ssa_event **head, ssa_event ***tail, ssa_event * const e)
   {
-    ssa_event *t = NULL;
-
     if (*head == NULL)
       *head = e;
-    else if (**tail != NULL && (!sort || e->start > (**tail)->start))
+    else
       (**tail)->next = e, *tail = &(**tail)->next;
-    else /* *tail == NULL || (tail != NULL && e->start <= (*tail)->start) */
-      for (t = *head; t != NULL && t->next != NULL; t = t->next)
-        if (t->next->start > e->start)
+  }
+
+/* sort key for events_sort() */
+double
+ssa_event_start(void const *e)
+  {
+    return ((ssa_event const *) e)->start;
+  }
+
+/* Packs style, name, effect & text ('str', in this order) of event *
+ * into one arena block. first three are cut to SSA_EVENT_FIELD_MAX *
+ * bytes (parser warns, see SSA_CUT), all of them - at first '\0',  *
+ * like arena_strndup() does                                        */
+void
+ssa_event_pack(arena * const mem, ssa_event * const e,
+               struct span const str[4])
+  {
+    size_t len[4], total = 0;
+    char *p = NULL;
+    uint8_t i = 0;
+
+    for (i = 0; i < 4; i++)
+      {
+        len[i] = ssa_event_str_len(&str[i], i);
+        total += len[i] + 1;
+      }
+
+    ACALLOC(e->str, mem, total, sizeof(char));
+
+    for (p = e->str, i = 0; i < 4; i++)
+      {
+        switch (i)
           {
-            e->next = t->next, t->next = e;
-            break;
+            case 1 : e->name   = p - e->str; break;
+            case 2 : e->effect = p - e->str; break;
+            case 3 : e->text   = p - e->str; break;
+            default : break;
           }
+        if (len[i] > 0)
+          memcpy(p, str[i].ptr, len[i]);
+        p += len[i] + 1; /* '\0' is already here */
+      }
+  }
+
+/* FNV-1a */
+static uint32_t
+ssa_style_hash(char const *name, size_t len)
+  {
+    uint32_t h = 2166136261U;
+
+    while (len --> 0)
+      h = (h ^ (unsigned char) *name++) * 16777619U;
+
+    return h;
+  }
+
+/* slot with style of this name, or free slot, where it should be */
+static ssa_style **
+ssa_style_slot(ssa_style_index const * const idx, char const *name, size_t len)
+  {
+    uint32_t mask = idx->size - 1;
+    uint32_t i = ssa_style_hash(name, len) & mask;
+    ssa_style **slot = NULL;
+
+    for (;; i = (i + 1) & mask)
+      {
+        slot = &idx->slots[i];
+        if (*slot == NULL || (strncmp((*slot)->name, name, len) == 0 &&
+                              (*slot)->name[len] == '\0'))
+          return slot;
+      }
+  }
+
+static void
+ssa_style_index_grow(arena * const mem, ssa_style_index * const idx)
+  {
+    ssa_style **old = idx->slots;
+    uint32_t size = idx->size, i = 0;
+
+    idx->size = (size == 0) ? 64 : size * 2;
+    ACALLOC(idx->slots, mem, idx->size, sizeof(ssa_style *));
+
+    for (i = 0; i < size; i++)
+      if (old[i] != NULL)
+        *ssa_style_slot(idx, old[i]->name, strlen(old[i]->name)) = old[i];
+  }
+
+/* Appends style to list of file and registers it's name in index. *
+ * Returns id of style. Style with already known name keeps it's   *
+ * place in list, but gets id of first one, as it can't be found   *
+ * by name anyway.                                                 */
+uint16_t
+ssa_style_add(ssa_file * const file, ssa_style * const style)
+  {
+    ssa_style_index *idx = &file->style_index;
+    ssa_style **slot = NULL;
+
+    if (file->styles_tail == NULL) /* list was built by hand */
+      for (file->styles_tail = &file->styles; *file->styles_tail != NULL;)
+        file->styles_tail = &(*file->styles_tail)->next;
+
+    *file->styles_tail = style;
+    file->styles_tail = &style->next;
+    style->id = SSA_STYLE_UNKNOWN;
+
+    if (style->name == NULL)
+      return style->id;
+
+    if ((idx->count + 1) * 4 > idx->size * 3) /* keep load below 3/4 */
+      ssa_style_index_grow(&file->mem, idx);
+
+    slot = ssa_style_slot(idx, style->name, strlen(style->name));
+
+    if (*slot != NULL)
+      return style->id = (*slot)->id;
+
+    if (idx->count < SSA_STYLES_MAX)
+      *slot = style, style->id = idx->count++;
 
+    return style->id;
+  }
+
+/* name isn't null-terminated here, as it usually points to input line */
+uint16_t
+ssa_style_id(ssa_style_index const * const idx, char const *name, size_t len)
+  {
+    ssa_style **slot = NULL;
+
+    if (idx == NULL || idx->count == 0)
+      return SSA_STYLE_UNKNOWN;
+
+    slot = ssa_style_slot(idx, name, len);
+
+    return (*slot != NULL) ? (*slot)->id : SSA_STYLE_UNKNOWN;
   }
 
 ssa_style *
 find_ssa_style_by_name(ssa_file *f, char *name)
   {
-    ssa_style *s = NULL;
+    ssa_style *s = NULL, **slot = NULL;
 
     if (!f || !name)
       return NULL;
 
-    /* else */
+    if (f->style_index.count > 0)
+      {
+        slot = ssa_style_slot(&f->style_index, name, strlen(name));
+        return *slot;
+      }
+
+    /* styles list was built by hand, without index */
     for (s = f->styles; s != NULL; s = s->next)
-      if (strcmp(name, s->name) == 0)
+      if (s->name != NULL && strcmp(name, s->name) == 0)
         return s;
 
     /* if this not works */
@@ -1193,31 +2192,30 @@ find_ssa_style_by_name(ssa_file *f, char *name)
   }
 
 int8_t
-detect_media_line_type(char const * const line)
+detect_media_line_type(context * const ctx, struct span const * const line)
   {
-    ssize_t len = 0;
+    size_t len = line->len;
 
-    len = strlen(line);
     if (len == 80)
       return MEDIA_UUE_LINE;
 
     if (len == 0)
       return MEDIA_UUE_TAIL;
 
-    if (strncmp(line, "fontname:", 9) == 0)
+    if (span_starts(line, "fontname:"))
       return MEDIA_HEADER;
 
-    if (strncmp(line, "filename:", 9) == 0)
+    if (span_starts(line, "filename:"))
       return MEDIA_HEADER;
 
     /* The keywords above MUST be lowercase, but we should     *
      * remember about not-well-coded applications, who think   *
      * that 'filename' should conforms to style of other lines */
-    if (len >= 9 && (strncmp((line + 1), "ontname:", 8) == 0 ||
-                     strncmp((line + 1), "ilename:", 8) == 0))
+    if (len >= 9 && (memcmp((line->ptr + 1), "ontname:", 8) == 0 ||
+                     memcmp((line->ptr + 1), "ilename:", 8) == 0))
       {
-        log_msg(warn, _("Keyword '*name' must be fully lowercase: %u:%s"), \
-                      line_num, line);
+        log_msg(ctx, warn, _("Keyword '*name' must be fully lowercase: %u:%.*s"), \
+                      ctx->line_num, (int) len, line->ptr);
         return MEDIA_HEADER;
       }
 
@@ -1226,3 +2224,159 @@ detect_media_line_type(char const * const line)
 
     return MEDIA_UNKNOWN;
   }
+
+/* by start time, then by position in list, so order is stable */
+static int
+ssa_event_ivl_cmp(void const *a, void const *b)
+  {
+    ssa_event_ivl const *x = a, *y = b;
+
+    if (x->start != y->start)
+      return (x->start < y->start) ? -1 : 1;
+
+    return (x->num < y->num) ? -1 : (x->num > y->num);
+  }
+
+/* Builds index over events of 'file' in O(n log n), or O(n) *
+ * for sorted events. nodes of level 'k' are items with      *
+ * index, which lowest k + 1 bits are 0111..1 (k ones), so   *
+ * leaves are even items and root is (1 << levels) - 1. for  *
+ * incomplete tree, missing right subtrees are replaced by   *
+ * the last existing node on their level.                    */
+void
+ssa_event_index_build(ssa_file * const file, ssa_event_index * const idx)
+  {
+    ssa_event_ivl *a = NULL;
+    ssa_event *e = NULL;
+    size_t n = 0, i = 0, last_i = 0, x = 0;
+    int32_t last = 0, el = 0, er = 0, m = 0;
+    bool sorted = true;
+    int8_t k = 0;
+
+    memset(idx, 0, sizeof(ssa_event_index));
+    idx->levels = -1;
+
+    for (e = file->events; e != NULL; e = e->next)
+      n++;
+
+    if (n == 0)
+      return;
+
+    ACALLOC(a, &file->mem, n, sizeof(ssa_event_ivl));
+
+    for (e = file->events, i = 0; e != NULL; e = e->next, i++)
+      {
+        a[i].start = e->start, a[i].end = e->end;
+        a[i].num = i, a[i].event = e;
+        if (i > 0 && a[i].start < a[i - 1].start)
+          sorted = false;
+      }
+
+    if (!sorted)
+      qsort(a, n, sizeof(ssa_event_ivl), ssa_event_ivl_cmp);
+
+    for (i = 0; i < n; i += 2) /* leaves */
+      last_i = i, last = a[i].max = a[i].end;
+
+    for (k = 1; ((size_t) 1 << k) <= n; k++)
+      {
+        x = (size_t) 1 << (k - 1);
+        for (i = (x << 1) - 1; i < n; i += x << 2)
+          {
+            el = a[i - x].max;
+            er = (i + x < n) ? a[i + x].max : last;
+            m = a[i].end;
+            m = (m > el) ? m : el;
+            a[i].max = (m > er) ? m : er;
+          }
+        /* parent of last node on this level */
+        last_i = ((last_i >> k) & 1) ? last_i - x : last_i + x;
+        if (last_i < n && a[last_i].max > last)
+          last = a[last_i].max;
+      }
+
+    idx->items = a;
+    idx->count = n;
+    idx->levels = k - 1;
+  }
+
+/* Calls 'fn' for each event, which overlaps [from, to), i.e.   *
+ * starts before 'to' & ends after 'from', in order of start.   *
+ * returns number of them. O(log n + k) for k found events      */
+size_t
+ssa_event_index_overlap(ssa_event_index const * const idx, int32_t from,
+                        int32_t to, ssa_event_index_f fn, void *arg)
+  {
+    struct { size_t x; int8_t k; bool right; } stack[64], z;
+    ssa_event_ivl const *a = idx->items;
+    size_t n = idx->count, found = 0, i = 0, i1 = 0, y = 0;
+    uint8_t t = 0;
+
+    if (idx->levels < 0)
+      return 0;
+
+    stack[t].x = ((size_t) 1 << idx->levels) - 1;
+    stack[t].k = idx->levels, stack[t++].right = false;
+
+    while (t > 0)
+      {
+        z = stack[--t];
+        if (z.k <= 3) /* small subtree: simply scan it */
+          {
+            i  = z.x >> z.k << z.k;
+            i1 = i + ((size_t) 1 << (z.k + 1)) - 1;
+            if (i1 > n)
+              i1 = n;
+            for (; i < i1 && a[i].start < to; i++)
+              if (a[i].end > from)
+                found++, fn(&a[i], arg);
+          }
+        else if (!z.right) /* node itself & right subtree later, left now */
+          {
+            y = z.x - ((size_t) 1 << (z.k - 1));
+            z.right = true, stack[t++] = z;
+            if (y >= n || a[y].max > from)
+              stack[t].x = y, stack[t].k = z.k - 1, stack[t++].right = false;
+          }
+        else if (z.x < n && a[z.x].start < to)
+          {
+            if (a[z.x].end > from)
+              found++, fn(&a[z.x], arg);
+            stack[t].x = z.x + ((size_t) 1 << (z.k - 1));
+            stack[t].k = z.k - 1, stack[t++].right = false;
+          }
+      }
+
+    return found;
+  }
+
+/* Calls 'fn' for each event, which starts in [from, to), *
+ * in order of start. binary search, so O(log n + k)      */
+size_t
+ssa_event_index_starts(ssa_event_index const * const idx, int32_t from,
+                       int32_t to, ssa_event_index_f fn, void *arg)
+  {
+    size_t lo = 0, hi = idx->count, mid = 0, found = 0;
+
+    while (lo < hi)
+      {
+        mid = lo + (hi - lo) / 2;
+        if (idx->items[mid].start < from)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+
+    for (; lo < idx->count && idx->items[lo].start < to; lo++)
+      found++, fn(&idx->items[lo], arg);
+
+    return found;
+  }
+
+/* events, shown at time 't' */
+size_t
+ssa_event_index_active(ssa_event_index const * const idx, int32_t t,
+                       ssa_event_index_f fn, void *arg)
+  {
+    return ssa_event_index_overlap(idx, t, t + 1, fn, arg);
+  }
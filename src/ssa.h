@@ -22,7 +22,30 @@
 
 #define SSA_DEFAULT_FONT "Sans"
 
+/* [Events] section smaller than this always parsed in one thread */
+#define SSA_EVENTS_MT_SIZE (4 * 1024 * 1024)
+#define SSA_THREADS_MAX    8
+
 #define SSA_E_SORTED   0x01
+#define SSA_H_DIRTY    0x02 /* header should be regenerated */
+
+/* entity was changed after parsing, it's source line is outdated */
+#define SSA_DIRTY      0x01
+/* style, name or effect of event is over SSA_EVENT_FIELD_MAX, *
+ * so it's cut, if event is formatted again                    */
+#define SSA_CUT        0x02
+
+/* groups of event fields, see ssa_file.event_fields. times are *
+ * always decoded while parsing, they are checked there         */
+#define SSA_F_TIMES    0x01 /* start & end          */
+#define SSA_F_STYLE    0x02 /* style id             */
+#define SSA_F_NUMS     0x04 /* layer & margins      */
+#define SSA_F_STRS     0x08 /* packed strings ('str') */
+#define SSA_F_ALL      0x0F
+
+/* style ids are dense: 0 .. (number of unique style names - 1) */
+#define SSA_STYLE_UNKNOWN 0xFFFF /* event's style not defined in file */
+#define SSA_STYLES_MAX    0xFFFE
 
 #define MEDIA_UNKNOWN  0x0
 #define MEDIA_HEADER   0x1
@@ -76,8 +99,21 @@ typedef struct ssa_style
     uint16_t margin_v;  /*  `------------'  */
     uint8_t a_level;    /* not used neither in ssa, nor in ass */
     uint8_t codepage;   /* 204 - russian */
+
+    uint16_t id;        /* index in ssa_file styles table */
+    uint8_t flags;      /* SSA_DIRTY */
+    char *src;          /* source line, copy. NULL - regenerate */
   } ssa_style;
 
+/* styles by name: open addressing hash table, *
+ * all memory lives in arena of ssa_file       */
+typedef struct ssa_style_index
+  {
+    ssa_style **slots;  /* 'size' entries, NULL - free slot */
+    uint32_t size;      /* power of 2 */
+    uint16_t count;     /* unique names, also next free id */
+  } ssa_style_index;
+
 /* Defined order & names below matches ssa_v4+ *
  * For use with ssa_v4 - rename #6, throw away *
  * ##10-15,23 and update value in #4-7 and 19  */
@@ -121,22 +157,61 @@ typedef enum ssa_event_type
     SOUND
   } ssa_event_type;
 
+/* compact record: times in centiseconds, 16-bit ids and    *
+ * all strings packed by ssa_event_pack() into one arena     *
+ * block as "style\0name\0effect\0text\0", with offsets of  *
+ * each field in it. use SSA_EVENT_*() macros to get them.   *
+ * 'src' is line of input, written as is, while event is     *
+ * not marked with SSA_DIRTY                                 */
 typedef struct ssa_event
   {
     struct ssa_event *next;
-    ssa_event_type type;
+    char *str;          /* NULL, if strings not packed yet */
+    char const *src;    /* source line, NULL - regenerate */
+    int32_t start;      /* centiseconds */
+    int32_t end;        /* centiseconds */
+    uint32_t src_len;
     uint32_t layer;
-    double start;
-    double end;
-    char *style;
-    char *name;
-    int margin_r;
-    int margin_l;
-    int margin_v;
-    char *effect;
-    char *text;
+    int32_t margin_r;
+    int32_t margin_l;
+    int32_t margin_v;
+    uint16_t style_id;  /* SSA_STYLE_UNKNOWN, if not found */
+    uint16_t name;      /* offsets in 'str', style is at 0 */
+    uint16_t effect;
+    uint16_t text;
+    uint8_t type;       /* ssa_event_type */
+    uint8_t flags;      /* SSA_DIRTY, SSA_CUT */
+    uint8_t fields;     /* SSA_F_*, decoded ones. others - in 'src' */
   } ssa_event;
 
+#define SSA_EVENT_STYLE(e)  ((e)->str)
+#define SSA_EVENT_NAME(e)   ((e)->str + (e)->name)
+#define SSA_EVENT_EFFECT(e) ((e)->str + (e)->effect)
+#define SSA_EVENT_TEXT(e)   ((e)->str + (e)->text)
+
+/* fixed-size event record of compiled file (see cache.h): *
+ * same as ssa_event, but without list pointer and with    *
+ * offset of packed strings instead of pointer to them     */
+typedef struct ssa_event_rec
+  {
+    int32_t start;
+    int32_t end;
+    uint32_t str;       /* offset in strings blob */
+    uint32_t layer;
+    int32_t margin_r;
+    int32_t margin_l;
+    int32_t margin_v;
+    uint16_t style_id;
+    uint16_t name;
+    uint16_t effect;
+    uint16_t text;
+    uint8_t type;
+    uint8_t pad[3];
+  } ssa_event_rec;
+
+/* longest style, name & effect, so offsets fits in 16 bits */
+#define SSA_EVENT_FIELD_MAX ((UINT16_MAX - 3) / 3)
+
 /* Defined order & names below matches ssa_v4+ *
  * For use with ssa_v4 - rename #1             */
 #define EVENT_LAYER    1 /* Layer   */ /* 'Marked' in ssa_v4 */
@@ -154,6 +229,30 @@ typedef struct ssa_event
 #define SSA_EVENT_V4_FORMAT  "Format: Marked, Start, End, Style, Name, MarginL, MarginR, MarginV, Effect, Text"
 #define SSA_EVENT_V4P_FORMAT "Format: Layer, Start, End, Style, Name, MarginL, MarginR, MarginV, Effect, Text"
 
+/* one event in ssa_event_index */
+typedef struct ssa_event_ivl
+  {
+    int32_t start;      /* copy of event times */
+    int32_t end;
+    int32_t max;        /* max 'end' in subtree of this node */
+    uint32_t num;       /* position in events list, from 0 */
+    ssa_event *event;
+  } ssa_event_ivl;
+
+/* events by time: array, sorted by start, is also implicit  *
+ * binary tree with root in the middle, where each node keeps *
+ * max end time of its subtree. all memory lives in arena of  *
+ * ssa_file. times of events, changed after build, not seen   */
+typedef struct ssa_event_index
+  {
+    ssa_event_ivl *items;
+    size_t count;
+    int8_t levels;      /* height of tree - 1, -1 if empty */
+  } ssa_event_index;
+
+/* called for every event found in index */
+typedef void (*ssa_event_index_f)(ssa_event_ivl const * const, void *);
+
 typedef enum ssa_section
   {
     NONE,
@@ -175,9 +274,22 @@ typedef struct ssa_media
       type_image
     } type;
     char *filename; /* "Original filename before embedding" */
-    FILE *data;
+    FILE *data;      /* uue lines in temporary file, or NULL, if: */
+    char const *raw; /* ...they are in memory (compiled file)     */
+    int fd;          /* ...or it's range of input file 'fd'       */
+    off_t offset;
+    size_t len;      /* of 'raw' or range in 'fd' */
+    char *ref;       /* stripped: hash of data in media store */
   } ssa_media;
 
+/* streaming: where current event is in input, see stream_ssa_file() */
+typedef struct ssa_event_src
+  {
+    struct span line;     /* whole line, valid only during callback */
+    struct span times[2]; /* 'Start' & 'End' fields in it, trimmed   */
+    off_t offset;         /* of line in input */
+  } ssa_event_src;
+
 typedef struct ssa_file
   {
     /*** data section */
@@ -210,6 +322,10 @@ typedef struct ssa_file
 
     /*** service section */
     uint16_t flags;
+    uint8_t event_fields; /* SSA_F_*, decoded while parsing, *
+                           * others - by ssa_event_decode() */
+    char *head_src;     /* [Script Info] lines, NULL - regenerate */
+    size_t head_len;
 
     int8_t style_fields_order[MAX_FIELDS];
     int8_t event_fields_order[MAX_FIELDS];
@@ -218,52 +334,94 @@ typedef struct ssa_file
     ssa_event *events;
     ssa_media *fonts;
     ssa_media *images;
+
+    /* events of compiled file, used if 'events' is NULL: *
+     * records & their strings are right in mapped memory */
+    ssa_event_rec const *event_recs;
+    size_t event_recs_count;
+    char const *event_strs;
+    size_t event_strs_len;
+
+    ssa_style **styles_tail;     /* for appending, NULL - unknown */
+    ssa_style_index style_index;
+    ssa_event_src src;           /* streaming: source of current event */
+    struct reader *input; /* kept open, sources of events are there */
+
+    arena mem; /* all parsed data lives here */
   } ssa_file;
 
+/* streaming parse: called for each event, which is valid only *
+ * during the call. false stops parsing                         */
+typedef bool (*ssa_event_f)(context * const, ssa_file * const, ssa_event * const, void *);
+
   /** function prototypes */
 
 bool init_ssa_file(ssa_file * const);
+void free_ssa_file(ssa_file * const);
 
   /** parse functions */
-bool parse_ssa_file(FILE *, ssa_file *);
+bool parse_ssa_file(context * const, FILE *, ssa_file *);
+bool stream_ssa_file(context * const, FILE *, ssa_file *, ssa_event_f, void *);
 
 /** header section */
-bool get_ssa_param(char * const, ssa_file * const);
+bool get_ssa_param(context * const, struct span const * const, ssa_file * const);
 
 /** styles section */
-bool set_style_fields_order(char * const, ssa_version, int8_t *);
-bool detect_style_fields_order(char * const, int8_t *);
-bool get_ssa_style(char * const, ssa_style **, int8_t *);
+bool set_style_fields_order(context * const, struct span const * const, ssa_version, int8_t *);
+bool detect_style_fields_order(context * const, char * const, int8_t *);
+bool get_ssa_style(ssa_file * const, struct span const * const, int8_t *);
 
 /** events section */
-bool set_event_fields_order(char * const, ssa_version, int8_t *);
-bool detect_event_fields_order(char * const, int8_t *);
-bool get_ssa_event (char * const, ssa_event * const, int8_t *);
+bool set_event_fields_order(context * const, struct span const * const, ssa_version, int8_t *);
+bool detect_event_fields_order(context * const, char * const, int8_t *);
+bool get_ssa_event (arena * const, ssa_style_index const * const,
+                    struct span const * const, ssa_event * const, int8_t *,
+                    struct span * const, uint8_t);
+void ssa_event_decode(ssa_file * const, ssa_event * const, uint8_t);
+void ssa_event_strs(ssa_event const * const, struct span [4]);
 
 /** media section */
-int8_t detect_media_line_type(char const * const);
-bool get_ssa_media(ssa_media **, ssa_media **, char const * const);
+int8_t detect_media_line_type(context * const, struct span const * const);
+bool ssa_media_chars(struct span const * const);
+bool get_ssa_media(context * const, arena * const, ssa_media **, ssa_media **,
+                   struct span const * const, char const *);
 
 /** write functions */
-bool write_ssa_file(FILE *, ssa_file *, bool);
+bool write_ssa_file(context * const, FILE *, ssa_file *, bool);
 
-bool write_ssa_txt_param(FILE *, char *, char *, bool, bool);
-bool write_ssa_header(FILE *, ssa_file   * const, bool);
+bool write_ssa_txt_param(outbuf * const, char *, char *, bool, bool);
+bool write_ssa_header(outbuf * const, ssa_file   * const, bool);
 
-bool write_ssa_styles(FILE *, ssa_style  * const, ssa_version, bool);
-bool write_ssa_style (FILE *, ssa_style  * const, ssa_version);
+bool write_ssa_styles(outbuf * const, ssa_style  * const, ssa_version, bool);
+bool write_ssa_style (outbuf * const, ssa_style  * const, ssa_version);
 
-bool write_ssa_events(FILE *, ssa_event  * const, ssa_version, bool);
-bool write_ssa_event (FILE *, ssa_event  * const, ssa_version);
+bool write_ssa_events_head(outbuf * const, ssa_version);
+bool write_ssa_events(outbuf * const, ssa_event  * const, ssa_version, bool);
+bool write_ssa_event (outbuf * const, ssa_event  * const, ssa_version);
+bool write_ssa_event_recs(outbuf * const, ssa_event_rec const *, size_t,
+                         char const *, size_t, ssa_version);
 
-bool write_ssa_media (FILE *, ssa_media  * const, bool);
+bool write_ssa_media (outbuf * const, ssa_media  * const, bool);
+void write_ssa_media_data(outbuf * const, ssa_media * const);
 
 /** other */
-uint32_t ssa_color(char * const);
+uint32_t ssa_color(struct span const * const);
 char *ssa_version_tos(ssa_version);
-bool  ssa_section_switch(enum ssa_section *, char const * const);
-void ssa_event_append(ssa_event **, ssa_event ***,
-                      ssa_event * const, bool);
+bool  ssa_section_switch(context * const, enum ssa_section *, struct span const * const);
+void ssa_event_append(ssa_event **, ssa_event ***, ssa_event * const);
+double ssa_event_start(void const *);
+void ssa_event_pack(arena * const, ssa_event * const, struct span const [4]);
 ssa_style *find_ssa_style_by_name(ssa_file *, char *);
+uint16_t ssa_style_add(ssa_file * const, ssa_style * const);
+uint16_t ssa_style_id(ssa_style_index const * const, char const *, size_t);
+
+/** events index */
+void ssa_event_index_build(ssa_file * const, ssa_event_index * const);
+size_t ssa_event_index_overlap(ssa_event_index const * const, int32_t, int32_t,
+                               ssa_event_index_f, void *);
+size_t ssa_event_index_starts(ssa_event_index const * const, int32_t, int32_t,
+                              ssa_event_index_f, void *);
+size_t ssa_event_index_active(ssa_event_index const * const, int32_t,
+                              ssa_event_index_f, void *);
 
 #endif /* _SSA_H */
@@ -0,0 +1,226 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+#include "store.h"
+
+#define MSG_S_NOTFOUND  _("No file '%s' in media store.")
+#define MSG_S_MISMATCH  _("File '%s' in media store has wrong size.")
+
+/* sha256, FIPS 180-4 */
+struct sha256
+  {
+    uint32_t h[8];
+    uint8_t buf[64];
+    size_t used;
+    uint64_t len;
+  };
+
+static uint32_t const sha256_k[64] =
+  {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+  };
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void
+sha256_block(struct sha256 * const s, uint8_t const *p)
+  {
+    uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+    uint8_t i = 0;
+
+    for (i = 0; i < 16; i++, p += 4)
+      w[i] = ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    for (i = 16; i < 64; i++)
+      w[i] = w[i - 16] + w[i - 7] +
+             (ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+             (ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19)  ^ (w[i - 2] >> 10));
+
+    a = s->h[0], b = s->h[1], c = s->h[2], d = s->h[3];
+    e = s->h[4], f = s->h[5], g = s->h[6], h = s->h[7];
+
+    for (i = 0; i < 64; i++)
+      {
+        t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) +
+             sha256_k[i] + w[i];
+        t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g, g = f, f = e, e = d + t1;
+        d = c, c = b, b = a, a = t1 + t2;
+      }
+
+    s->h[0] += a, s->h[1] += b, s->h[2] += c, s->h[3] += d;
+    s->h[4] += e, s->h[5] += f, s->h[6] += g, s->h[7] += h;
+  }
+
+/* Computes sha256 of 'len' bytes as hex string, *
+ * 'hex' should have STORE_HEX_LEN + 1 bytes     */
+void
+store_hash(uint8_t const *data, size_t len, char *hex)
+  {
+    struct sha256 s = { { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                          0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 },
+                        { 0 }, 0, 0 };
+    size_t i = 0;
+
+    s.len = (uint64_t) len * 8;
+
+    for (; len >= 64; data += 64, len -= 64)
+      sha256_block(&s, data);
+
+    /* tail, 0x80 & length in bits, one or two blocks */
+    memcpy(s.buf, data, len);
+    s.buf[len] = 0x80;
+    if (len >= 56)
+      {
+        sha256_block(&s, s.buf);
+        memset(s.buf, 0, 64);
+      }
+    for (i = 0; i < 8; i++)
+      s.buf[63 - i] = s.len >> (i * 8);
+    sha256_block(&s, s.buf);
+
+    for (i = 0; i < 8; i++)
+      sprintf(hex + i * 8, "%08x", s.h[i]);
+  }
+
+/* Checks, that line of media is reference to store, *
+ * copies hash from it to 'hex' (STORE_HEX_LEN + 1)  */
+bool
+store_ref(char const *line, size_t len, char *hex)
+  {
+    size_t prefix = strlen(STORE_REF), i = 0;
+
+    if (len != prefix + STORE_HEX_LEN || memcmp(line, STORE_REF, prefix) != 0)
+      return false;
+
+    /* it goes to path, so strictly */
+    for (i = prefix; i < len; i++)
+      if (!isdigit(line[i]) && !(line[i] >= 'a' && line[i] <= 'f'))
+        return false;
+
+    memcpy(hex, line + prefix, STORE_HEX_LEN);
+    hex[STORE_HEX_LEN] = '\0';
+
+    return true;
+  }
+
+static char *
+store_path(char const *dir, char const *hex)
+  {
+    char *path = NULL;
+
+    CALLOC(path, strlen(dir) + STORE_HEX_LEN + 5, sizeof(char));
+    sprintf(path, "%s/%.2s/%s", dir, hex, hex);
+
+    return path;
+  }
+
+/* Puts file to store 'dir', if there is no such one yet, puts *
+ * it's hash to 'hex'. File is written under temporary name &  *
+ * renamed, so other processes never see it incomplete.        *
+ * Only warnings here, returns false on failure                */
+bool
+store_put(context * const ctx, char const *dir, uint8_t const *data,
+          size_t len, char *hex)
+  {
+    struct stat st;
+    char *path = NULL, *tmp = NULL;
+    int fd = -1;
+    ssize_t r = 0;
+    size_t done = 0;
+    bool result = false;
+
+    store_hash(data, len, hex);
+    path = store_path(dir, hex);
+
+    if (stat(path, &st) == 0)
+      {
+        if ((result = ((size_t) st.st_size == len)) == false)
+          log_msg(ctx, warn, MSG_S_MISMATCH, path);
+        free(path);
+        return result;
+      }
+
+    /* subdir, may be already made */
+    path[strlen(dir) + 3] = '\0';
+    mkdir(dir, 0755), mkdir(path, 0755);
+    path[strlen(dir) + 3] = '/';
+
+    CALLOC(tmp, strlen(path) + 8, sizeof(char));
+    sprintf(tmp, "%s.XXXXXX", path);
+
+    if ((fd = mkstemp(tmp)) < 0)
+      log_msg(ctx, warn, MSG_F_OWRFAIL, tmp);
+    else
+      {
+        while (done < len && (r = write(fd, data + done, len - done)) > 0)
+          done += r;
+        result = (done == len);
+        result &= (close(fd) == 0);
+        /* mkstemp() makes it 0600, files in store are public */
+        result &= (chmod(tmp, 0644) == 0);
+        result &= (rename(tmp, path) == 0);
+
+        if (!result)
+          log_msg(ctx, warn, MSG_F_WRFAIL), unlink(tmp);
+      }
+
+    free(tmp);
+    free(path);
+
+    return result;
+  }
+
+/* Reads file with hash 'hex' from store 'dir', *
+ * returns NULL with warning, if it's missing   */
+uint8_t *
+store_get(context * const ctx, char const *dir, char const *hex, size_t *len)
+  {
+    FILE *f = NULL;
+    struct stat st;
+    uint8_t *data = NULL;
+    char *path = store_path(dir, hex);
+
+    if ((f = fopen(path, "r")) == NULL || fstat(fileno(f), &st) != 0)
+      {
+        log_msg(ctx, warn, MSG_S_NOTFOUND, path);
+        if (f != NULL)
+          fclose(f);
+        free(path);
+        return NULL;
+      }
+
+    *len = st.st_size;
+    CALLOC(data, *len + 1, sizeof(uint8_t));
+
+    if (fread(data, sizeof(uint8_t), *len, f) != *len)
+      {
+        log_msg(ctx, warn, MSG_F_RDFAIL, strerror(errno));
+        free(data), data = NULL;
+      }
+
+    fclose(f);
+    free(path);
+
+    return data;
+  }
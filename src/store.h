@@ -0,0 +1,32 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef _STORE_H
+#define _STORE_H
+
+/* Content-addressed store of embedded files: each one is kept once, *
+ * decoded, as '<dir>/<first 2 hex digits>/<sha256 in hex>'. Stripped *
+ * font or image has one line "sha256:<hex>" instead of uue lines     */
+#define STORE_REF     "sha256:"
+#define STORE_HEX_LEN 64
+
+/** function prototypes */
+void     store_hash(uint8_t const *, size_t, char *);
+bool     store_ref(char const *, size_t, char *);
+bool     store_put(context * const, char const *, uint8_t const *, size_t, char *);
+uint8_t *store_get(context * const, char const *, char const *, size_t *);
+
+#endif /* _STORE_H */
@@ -19,22 +19,21 @@
 
 #define PROG_NAME "test_parse_microsub"
 
-extern struct options opts;
-uint32_t line_num = 0;
-
 int main(int argc, char *argv[])
   {
     microsub_file file;
+    context ctx;
 
     memset(&file, 0, sizeof(microsub_file));
+    context_init(&ctx);
 
     if (argc < 1)
       exit(EXIT_FAILURE);
 
-    if ((opts.infile = fopen(argv[1], "r")) == NULL)
-       log_msg(error, MSG_F_ORDFAIL, argv[1]);
+    if ((ctx.opts.infile = fopen(argv[1], "r")) == NULL)
+       log_msg(&ctx, error, MSG_F_ORDFAIL, argv[1]);
 
-    if (parse_microsub_file(opts.infile, &file) == false)
+    if (parse_microsub_file(&ctx, ctx.opts.infile, &file) == false)
       exit(EXIT_FAILURE);
     else
       printf("Success!\n");
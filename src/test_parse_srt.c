@@ -19,24 +19,23 @@
 
 #define PROG_NAME "test_parse_srt"
 
-extern struct options opts;
-uint32_t line_num = 0;
-
 int main(int argc, char *argv[])
   {
     FILE *infile = (FILE *) 0;
     srt_file file;
+    context ctx;
 
     memset(&file, 0, sizeof(srt_file));
-    opts.msglevel = info;
+    context_init(&ctx);
+    ctx.opts.msglevel = info;
 
     if (argc < 1)
       exit(EXIT_FAILURE);
 
-    if ((opts.infile = fopen(argv[1], "r")) == NULL)
-       log_msg(error, MSG_F_ORDFAIL, argv[1]);
+    if ((ctx.opts.infile = fopen(argv[1], "r")) == NULL)
+       log_msg(&ctx, error, MSG_F_ORDFAIL, argv[1]);
 
-    if (parse_srt_file(infile, &file) == false)
+    if (parse_srt_file(&ctx, infile, &file) == false)
       exit(EXIT_FAILURE);
     else
       printf("Success!\n");
@@ -15,30 +15,31 @@
  */
 
 #include "common.h"
+#include "arena.h"
+#include "outbuf.h"
 #include "ssa.h"
 
 #define PROG_NAME "test_parse_ssa"
 
-uint32_t line_num = 0;
-extern struct options opts;
-
 int main(int argc, char *argv[])
   {
     ssa_file file;
+    context ctx;
 
     memset(&file, 0, sizeof(ssa_file));
+    context_init(&ctx);
     init_ssa_file(&file);
 
     if (argc < 1)
       exit(EXIT_FAILURE);
 
-    if ((opts.infile = fopen(argv[1], "r")) == NULL)
-       log_msg(error, MSG_F_ORDFAIL, argv[1]);
+    if ((ctx.opts.infile = fopen(argv[1], "r")) == NULL)
+       log_msg(&ctx, error, MSG_F_ORDFAIL, argv[1]);
 
-    if (parse_ssa_file(opts.infile, &file) == false)
+    if (parse_ssa_file(&ctx, ctx.opts.infile, &file) == false)
       exit(EXIT_FAILURE);
 
-    write_ssa_file(stdout, &file, true);
+    write_ssa_file(&ctx, stdout, &file, true);
 
     putc('\n', stdout);
 
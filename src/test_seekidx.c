@@ -0,0 +1,154 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+#include "arena.h"
+#include "outbuf.h"
+#include "reader.h"
+#include "ssa.h"
+#include "seekidx.h"
+
+#define PROG_NAME "test_seekidx"
+
+static char const *header = "\
+[Script Info]\n\
+ScriptType: v4.00+\n\
+\n\
+[V4+ Styles]\n\
+Format: Name, Fontname\n\
+Style: Default,Sans\n\
+\n";
+
+/* uue line, that starts with '[', should not switch section */
+static char const *fonts = "\
+[Fonts]\n\
+fontname: a_0.ttf\n\
+[[[[!!!!\n\
+````\n\
+\n";
+
+static char const *graphics = "\
+[Graphics]\n\
+filename: b.png\n\
+[!!!\n\
+\n";
+
+static char const *events = "\
+[Events]\n\
+Format: Layer, Start, End, Style, Text\n\
+Dialogue: 0,0:00:01.00,0:00:02.00,Default,a\n\
+Dialogue: 0,0:00:03.00,0:00:04.50,Default,b\n\
+\n";
+
+/* builds index of sections, joined in given order, and *
+ * checks range of [Events] and bounds of it's block     */
+static bool
+check(context * const ctx, char const *name, char const **parts)
+  {
+    char text[MAXLINE] = "";
+    char const *from = NULL, *to = NULL;
+    FILE *f = NULL;
+    seekidx idx;
+    bool ok = false;
+
+    for (; *parts != NULL; parts++)
+      strcat(text, *parts);
+
+    from = strstr(text, "Dialogue:");
+    to = strstr(from, "\n[");
+    to = (to != NULL) ? to + 1 : text + strlen(text);
+
+    if ((f = tmpfile()) == NULL || fputs(text, f) == EOF || fflush(f) != 0)
+      log_msg(ctx, error, MSG_F_WRFAIL);
+
+    if (seekidx_build(ctx, f, &idx))
+      ok = idx.ev_from == (size_t) (from - text) &&
+           idx.ev_to   == (size_t) (to - text) &&
+           idx.count == 1 && idx.blocks[0].offset == idx.ev_from &&
+           idx.blocks[0].start == 100 && idx.blocks[0].end == 450;
+
+    printf("%-24s %s\n", name, (ok) ? "ok" : "FAILED");
+
+    seekidx_free(&idx);
+    fclose(f);
+
+    return ok;
+  }
+
+/* index, saved before same-size rewrite of file in place *
+ * (like 'ssa-retime -P' does), should be taken as stale   */
+static bool
+check_rewrite(context * const ctx)
+  {
+    char text[MAXLINE] = "";
+    char name[] = "/tmp/" PROG_NAME ".XXXXXX";
+    char *t = NULL;
+    FILE *f = NULL;
+    seekidx idx, saved;
+    bool fresh = false, stale = false;
+    int fd = -1;
+
+    strcat(strcat(text, header), events);
+    t = strstr(text, "0:00:01.00");
+
+    if ((f = tmpfile()) == NULL || fputs(text, f) == EOF || fflush(f) != 0 ||
+        (fd = mkstemp(name)) < 0)
+      log_msg(ctx, error, MSG_F_WRFAIL);
+    close(fd);
+
+    if (seekidx_build(ctx, f, &idx) && seekidx_write(ctx, name, &idx))
+      {
+        fresh = seekidx_read(ctx, name, f, &saved);
+        seekidx_free(&saved);
+
+        memcpy(t, "0:00:05.00", 10); /* the same length */
+        rewind(f);
+        if (fputs(text, f) == EOF || fflush(f) != 0)
+          log_msg(ctx, error, MSG_F_WRFAIL);
+
+        ctx->opts.msglevel = error; /* 'outdated' is expected */
+        stale = !seekidx_read(ctx, name, f, &saved);
+        ctx->opts.msglevel = warn;
+        seekidx_free(&saved);
+      }
+
+    printf("%-24s %s\n", "same-size rewrite", (fresh && stale) ? "ok" : "FAILED");
+
+    seekidx_free(&idx);
+    unlink(name);
+    fclose(f);
+
+    return fresh && stale;
+  }
+
+int main(void)
+  {
+    char const *ev_first[] = { header, events, fonts, graphics, NULL };
+    char const *media_first[] = { header, fonts, graphics, events, NULL };
+    char const *media_around[] = { header, fonts, events, graphics, NULL };
+    context ctx;
+    bool ok = true;
+
+    context_init(&ctx);
+    ctx.opts.msglevel = warn;
+
+    ok &= check(&ctx, "events before media", ev_first);
+    ok &= check(&ctx, "media before events", media_first);
+    ok &= check(&ctx, "media around events", media_around);
+    ok &= check_rewrite(&ctx);
+
+    exit((ok) ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
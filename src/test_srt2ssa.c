@@ -0,0 +1,84 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+
+#define PROG_NAME "test_srt2ssa"
+
+/* Runs srt2ssa, given as first argument, and checks exact     *
+ * events it writes: fields, not set by srt, come from template */
+static char const *input = "\
+1\n\
+00:00:01,500 --> 00:00:03,250\n\
+<b>Hello</b>\n\
+world\n\
+\n\
+2\n\
+01:02:03,040 --> 01:02:05,000\n\
+plain\n\
+\n";
+
+static char const *expected[] = {
+  "Dialogue: 0,0:00:01.50,0:00:03.25,Default,,0000,0000,0000,,{\\b1}Hello{\\b0}\\nworld{}\n",
+  "Dialogue: 0,1:02:03.04,1:02:05.00,Default,,0000,0000,0000,,plain\n",
+  NULL
+};
+
+int main(int argc, char *argv[])
+  {
+    char name[] = "/tmp/" PROG_NAME ".XXXXXX";
+    char cmd[MAXLINE];
+    char line[MAXLINE];
+    char const **e = expected;
+    FILE *f = NULL;
+    int fd = -1;
+    bool ok = true;
+
+    if (argc < 2)
+      {
+        fprintf(stderr, "Usage: %s <srt2ssa>\n", PROG_NAME);
+        exit(EXIT_FAILURE);
+      }
+
+    if ((fd = mkstemp(name)) < 0 || (f = fdopen(fd, "w")) == NULL ||
+        fputs(input, f) == EOF || fclose(f) != 0)
+      exit(EXIT_FAILURE);
+
+    snprintf(cmd, MAXLINE, "'%s' -q -f ass -i '%s'", argv[1], name);
+    if ((f = popen(cmd, "r")) == NULL)
+      exit(EXIT_FAILURE);
+
+    while (fgets(line, MAXLINE, f) != NULL)
+      {
+        if (strncmp(line, "Dialogue:", 9) != 0)
+          continue;
+        if (*e == NULL || strcmp(line, *e) != 0)
+          {
+            printf("unexpected: %s", line);
+            ok = false;
+          }
+        if (*e != NULL)
+          e++;
+      }
+
+    if (pclose(f) != 0 || *e != NULL)
+      ok = false;
+    unlink(name);
+
+    printf("%-24s %s\n", "dialogue lines", (ok) ? "ok" : "FAILED");
+
+    exit((ok) ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
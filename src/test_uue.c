@@ -0,0 +1,146 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+#include "uue.h"
+
+#define PROG_NAME "test_uue"
+
+/* large block: many full lines, partial group at the end */
+#define LARGE_LEN  (1024 * 1024 + 7)
+/* width of lines, to which encoded data is wrapped again: *
+ * groups are split between lines then                    */
+#define WRAP_CHARS 7
+/* written past the end of output buffers, should stay there */
+#define GUARD      0x5A
+
+/* the same data on each run */
+static void
+fill(uint8_t *data, size_t len)
+  {
+    uint32_t seed = 12345;
+    size_t i = 0;
+
+    for (i = 0; i < len; i++)
+      {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (seed >> 16) & 0xFF;
+      }
+  }
+
+/* lines are at most UUE_LINE_CHARS long, all chars are in alphabet */
+static bool
+check_lines(char const *enc, size_t len)
+  {
+    char const *p = enc, *end = enc + len, *eol = NULL;
+
+    for (; p < end; p = eol + 1)
+      {
+        if ((eol = memchr(p, '\n', end - p)) == NULL ||
+            eol - p == 0 || eol - p > UUE_LINE_CHARS)
+          return false;
+        for (; p < eol; p++)
+          if (*p < UUE_OFFSET || *p > UUE_OFFSET + 0x3F)
+            return false;
+      }
+
+    return true;
+  }
+
+/* decodes 'enc' and compares result with 'data' */
+static bool
+check_decode(uint8_t const *data, size_t len, char const *enc, size_t enc_len)
+  {
+    uint8_t *dec = NULL;
+    size_t out = 0;
+    bool ok = false;
+
+    CALLOC(dec, UUE_DECODED_MAX(enc_len) + 1, sizeof(uint8_t));
+    dec[UUE_DECODED_MAX(enc_len)] = GUARD;
+
+    ok = uue_decode(dec, &out, enc, enc_len) && out == len &&
+         memcmp(dec, data, len) == 0 && dec[UUE_DECODED_MAX(enc_len)] == GUARD;
+
+    free(dec);
+
+    return ok;
+  }
+
+/* the same data, but in WRAP_CHARS lines with "\r\n" */
+static size_t
+rewrap(char *dst, char const *enc, size_t len)
+  {
+    char *p = dst;
+    size_t n = 0;
+
+    for (; len > 0; enc++, len--)
+      {
+        if (*enc == '\n')
+          continue;
+        *p++ = *enc;
+        if (++n % WRAP_CHARS == 0)
+          *p++ = '\r', *p++ = '\n';
+      }
+
+    return p - dst;
+  }
+
+static bool
+check(size_t len)
+  {
+    uint8_t *data = NULL;
+    char *enc = NULL, *wrapped = NULL;
+    size_t enc_len = uue_encoded_len(len);
+    bool ok = false;
+
+    CALLOC(data, len + 1, sizeof(uint8_t));
+    CALLOC(enc, enc_len + 1, sizeof(char));
+    CALLOC(wrapped, enc_len / WRAP_CHARS * 2 + enc_len + 1, sizeof(char));
+    fill(data, len);
+    enc[enc_len] = GUARD;
+
+    ok = uue_encode(enc, data, len) == enc_len &&
+         enc[enc_len] == GUARD &&
+         check_lines(enc, enc_len) &&
+         check_decode(data, len, enc, enc_len) &&
+         check_decode(data, len, wrapped, rewrap(wrapped, enc, enc_len));
+
+    if (!ok)
+      printf("%-24s %lu bytes FAILED\n", "round trip", (unsigned long) len);
+
+    free(wrapped);
+    free(enc);
+    free(data);
+
+    return ok;
+  }
+
+int main(void)
+  {
+    size_t len = 0;
+    bool ok = true, all = true;
+
+    for (len = 0; len <= 64; len++)
+      ok &= check(len);
+    printf("%-24s %s\n", "lengths 0..64", (ok) ? "ok" : "FAILED");
+    all &= ok;
+
+    ok = check(LARGE_LEN);
+    printf("%-24s %s\n", "large block", (ok) ? "ok" : "FAILED");
+    all &= ok;
+
+    exit((all) ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
@@ -0,0 +1,240 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include "common.h"
+#include "uue.h"
+
+/* 4 chars -> 3 bytes. false, if any char is out of alphabet */
+static inline bool
+uue_group_decode(uint8_t *dst, char const *src)
+  {
+    uint8_t a = src[0] - UUE_OFFSET, b = src[1] - UUE_OFFSET;
+    uint8_t c = src[2] - UUE_OFFSET, d = src[3] - UUE_OFFSET;
+    uint32_t v = 0;
+
+    if ((a | b | c | d) & 0xC0)
+      return false;
+
+    v = (a << 18) | (b << 12) | (c << 6) | d;
+    dst[0] = v >> 16, dst[1] = v >> 8, dst[2] = v;
+
+    return true;
+  }
+
+/* 3 bytes -> 4 chars */
+static inline void
+uue_group_encode(char *dst, uint8_t const *src)
+  {
+    uint32_t v = (src[0] << 16) | (src[1] << 8) | src[2];
+
+    dst[0] = ((v >> 18) & 0x3F) + UUE_OFFSET;
+    dst[1] = ((v >> 12) & 0x3F) + UUE_OFFSET;
+    dst[2] = ((v >>  6) & 0x3F) + UUE_OFFSET;
+    dst[3] = ( v        & 0x3F) + UUE_OFFSET;
+  }
+
+/* decodes 'len' chars (multiple of 4) without line breaks */
+static bool
+uue_run_decode(uint8_t *dst, char const *src, size_t len)
+  {
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i v, t, bad = _mm_setzero_si128();
+    __m128i odd = _mm_set_epi32(-1, 0, -1, 0);
+    int32_t last = 0;
+
+    /* 16 chars -> 12 bytes. 6-bit values are joined into   *
+     * 12-bit pairs in 16-bit lanes, then into 24-bit groups *
+     * in 32-bit lanes, then groups are packed without gaps  */
+    for (; i + 16 <= len; i += 16, dst += 12)
+      {
+        v = _mm_sub_epi8(_mm_loadu_si128((__m128i const *) (src + i)),
+                         _mm_set1_epi8(UUE_OFFSET));
+        bad = _mm_or_si128(bad, v);
+
+        t = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00FF)), 6),
+                         _mm_srli_epi16(v, 8));
+        v = _mm_madd_epi16(t, _mm_set1_epi32(0x00011000));
+        /* 32-bit lanes: [b2 b1 b0 0] -> [b0 b1 b2 0] */
+        v = _mm_or_si128(_mm_or_si128(_mm_srli_epi32(v, 16),
+                           _mm_and_si128(v, _mm_set1_epi32(0x0000FF00))),
+                         _mm_and_si128(_mm_slli_epi32(v, 16), _mm_set1_epi32(0x00FF0000)));
+        /* 4 x 3 bytes in 32-bit lanes -> 12 bytes in a row */
+        v = _mm_or_si128(_mm_andnot_si128(odd, v),
+                         _mm_srli_epi64(_mm_and_si128(odd, v), 8));
+        v = _mm_or_si128(_mm_move_epi64(v), _mm_slli_si128(_mm_srli_si128(v, 8), 6));
+
+        _mm_storel_epi64((__m128i *) dst, v);
+        last = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+        memcpy(dst + 8, &last, 4);
+      }
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(bad, _mm_set1_epi8((char) 0xC0)),
+                                         _mm_setzero_si128())) != 0xFFFF)
+      return false;
+#endif
+
+    for (; i < len; i += 4, dst += 3)
+      if (!uue_group_decode(dst, src + i))
+        return false;
+
+    return true;
+  }
+
+/* encodes 'len' bytes (multiple of 3) into one run of chars, *
+ * 'avail' - how many bytes may be read from 'src'             */
+static void
+uue_run_encode(char *dst, uint8_t const *src, size_t len, size_t avail)
+  {
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i v, n;
+    uint8_t pad[16] = { 0 };
+
+    /* 12 bytes -> 16 chars, reverse of uue_run_decode(). last *
+     * load of input's end goes through copy, not past it      */
+    for (; i + 12 <= len; i += 12, dst += 16)
+      {
+        if (i + 16 > avail)
+          {
+            memcpy(pad, src + i, 12);
+            v = _mm_loadu_si128((__m128i const *) pad);
+          }
+        else
+          v = _mm_loadu_si128((__m128i const *) (src + i));
+
+        /* 12 bytes in a row -> 4 x 3 bytes in 32-bit lanes */
+        v = _mm_unpacklo_epi64(v, _mm_srli_si128(v, 6));
+        v = _mm_or_si128(_mm_and_si128(v, _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF)),
+                         _mm_and_si128(_mm_slli_epi64(v, 8),
+                                       _mm_set_epi32(0x00FFFFFF, 0, 0x00FFFFFF, 0)));
+        /* [b0 b1 b2 0] -> 24-bit group value */
+        n = _mm_or_si128(_mm_or_si128(_mm_srli_epi32(v, 16),
+                           _mm_and_si128(v, _mm_set1_epi32(0x0000FF00))),
+                         _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x000000FF)), 16));
+        /* and it's 6-bit parts, one per byte */
+        v = _mm_and_si128(_mm_srli_epi32(n, 18), _mm_set1_epi32(0x0000003F));
+        v = _mm_or_si128(v, _mm_and_si128(_mm_srli_epi32(n, 4),  _mm_set1_epi32(0x00003F00)));
+        v = _mm_or_si128(v, _mm_and_si128(_mm_slli_epi32(n, 10), _mm_set1_epi32(0x003F0000)));
+        v = _mm_or_si128(v, _mm_and_si128(_mm_slli_epi32(n, 24), _mm_set1_epi32(0x3F000000)));
+        v = _mm_add_epi8(v, _mm_set1_epi8(UUE_OFFSET));
+
+        _mm_storeu_si128((__m128i *) dst, v);
+      }
+#else
+    (void) avail;
+#endif
+
+    for (; i < len; i += 3, dst += 4)
+      uue_group_encode(dst, src + i);
+  }
+
+/* exact length of encoded 'len' bytes, '\n' after each line included */
+size_t
+uue_encoded_len(size_t len)
+  {
+    size_t chars = len / 3 * 4 + ((len % 3) ? len % 3 + 1 : 0);
+
+    return chars + (chars + UUE_LINE_CHARS - 1) / UUE_LINE_CHARS;
+  }
+
+/* Writes 'len' bytes of 'src' as uue lines to 'dst', which should *
+ * have room for uue_encoded_len() chars. Returns written length   */
+size_t
+uue_encode(char *dst, uint8_t const *src, size_t len)
+  {
+    char *p = dst;
+    uint8_t last[3] = { 0, 0, 0 };
+    char group[4];
+    size_t n = 0, rest = 0;
+
+    for (; len > 0; src += n, len -= n)
+      {
+        n = (len < UUE_LINE_BYTES) ? len : UUE_LINE_BYTES;
+        rest = n % 3;
+
+        uue_run_encode(p, src, n - rest, len);
+        p += (n - rest) / 3 * 4;
+
+        if (rest > 0) /* end of data: partial group */
+          {
+            memcpy(last, src + n - rest, rest);
+            uue_group_encode(group, last);
+            memcpy(p, group, rest + 1);
+            p += rest + 1;
+          }
+
+        *p++ = '\n';
+      }
+
+    return p - dst;
+  }
+
+/* Decodes uue lines from 'src' to 'dst', which should have room *
+ * for UUE_DECODED_MAX(len) bytes, decoded length is put to 'out' *
+ * Line breaks ("\n" or "\r\n") & empty lines are skipped, group  *
+ * may be split between lines. Returns false on malformed data    */
+bool
+uue_decode(uint8_t *dst, size_t *out, char const *src, size_t len)
+  {
+    char const *end = src + len, *eol = NULL, *p = src;
+    char const *stop = NULL;
+    char group[4] = { 0, 0, 0, 0 };
+    uint8_t bytes[3];
+    uint8_t *d = dst;
+    size_t n = 0, pending = 0;
+
+    for (; p < end; p = eol + 1)
+      {
+        if ((eol = memchr(p, '\n', end - p)) == NULL)
+          eol = end;
+        stop = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+
+        /* group, started on previous line */
+        while (pending > 0 && pending < 4 && p < stop)
+          group[pending++] = *p++;
+        if (pending == 4)
+          {
+            if (!uue_group_decode(d, group))
+              return false;
+            d += 3, pending = 0;
+          }
+
+        n = (stop - p) & ~((size_t) 3);
+        if (!uue_run_decode(d, p, n))
+          return false;
+        d += n / 4 * 3, p += n;
+
+        while (p < stop)
+          group[pending++] = *p++;
+      }
+
+    /* incomplete group: 2 chars - 1 byte, 3 chars - 2 bytes */
+    if (pending == 1)
+      return false;
+    if (pending > 1)
+      {
+        memset(group + pending, UUE_OFFSET, 4 - pending);
+        if (!uue_group_decode(bytes, group))
+          return false;
+        memcpy(d, bytes, pending - 1);
+        d += pending - 1;
+      }
+
+    *out = d - dst;
+
+    return true;
+  }
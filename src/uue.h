@@ -0,0 +1,36 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#ifndef _UUE_H
+#define _UUE_H
+
+/* Embedded files in [Fonts] & [Graphics] are uue-encoded, but with *
+ * alphabet shifted by one ('!' - '`'), without header, line length *
+ * byte & trailer. Lines are 80 chars, last group may be incomplete *
+ * (2 or 3 chars for 1 or 2 bytes). See doc/embeded_files          */
+#define UUE_OFFSET     33
+#define UUE_LINE_CHARS 80
+#define UUE_LINE_BYTES 60
+
+/* enough for data of 'len' encoded chars, line breaks included */
+#define UUE_DECODED_MAX(len) ((len) / 4 * 3 + 3)
+
+/** function prototypes */
+size_t uue_encoded_len(size_t);
+size_t uue_encode(char *, uint8_t const *, size_t);
+bool   uue_decode(uint8_t *, size_t *, char const *, size_t);
+
+#endif /* _UUE_H */